@@ -33,3 +33,62 @@ void mrtp_free(void * memory) {
 	callbacks.free(memory);
 }
 
+
+// an arena counts what a host and its peers hold, peerUsed is what the peer the memory is for holds,
+// NULL if it is for the host, a budget that would be exceeded turns the memory down instead of no_memory
+int mrtp_arena_reserve(MRtpMemoryArena * arena, size_t * peerUsed, MRtpMemoryType type, size_t size) {
+
+	if (arena == NULL)
+		return 0;
+
+	if ((arena->budget != 0 && arena->totalUsed + size > arena->budget) ||
+		(peerUsed != NULL && arena->peerBudget != 0 && *peerUsed + size > arena->peerBudget))
+	{
+		++arena->refusals;
+
+		return -1;
+	}
+
+	arena->used[type] += size;
+	arena->totalUsed += size;
+	if (arena->totalUsed > arena->peakUsed)
+		arena->peakUsed = arena->totalUsed;
+
+	if (peerUsed != NULL)
+		*peerUsed += size;
+
+	return 0;
+}
+
+void mrtp_arena_release(MRtpMemoryArena * arena, size_t * peerUsed, MRtpMemoryType type, size_t size) {
+
+	if (arena == NULL)
+		return;
+
+	arena->used[type] -= size;
+	arena->totalUsed -= size;
+
+	if (peerUsed != NULL)
+		*peerUsed -= size;
+}
+
+void * mrtp_arena_malloc(MRtpMemoryArena * arena, size_t * peerUsed, MRtpMemoryType type, size_t size) {
+
+	void * memory;
+
+	if (mrtp_arena_reserve(arena, peerUsed, type, size) < 0)
+		return NULL;
+
+	memory = mrtp_malloc(size);
+	if (memory == NULL)
+		mrtp_arena_release(arena, peerUsed, type, size);
+
+	return memory;
+}
+
+// size is the one the memory was allocated with
+void mrtp_arena_free(MRtpMemoryArena * arena, size_t * peerUsed, MRtpMemoryType type, void * memory, size_t size) {
+
+	mrtp_free(memory);
+	mrtp_arena_release(arena, peerUsed, type, size);
+}
@@ -51,7 +51,13 @@ extern "C"
 		MRTP_SOCKOPT_RCVTIMEO = 6,
 		MRTP_SOCKOPT_SNDTIMEO = 7,
 		MRTP_SOCKOPT_ERROR = 8,
-		MRTP_SOCKOPT_NODELAY = 9
+		MRTP_SOCKOPT_NODELAY = 9,
+		MRTP_SOCKOPT_UDP_SEGMENT = 10,
+		MRTP_SOCKOPT_UDP_GRO = 11,
+		MRTP_SOCKOPT_REUSEPORT = 12,
+		MRTP_SOCKOPT_TIMESTAMP = 13,
+		MRTP_SOCKOPT_ZEROCOPY = 14,
+		MRTP_SOCKOPT_TXTIME = 15
 	} MRtpSocketOption;
 
 	typedef enum _MRtpSocketShutdown {
@@ -70,6 +76,19 @@ extern "C"
 		mrtp_uint16 port;
 	} MRtpAddress;
 
+	// one outgoing datagram of a batched send
+	typedef struct _MRtpSocketMessage {
+		MRtpAddress address;
+		MRtpBuffer * buffers;
+		size_t bufferCount;
+		size_t segmentSize;                 // if not 0, the buffers hold datagrams of this size for the kernel to split, the last one may be shorter
+		mrtp_uint32 sendTime;               // if not 0, the mrtp_time_micro time the kernel holds the datagram back to (SO_TXTIME)
+		size_t sentLength;                  // filled in by mrtp_socket_send_batch
+	} MRtpSocketMessage;
+
+	// io_uring of one socket, see uring.c
+	typedef struct _MRtpSocketRing MRtpSocketRing;
+
 	typedef enum _MRtpPacketFlag {
 		MRTP_PACKET_FLAG_RELIABLE = (1 << 0),
 		MRTP_PACKET_FLAG_NO_ALLOCATE = (1 << 2),
@@ -86,18 +105,121 @@ extern "C"
 	typedef struct _MRtpPacket {
 		size_t                   referenceCount;  // internal use only 
 		mrtp_uint32              flags;           // bitwise-or of MRtpPacketFlag constants 
-		mrtp_uint8 *             data;            // allocated data for packet 
+		mrtp_uint8 *             data;            // data of the packet, it follows the packet in the same block unless it grew past capacity or is not allocated
 		size_t                   dataLength;      // length of data 
 		MRtpPacketFreeCallback   freeCallback;    // function to be called when the packet is no longer in use 
+		struct _MRtpPacketPool * pool;            // internal use only, the pool the packet block goes back to, NULL if it was allocated on its own
+		size_t                   capacity;        // internal use only, room for data in the packet block
+		struct _MRtpReceiveSlab * slab;           // internal use only, the receive slab the data points into, NULL if it doesn't
 	} MRtpPacket;
 
+	enum
+	{
+		MRTP_PACKET_POOL_CLASSES = 11,          // block sizes of a packet pool, the data doubles from the minimum up to 64KB
+		MRTP_PACKET_POOL_MINIMUM_DATA = 64,
+		MRTP_PACKET_POOL_SLAB_SIZE = 64 * 1024,
+		MRTP_PACKET_POOL_MINIMUM_SLAB_BLOCKS = 4, // the slabs of the large classes grow past the slab size to hold this many blocks
+		MRTP_PACKET_INLINE_DATA = 128,          // incoming payloads shorter than this are copied into the packet block rather than pin a receive slab
+	};
+
+	// size classed blocks that hold a packet with its data, carved from slabs and recycled
+	typedef struct _MRtpPacketPool {
+		MRtpPacket * freePackets[MRTP_PACKET_POOL_CLASSES];	// free blocks of each class, linked through their data pointers
+		void * slabs;
+		size_t slabCount;
+		size_t largeSlabs;                  // slabs grown past the slab size to hold the minimum blocks
+		size_t usedPackets;                 // blocks taken and not destroyed yet
+		int destroyed;                      // the host let go of the pool, it is freed with its last block
+	} MRtpPacketPool;
+
+	// a receive buffer that the packets delivered from it point into, the data follows the header
+	typedef struct _MRtpReceiveSlab {
+		size_t referenceCount;              // the host while it receives into the slab, and each packet into it
+		struct _MRtpReceiveSlab * next;
+		struct _MRtpReceiveSlabPool * pool;
+		size_t size;
+	} MRtpReceiveSlab;
+
+	typedef struct _MRtpReceiveSlabPool {
+		MRtpReceiveSlab * freeSlabs;
+		size_t freeCount;
+		size_t slabSize;                    // size of the slabs handed out, the receive buffer size of the host
+		size_t usedSlabs;
+		int destroyed;                      // the host let go of the pool, it is freed with its last slab
+	} MRtpReceiveSlabPool;
+
+#define MRTP_RECEIVE_SLAB_DATA(slab) ((mrtp_uint8 *)(slab) + sizeof(MRtpReceiveSlab))
+
+	typedef enum _MRtpMemoryType {
+		MRTP_MEMORY_PACKETS = 0,            // data of the incoming messages waiting to be delivered
+		MRTP_MEMORY_COMMANDS = 1,           // incoming commands and the slabs of the outgoing command pool
+		MRTP_MEMORY_ACKNOWLEDGEMENTS = 2,   // acknowledgement rings
+		MRTP_MEMORY_REASSEMBLY = 3,         // data of the messages still missing fragments and their fragment bitmaps
+		MRTP_MEMORY_TYPES = 4
+	} MRtpMemoryType;
+
+	// what a host and its peers hold by object type, and the budgets they are held to, see callbacks.c
+	typedef struct _MRtpMemoryArena {
+		size_t used[MRTP_MEMORY_TYPES];
+		size_t totalUsed;
+		size_t peakUsed;
+		size_t budget;                      // the most the host may hold, 0 if unlimited
+		size_t peerBudget;                  // the most each peer may hold, 0 if unlimited
+		size_t refusals;                    // allocations turned down for going over a budget
+	} MRtpMemoryArena;
+
+	// fixed size objects carved from slabs and recycled through a free list, see pool.c
+	typedef struct _MRtpObjectPool {
+		size_t objectSize;
+		size_t slabObjects;                 // objects carved from each slab
+		void * freeObjects;
+		void * slabs;
+		size_t slabCount;
+		size_t usedObjects;                 // objects taken and not given back yet
+		size_t peakObjects;                 // the most objects used at once
+		size_t totalObjects;                // objects taken since the pool was set up, the allocations it saved
+		MRtpMemoryArena * arena;            // the slabs are charged to it, NULL if they aren't accounted
+		MRtpMemoryType memoryType;
+	} MRtpObjectPool;
+
+	enum
+	{
+		MRTP_TIMER_WHEEL_BITS = 6,
+		MRTP_TIMER_WHEEL_SLOTS = 1 << MRTP_TIMER_WHEEL_BITS,	// slots of each level of a timer wheel
+		MRTP_TIMER_WHEEL_LEVELS = 4,            // a slot spans a millisecond on level 0 and 64 slots of the level below above it
+	};
+
+	// a deadline in the timer wheel of a host
+	typedef struct _MRtpTimer {
+		MRtpListNode timerList;             // in a slot of the wheel while armed, next is NULL otherwise
+		mrtp_uint32 expireTime;
+		size_t level;
+	} MRtpTimer;
+
+	// the timers of a host sorted by expire time into slots, see timer.c
+	typedef struct _MRtpTimerWheel {
+		mrtp_uint32 currentTime;            // the timers expiring before it have fired
+		mrtp_uint8 started;                 // currentTime was taken from the first advance
+		size_t timerCount;
+		size_t levelCounts[MRTP_TIMER_WHEEL_LEVELS];
+		MRtpList slots[MRTP_TIMER_WHEEL_LEVELS][MRTP_TIMER_WHEEL_SLOTS];
+	} MRtpTimerWheel;
+
 	typedef struct _MRtpAcknowledgement
 	{
-		MRtpListNode acknowledgementList;
 		mrtp_uint32  sentTime;
-		MRtpProtocol command;
+		MRtpProtocolCommandHeader command;
 	} MRtpAcknowledgement;
 
+	// acknowledgements waiting to be sent, oldest first
+	typedef struct _MRtpAcknowledgementRing
+	{
+		MRtpAcknowledgement * acknowledgements;
+		size_t capacity;                    // a power of two, the ring is allocated on the first acknowledgement
+		size_t first;
+		size_t count;
+	} MRtpAcknowledgementRing;
+
 	typedef struct _MRtpOutgoingCommand
 	{
 		MRtpListNode outgoingCommandList;
@@ -105,15 +227,33 @@ extern "C"
 		mrtp_uint32  sentTime;
 		mrtp_uint32  roundTripTimeout;
 		mrtp_uint32  roundTripTimeoutLimit;
+		mrtp_uint32  sentEpoch;             // the send round of the peer a redundancy command last went out in
 		mrtp_uint32  fragmentOffset;
 		mrtp_uint16  fragmentLength;
 		mrtp_uint16  sendAttempts;
 		mrtp_uint16	 redundancyBufferNum;
 		mrtp_uint16  fastAck;
+		mrtp_uint8   inTransit;             // a reliable command on the sent queue, waiting for its acknowledgement
 		MRtpProtocol command;
 		MRtpPacket * packet;
 	} MRtpOutgoingCommand;
 
+	// the reliable and redundancy commands sent and not acknowledged yet, indexed by sequence number
+	// a command stays in the ring while it waits on the outgoing queue to be resent
+	typedef struct _MRtpSentCommandRing
+	{
+		MRtpOutgoingCommand ** commands;    // commands[sequenceNumber & (capacity - 1)]
+		size_t capacity;                    // a power of two, the ring is allocated on the first sent command
+		size_t count;
+		mrtp_uint16 first;                  // the oldest sequence number still in flight
+		mrtp_uint16 last;                   // one past the newest sequence number sent
+	} MRtpSentCommandRing;
+
+	enum
+	{
+		MRTP_PEER_INLINE_FRAGMENTS = 64,        // fragment bitmaps up to this many bits live in the incoming command
+	};
+
 	typedef struct _MRtpIncomingCommand
 	{
 		MRtpListNode incomingCommandList;
@@ -121,10 +261,35 @@ extern "C"
 		MRtpProtocol command;
 		mrtp_uint32 fragmentCount;
 		mrtp_uint32 fragmentsRemaining;
-		mrtp_uint32 * fragments;
+		mrtp_uint32 * fragments;            // bitmap of the received fragments, inlineFragments unless there are many
 		MRtpPacket * packet;
+		mrtp_uint32 inlineFragments[MRTP_PEER_INLINE_FRAGMENTS / 32];
+		MRtpListNode reassemblyList;        // in the host reassemblies while fragments are missing, next is NULL otherwise
+		struct _MRtpPeer * peer;
+		mrtp_uint32 reassemblyTime;         // service time the first fragment came in
 	} MRtpIncomingCommand;
 
+	// the commands of a sequenced channel waiting to be dispatched, indexed by sequence number
+	typedef struct _MRtpIncomingCommandRing
+	{
+		MRtpIncomingCommand ** commands;    // commands[sequenceNumber & (capacity - 1)]
+		size_t capacity;                    // a power of two, doubles up to the free windows as the commands spread out
+		size_t count;
+	} MRtpIncomingCommandRing;
+
+	// a datagram sent with MSG_ZEROCOPY, the kernel reads the packet data after the send returns,
+	// so the packets are held until it reports the send done on the socket error queue
+	typedef struct _MRtpZeroCopySend
+	{
+		MRtpListNode zeroCopyList;
+		size_t socketIndex;
+		mrtp_uint32 sequence;               // completion id the kernel gave the send
+		MRtpPacket ** packets;
+		size_t packetCount;
+		MRtpBuffer * buffers;               // the datagram, the headers and commands copied behind the arrays
+		size_t bufferCount;
+	} MRtpZeroCopySend;
+
 	typedef enum _MRtpPeerState {
 		MRTP_PEER_STATE_DISCONNECTED = 0,
 		MRTP_PEER_STATE_CONNECTING = 1,
@@ -150,6 +315,21 @@ extern "C"
 		MRTP_HOST_DEFAULT_MTU = 1400,
 		MRTP_HOST_DEFAULT_MAXIMUM_PACKET_SIZE = 32 * 1024 * 1024,
 		MRTP_HOST_DEFAULT_MAXIMUM_WAITING_DATA = 32 * 1024 * 1024,
+		MRTP_HOST_MAXIMUM_SOCKETS = 16,
+		MRTP_HOST_RECEIVE_BATCH_SIZE = 32,
+		MRTP_HOST_SEGMENT_RECEIVE_BUFFER_SIZE = 65536,
+		MRTP_HOST_SEND_BATCH_SIZE = 32,
+		MRTP_HOST_MAXIMUM_SEGMENTS = 64,
+		MRTP_HOST_MAXIMUM_SEGMENT_DATA = 65000,
+		MRTP_HOST_MAXIMUM_SEGMENT_BUFFERS = 1024,
+		MRTP_HOST_IO_RING_BUFFERS = 256,
+		MRTP_HOST_DEFAULT_ZERO_COPY_THRESHOLD = 16 * 1024,
+		MRTP_HOST_COMMAND_SLAB_OBJECTS = 256,
+		MRTP_HOST_FREE_RECEIVE_SLABS = 64,
+		MRTP_HOST_DEFAULT_MAXIMUM_REASSEMBLY_DATA = 128 * 1024 * 1024,
+		MRTP_HOST_DEFAULT_MAXIMUM_PEER_REASSEMBLY_DATA = 32 * 1024 * 1024,
+		MRTP_HOST_PEER_CHUNK = 64,              // peers added to the peer table at once as it grows
+		MRTP_HOST_BROADCAST_PLANS = 4,          // fragment lengths a broadcast encodes fragments for, other peers fragment on their own
 
 		MRTP_PEER_DEFAULT_ROUND_TRIP_TIME = 100,
 		MRTP_PEER_DEFAULT_PACKET_THROTTLE = 32,
@@ -171,6 +351,16 @@ extern "C"
 		MRTP_PEER_UNSEQUENCED_WINDOWS = 64,
 		MRTP_PEER_UNSEQUENCED_WINDOW_SIZE = 1024,
 		MRTP_PEER_FREE_UNSEQUENCED_WINDOWS = 32,
+		MRTP_PEER_PACING_GAIN = 125,            // percent of the throttled window paced out per round trip time
+		MRTP_PEER_PACING_SLACK = 1000,          // microseconds a paced datagram may leave early, the service loop waits in milliseconds
+		MRTP_PEER_PACING_HORIZON = 1000000,     // microseconds, a pacing time further ahead is stale
+		MRTP_PEER_ACKNOWLEDGEMENTS = 256,       // initial capacity of an acknowledgement ring
+		MRTP_PEER_MAXIMUM_ACKNOWLEDGEMENTS = 8192,
+		MRTP_PEER_SENT_COMMANDS = 64,           // initial capacity of a sent command ring
+		MRTP_PEER_MAXIMUM_SENT_COMMANDS = 0x10000,
+		MRTP_PEER_REORDER_COMMANDS = 64,        // initial capacity of a reorder buffer
+		MRTP_PEER_MAXIMUM_REORDER_COMMANDS = MRTP_PEER_FREE_WINDOWS * MRTP_PEER_WINDOW_SIZE,
+		MRTP_PEER_REASSEMBLY_TIMEOUT = 5000,    // an unreliable message still missing fragments after it is stale
 	};
 
 	typedef struct _MRtpChannel {
@@ -178,7 +368,9 @@ extern "C"
 		mrtp_uint16 usedWindows;
 		mrtp_uint16 commandWindows[MRTP_PEER_WINDOWS];
 		mrtp_uint16 incomingSequenceNumber;
-		MRtpList incomingCommands;
+		MRtpList incomingCommands;          // the commands waiting to be dispatched, in arrival order
+		MRtpIncomingCommandRing reorderBuffer;
+		MRtpSentCommandRing sentCommands;
 	} MRtpChannel;
 
 
@@ -196,17 +388,37 @@ extern "C"
 	} MRtpRedundancyBuffer;
 
 	typedef struct _MRtpPeer {
+		// the fields every service pass checks come first, so a scan over busy peers touches few cache lines
 		MRtpListNode  dispatchList;
+		MRtpListNode  sendList;         // in the send queue of the host while needsSend is set
 		struct _MRtpHost * host;
+		MRtpPeerState state;
+		MRtpAddress address;            // Internet address of the peer 
+		MRtpSocket socket;              // host socket the peer's datagrams go out on
+		mrtp_uint32 nextTimeout;
+		mrtp_uint32 nextRedundancyTimeout;
+		mrtp_uint32 lastReceiveTime;
+		mrtp_uint32 pingInterval;
+		MRtpTimer timeoutTimer;             // armed at the earliest of the deadlines above
+		mrtp_uint8 timeoutsDue;             // the timer fired, the deadlines are checked on the next send pass
+		mrtp_uint8 sendRedundancyAfterReceive;
+		MRtpAcknowledgementRing acknowledgements;
+		MRtpAcknowledgementRing redundancyAcknowledgemets;
+		MRtpList sentReliableCommands;
+		MRtpSentCommandRing sentSystemCommands;  // the sent reliable commands outside the channels, connect, ping and the like
+		MRtpList sentRedundancyCommands;         // the redundancy commands in flight, the channel ring orders them for resending
+		MRtpList outgoingReliableCommands;
+		MRtpList outgoingRedundancyCommands;
+		MRtpList outgoingRedundancyNoAckCommands;
+		MRtpList outgoingUnsequencedCommands;
+
 		mrtp_uint16 outgoingPeerID;
 		mrtp_uint16 incomingPeerID;
 		mrtp_uint32 connectID;
 		mrtp_uint8 outgoingSessionID;
 		mrtp_uint8 incomingSessionID;
-		MRtpAddress address;            // Internet address of the peer 
 		void * data;					
-		MRtpPeerState state;
-		MRtpChannel * channels;
+		MRtpChannel channels[MRTP_PROTOCOL_CHANNEL_COUNT];
 		size_t channelCount;			// Number of channels allocated for communication with peer 
 		mrtp_uint32 incomingBandwidth;  // Downstream bandwidth of the client in bytes/second 
 		mrtp_uint32 outgoingBandwidth;  // Upstream bandwidth of the client in bytes/second 
@@ -215,9 +427,6 @@ extern "C"
 		mrtp_uint32 incomingDataTotal;
 		mrtp_uint32 outgoingDataTotal;
 		mrtp_uint32 lastSendTime;
-		mrtp_uint32 lastReceiveTime;
-		mrtp_uint32 nextTimeout;
-		mrtp_uint32 nextRedundancyTimeout;
 		mrtp_uint32 earliestTimeout;
 		mrtp_uint32 packetThrottle;
 		mrtp_uint32 packetThrottleLimit;
@@ -226,7 +435,6 @@ extern "C"
 		mrtp_uint32 packetThrottleAcceleration;
 		mrtp_uint32 packetThrottleDeceleration;
 		mrtp_uint32 packetThrottleInterval;
-		mrtp_uint32 pingInterval;
 		mrtp_uint32 timeoutLimit;
 		mrtp_uint32 timeoutMinimum;
 		mrtp_uint32 timeoutMaximum;
@@ -239,34 +447,51 @@ extern "C"
 		mrtp_uint32 mtu;
 		mrtp_uint32 windowSize;
 		mrtp_uint32 reliableDataInTransit;
+		mrtp_uint32 pacingRate;             // bytes per millisecond the datagrams of the peer are spread at while the host paces
+		mrtp_uint32 pacingTime;             // mrtp_time_micro time the next datagram of the peer is due at
 		mrtp_uint16 outgoingReliableSequenceNumber;
-		MRtpList acknowledgements;
-		MRtpList redundancyAcknowledgemets;
-		MRtpList sentReliableCommands;
 		MRtpList sentRedundancyNoAckCommands;
-		MRtpList sentRedundancyLastTimeCommands;			
-		MRtpList sentRedundancyThisTimeCommands;			
-		MRtpList outgoingReliableCommands;
-		MRtpList outgoingRedundancyCommands;
-		MRtpList outgoingRedundancyNoAckCommands;
-		MRtpList outgoingUnsequencedCommands;
 		MRtpList sentUnsequencedCommands;
 		MRtpList dispatchedCommands;
-		size_t sentRedundancyLastTimeSize;
-		size_t sentRedundancyThisTimeSize;
+		size_t sentRedundancySize;
+		mrtp_uint32 redundancySendEpoch;        // counts the send rounds, a redundancy command is resent once a round
+		mrtp_uint16 redundancyResendSequenceNumber;  // where a resend cut short by a full datagram picks up
 		int needsDispatch;
+		int needsSend;
 		size_t totalWaitingData;
+		size_t reassemblyData;              // length of the messages of the peer still missing fragments
+		size_t memoryUsed;                  // what the peer holds in the arena of the host
 		size_t redundancyNum;
 		size_t currentRedundancyNoAckBufferNum;
 		MRtpRedundancyNoAckBuffer* redundancyNoAckBuffers;
 		mrtp_uint16 quickRetransmitNum;
 		mrtp_uint32 redundancyLastSentTimeStamp;
-		mrtp_uint8 sendRedundancyAfterReceive;
 		mrtp_uint16   incomingUnsequencedGroup;
 		mrtp_uint16   outgoingUnsequencedGroup;
 		mrtp_uint32   unsequencedWindow[MRTP_PEER_UNSEQUENCED_WINDOW_SIZE / 32];
 	} MRtpPeer;
 
+	// the state and address of a peer, kept in an array beside the peers so that scanning the peer table
+	// only touches the peers that are in use, the peer fields are the ones to read
+	typedef struct _MRtpPeerSlot {
+		MRtpAddress address;
+		MRtpPeerState state;
+	} MRtpPeerSlot;
+
+#define MRTP_PEER_SLOT_IDLE(slot) ((slot)->state == MRTP_PEER_STATE_DISCONNECTED || (slot)->state == MRTP_PEER_STATE_ZOMBIE)
+#define MRTP_PEER_SLOT_CONNECTED(slot) ((slot)->state == MRTP_PEER_STATE_CONNECTED || (slot)->state == MRTP_PEER_STATE_DISCONNECT_LATER)
+
+	// the peer with the incoming peer id, it must be below the peer count of the host
+#define MRTP_HOST_PEER(host, peerID) (&(host)->peerChunks[(peerID) / MRTP_HOST_PEER_CHUNK][(peerID) % MRTP_HOST_PEER_CHUNK])
+
+	// the fragments of a broadcast packet for one fragment length, shared by every peer with that length
+	typedef struct _MRtpFragmentPlan
+	{
+		size_t fragmentLength;
+		mrtp_uint32 fragmentCount;
+		MRtpProtocol * fragments;
+	} MRtpFragmentPlan;
+
 	/** An MRtp packet compressor for compressing UDP packets before socket sends or receives.
 	*/
 	typedef struct _MRtpCompressor
@@ -282,12 +507,23 @@ extern "C"
 	} MRtpCompressor;
 
 
+	typedef enum _MRtpPacingMode {
+		MRTP_PACING_NONE = 0,
+		MRTP_PACING_KERNEL = 1,             // datagrams are stamped with SO_TXTIME and held back by the fq qdisc
+		MRTP_PACING_USER = 2                // a peer stops sending until its next datagram is due
+	} MRtpPacingMode;
+
 	typedef mrtp_uint32(MRTP_CALLBACK * MRtpChecksumCallback) (const MRtpBuffer * buffers, size_t bufferCount);
 
 	typedef int (MRTP_CALLBACK * MRtpInterceptCallback) (struct _MRtpHost * host, struct _MRtpEvent * event);
 
 	typedef struct _MRtpHost {
-		MRtpSocket socket;
+		MRtpSocket socket;                  // primary socket, the first of sockets
+		MRtpSocket sockets[MRTP_HOST_MAXIMUM_SOCKETS];	// SO_REUSEPORT sockets bound to the same address
+		size_t socketCount;
+		size_t receiveSocketIndex;          // next socket to receive a batch from
+		MRtpSocketRing * socketRings[MRTP_HOST_MAXIMUM_SOCKETS];	// io_uring of each socket, NULL while the plain socket calls are used
+		struct _MRtpReactor * reactor;      // the reactor waiting on the sockets of the host, or NULL
 		MRtpAddress address;                // Internet address of the host 
 		mrtp_uint32 incomingBandwidth;      //downstream bandwidth of the host 
 		mrtp_uint32 outgoingBandwidth;      // upstream bandwidth of the host 
@@ -295,21 +531,45 @@ extern "C"
 		mrtp_uint32  mtu;
 		mrtp_uint32 randomSeed;
 		int recalculateBandwidthLimits;
-		MRtpPeer * peers;                   // array of peers allocated for this host 
-		size_t peerCount;                   // number of peers allocated for this host 
+		MRtpPeer ** peerChunks;             // the peer table, chunks of MRTP_HOST_PEER_CHUNK peers added as it grows
+		MRtpPeerSlot * peerSlots;           // state and address of each peer, what the host scans the peers by
+		size_t peerCount;                   // number of peers allocated for this host so far
+		size_t peerLimit;                   // the most peers the table may grow to
 		mrtp_uint32 serviceTime;
 		MRtpList dispatchQueue;
+		MRtpList sendQueue;                 // the peers with commands or acknowledgements to send, or deadlines to check
 		int continueSending;
 		size_t packetSize;
 		mrtp_uint16 headerFlags;
-		MRtpProtocol commands[MRTP_PROTOCOL_MAXIMUM_PACKET_COMMANDS];
+		MRtpProtocol * commands;            // commands of the datagram being assembled, points into sendCommands
 		size_t commandCount;
-		MRtpBuffer buffers[MRTP_BUFFER_MAXIMUM];
+		MRtpBuffer * buffers;               // buffers of the datagram being assembled, points into sendBuffers
 		size_t bufferCount;
-		mrtp_uint8 packetData[2][MRTP_PROTOCOL_MAXIMUM_MTU];
+		MRtpProtocol sendCommands[MRTP_HOST_SEND_BATCH_SIZE][MRTP_PROTOCOL_MAXIMUM_PACKET_COMMANDS];
+		MRtpBuffer sendBuffers[MRTP_HOST_SEND_BATCH_SIZE * MRTP_BUFFER_MAXIMUM];	// buffers of the staged datagrams, back to back
+		size_t sendBufferCount;
+		mrtp_uint8 sendHeaders[MRTP_HOST_SEND_BATCH_SIZE][sizeof(MRtpProtocolHeader) + sizeof(mrtp_uint32)];
+		MRtpSocketMessage sendMessages[MRTP_HOST_SEND_BATCH_SIZE];	// datagrams staged for the next batch send
+		MRtpSocket sendSockets[MRTP_HOST_SEND_BATCH_SIZE];
+		MRtpPacket * sendPackets[MRTP_HOST_SEND_BATCH_SIZE * MRTP_BUFFER_MAXIMUM];	// packet whose data each staged buffer points into, or NULL
+		size_t sendMessageCount;
+		mrtp_uint8 receiveBufferData[MRTP_HOST_RECEIVE_BATCH_SIZE][MRTP_PROTOCOL_MAXIMUM_MTU];
+		mrtp_uint8 * receiveBuffers[MRTP_HOST_RECEIVE_BATCH_SIZE];	// ring of datagrams filled by one batch receive
+		size_t receiveBufferSize;
+		mrtp_uint8 * receiveSegmentData;	// larger receive buffers used while receive offload is on
+		MRtpBuffer receiveBatch[MRTP_HOST_RECEIVE_BATCH_SIZE];	// datagrams of the last batch receive, they point into the io ring buffers when it is on
+		MRtpAddress receiveAddresses[MRTP_HOST_RECEIVE_BATCH_SIZE];
+		size_t receiveLengths[MRTP_HOST_RECEIVE_BATCH_SIZE];
+		size_t receiveSegmentSizes[MRTP_HOST_RECEIVE_BATCH_SIZE];	// 0 unless the kernel coalesced several datagrams into the buffer
+		mrtp_uint32 receiveTimes[MRTP_HOST_RECEIVE_BATCH_SIZE];	// kernel receive timestamps of the datagrams in the ring
+		size_t receiveBatchCount;			// datagrams in the ring
+		size_t receiveBatchIndex;			// next datagram in the ring to handle
+		size_t receiveSegmentOffset;		// offset of the next datagram in a coalesced buffer
 		MRtpAddress receivedAddress;
+		MRtpSocket receivedSocket;          // socket the datagrams in the receive ring came in on
 		mrtp_uint8 *receivedData;
 		size_t receivedDataLength;
+		mrtp_uint32 receivedTime;           // when the datagram being handled came in, round trip times are measured to it
 		mrtp_uint32 totalSentData;          // total data sent, user should reset to 0 as needed to prevent overflow 
 		mrtp_uint32 totalSentPackets;       // total UDP packets sent, user should reset to 0 as needed to prevent overflow 
 		mrtp_uint32 totalReceivedData;      // total data received, user should reset to 0 as needed to prevent overflow
@@ -319,8 +579,27 @@ extern "C"
 		size_t duplicatePeers;              // optional number of allowed peers from duplicate IPs, defaults to MRTP_PROTOCOL_MAXIMUM_PEER_ID 
 		size_t maximumPacketSize;           // the maximum allowable packet size that may be sent or received on a peer 
 		size_t maximumWaitingData;          // the maximum aggregate amount of buffer space a peer may use waiting for packets to be delivered 
+		MRtpList reassemblies;              // incoming messages still missing fragments, oldest first
+		size_t reassemblyData;
+		size_t maximumReassemblyData;       // the most the messages missing fragments of all peers may hold, 0 if unlimited
+		size_t maximumPeerReassemblyData;   // the same for each peer
 		mrtp_uint8 redundancyNum;
 		mrtp_uint8 openQuickRetransmit;		// open the quick retransmit
+		int segmentOffload;                 // send trains of equal sized datagrams to one peer with UDP GSO
+		size_t zeroCopyThreshold;           // datagrams carrying at least this much packet data are sent with MSG_ZEROCOPY, 0 if off
+		mrtp_uint32 zeroCopySequences[MRTP_HOST_MAXIMUM_SOCKETS];	// completion id of the next zero copy send on each socket
+		MRtpList zeroCopySends;             // zero copy sends the kernel hasn't reported done yet
+		MRtpPacketPool * packetPool;        // the incoming packets are taken from it, NULL if off
+		MRtpPacketPool * reassemblyPool;    // the messages missing fragments are taken from it while packetPool is off
+		MRtpReceiveSlabPool * receiveSlabPool;	// NULL unless the incoming packets point into the receive buffers
+		MRtpReceiveSlab * receiveSlabs[MRTP_HOST_RECEIVE_BATCH_SIZE];	// the slabs behind the receive buffers
+		MRtpReceiveSlab * receivedSlab;     // the slab the datagram being handled is in, NULL if it is in none
+		MRtpObjectPool outgoingCommandPool; // outgoing commands and fragments of all peers
+		MRtpMemoryArena memory;             // what the host and its peers hold, and their budgets
+		MRtpPacingMode pacing;
+		size_t pacedPeers;                  // peers whose data was held back by pacing in the last send pass
+		mrtp_uint32 pacingTimeout;          // when the first of them may send again
+		MRtpTimerWheel timers;              // the earliest retransmit, ping or disconnect deadline of each peer
 		MRtpCompressor compressor;
 #ifdef PRINTLOG
 		FILE* logFile;
@@ -343,6 +622,28 @@ extern "C"
 		MRtpPacket *         packet;    // packet associated with the event, if appropriate 
 	} MRtpEvent;
 
+	enum
+	{
+		MRTP_SOCKET_POLLER_MAXIMUM_EVENTS = 64,
+		MRTP_REACTOR_DEFAULT_HOSTS = 16,
+		MRTP_REACTOR_MAXIMUM_READY = 64
+	};
+
+	typedef struct _MRtpReactorHost {
+		MRtpHost * host;
+		mrtp_uint32 nextTimeout;            // the host has to be serviced at this time even if nothing was received
+		int ready;                          // a socket of the host is readable or the host may still have events
+	} MRtpReactorHost;
+
+	// waits on the sockets of many hosts with one epoll descriptor
+	typedef struct _MRtpReactor {
+		MRtpSocket poller;                  // MRTP_SOCKET_NULL if there is no epoll, then select is used
+		MRtpReactorHost * hosts;
+		size_t hostCount;
+		size_t hostCapacity;
+		size_t nextHost;                    // where the next round robin servicing starts
+	} MRtpReactor;
+
 	extern mrtp_uint8 channelIDs[];
 
 	MRTP_API int mrtp_initialize(void);
@@ -351,6 +652,8 @@ extern "C"
 
 	MRTP_API mrtp_uint32 mrtp_time_get(void);
 	MRTP_API void mrtp_time_set(mrtp_uint32);
+	MRTP_API mrtp_uint32 mrtp_time_from_system(mrtp_uint32);
+	MRTP_API mrtp_uint32 mrtp_time_micro(void);
 
 	MRTP_API MRtpSocket mrtp_socket_create(MRtpSocketType);
 	MRTP_API int mrtp_socket_bind(MRtpSocket, const MRtpAddress *);
@@ -359,13 +662,28 @@ extern "C"
 	MRTP_API MRtpSocket mrtp_socket_accept(MRtpSocket, MRtpAddress *);
 	MRTP_API int mrtp_socket_connect(MRtpSocket, const MRtpAddress *);
 	MRTP_API int mrtp_socket_send(MRtpSocket, const MRtpAddress *, const MRtpBuffer *, size_t);
+	MRTP_API int mrtp_socket_send_batch(MRtpSocket, MRtpSocketMessage *, size_t);
+	MRTP_API int mrtp_socket_send_zero_copy(MRtpSocket, MRtpSocketMessage *);
+	MRTP_API int mrtp_socket_zero_copy_completion(MRtpSocket, mrtp_uint32 *, mrtp_uint32 *);
 	MRTP_API int mrtp_socket_receive(MRtpSocket, MRtpAddress *, MRtpBuffer *, size_t);
+	MRTP_API int mrtp_socket_receive_batch(MRtpSocket, MRtpAddress *, MRtpBuffer *, size_t *, size_t *, mrtp_uint32 *, size_t);
 	MRTP_API int mrtp_socket_wait(MRtpSocket, mrtp_uint32 *, mrtp_uint32);
+	MRTP_API int mrtp_socket_wait_multiple(const MRtpSocket *, size_t, mrtp_uint32 *, mrtp_uint32);
 	MRTP_API int mrtp_socket_set_option(MRtpSocket, MRtpSocketOption, int);
 	MRTP_API int mrtp_socket_get_option(MRtpSocket, MRtpSocketOption, int *);
 	MRTP_API int mrtp_socket_shutdown(MRtpSocket, MRtpSocketShutdown);
 	MRTP_API void mrtp_socket_destroy(MRtpSocket);
 	MRTP_API int mrtp_socketset_select(MRtpSocket, MRtpSocketSet *, MRtpSocketSet *, mrtp_uint32);
+	MRTP_API MRtpSocket mrtp_socket_poller_create(void);
+	MRTP_API int mrtp_socket_poller_add(MRtpSocket, MRtpSocket, size_t);
+	MRTP_API int mrtp_socket_poller_remove(MRtpSocket, MRtpSocket);
+	MRTP_API int mrtp_socket_poller_wait(MRtpSocket, size_t *, size_t, mrtp_uint32);
+	MRTP_API MRtpSocketRing * mrtp_socket_ring_create(MRtpSocket, size_t, size_t);
+	MRTP_API void mrtp_socket_ring_destroy(MRtpSocketRing *);
+	MRTP_API MRtpSocket mrtp_socket_ring_wait_socket(MRtpSocketRing *);
+	MRTP_API int mrtp_socket_ring_pending(MRtpSocketRing *);
+	MRTP_API int mrtp_socket_ring_send_batch(MRtpSocketRing *, MRtpSocketMessage *, size_t);
+	MRTP_API int mrtp_socket_ring_receive_batch(MRtpSocketRing *, MRtpAddress *, MRtpBuffer *, size_t *, size_t *, mrtp_uint32 *, size_t);
 
 	MRTP_API int mrtp_address_set_host(MRtpAddress * address, const char * hostName);
 	MRTP_API int mrtp_address_get_host_ip(const MRtpAddress * address, char * hostName, size_t nameLength);
@@ -374,25 +692,74 @@ extern "C"
 	MRTP_API MRtpPacket * mrtp_packet_create(const void *, size_t, mrtp_uint32);
 	MRTP_API void mrtp_packet_destroy(MRtpPacket *);
 	MRTP_API int mrtp_packet_resize(MRtpPacket *, size_t);
+	extern MRtpPacketPool * mrtp_packet_pool_create(void);
+	extern void mrtp_packet_pool_destroy(MRtpPacketPool *);
+	extern MRtpPacket * mrtp_packet_pool_acquire(MRtpPacketPool *, const void *, size_t, mrtp_uint32);
+	extern MRtpPacket * mrtp_packet_pool_reference(MRtpPacketPool *, MRtpReceiveSlab *, const void *, size_t, mrtp_uint32);
+	extern void mrtp_packet_pool_trim(MRtpPacketPool *);
+	extern MRtpReceiveSlabPool * mrtp_receive_slab_pool_create(size_t);
+	extern void mrtp_receive_slab_pool_destroy(MRtpReceiveSlabPool *);
+	extern void mrtp_receive_slab_pool_resize(MRtpReceiveSlabPool *, size_t);
+	extern MRtpReceiveSlab * mrtp_receive_slab_acquire(MRtpReceiveSlabPool *);
+	extern void mrtp_receive_slab_release(MRtpReceiveSlab *);
+
+	extern int mrtp_arena_reserve(MRtpMemoryArena *, size_t *, MRtpMemoryType, size_t);
+	extern void mrtp_arena_release(MRtpMemoryArena *, size_t *, MRtpMemoryType, size_t);
+	extern void * mrtp_arena_malloc(MRtpMemoryArena *, size_t *, MRtpMemoryType, size_t);
+	extern void mrtp_arena_free(MRtpMemoryArena *, size_t *, MRtpMemoryType, void *, size_t);
+
+	extern void mrtp_object_pool_init(MRtpObjectPool *, size_t, size_t);
+	extern void mrtp_object_pool_clear(MRtpObjectPool *);
+	extern void * mrtp_object_pool_acquire(MRtpObjectPool *);
+	extern void mrtp_object_pool_release(MRtpObjectPool *, void *);
+	extern void mrtp_timer_wheel_init(MRtpTimerWheel *);
+	extern void mrtp_timer_wheel_schedule(MRtpTimerWheel *, MRtpTimer *, mrtp_uint32);
+	extern void mrtp_timer_wheel_cancel(MRtpTimerWheel *, MRtpTimer *);
+	extern void mrtp_timer_wheel_advance(MRtpTimerWheel *, mrtp_uint32, MRtpList *);
+	extern int mrtp_timer_wheel_next(MRtpTimerWheel *, mrtp_uint32 *);
 	MRTP_API mrtp_uint32 mrtp_crc32(const MRtpBuffer *, size_t);
 
 	MRTP_API MRtpHost * mrtp_host_create(const MRtpAddress *, size_t, mrtp_uint32, mrtp_uint32);
+	MRTP_API MRtpHost * mrtp_host_create_sharded(const MRtpAddress *, size_t, size_t, mrtp_uint32, mrtp_uint32);
 	MRTP_API void mrtp_host_destroy(MRtpHost *);
 	MRTP_API MRtpPeer * mrtp_host_connect(MRtpHost *, const MRtpAddress *);
 	MRTP_API int mrtp_host_check_events(MRtpHost *, MRtpEvent *);
 	MRTP_API int mrtp_host_service(MRtpHost *, MRtpEvent *, mrtp_uint32);
 	MRTP_API void mrtp_host_flush(MRtpHost *);
-	MRTP_API void mrtp_host_broadcast(MRtpHost *, mrtp_uint8, MRtpPacket *);
+	MRTP_API void mrtp_host_broadcast(MRtpHost *, MRtpPacket *);
 	MRTP_API void mrtp_host_channel_limit(MRtpHost *, size_t);
 	MRTP_API void mrtp_host_bandwidth_limit(MRtpHost *, mrtp_uint32, mrtp_uint32);
+	MRTP_API void mrtp_host_reassembly_limit(MRtpHost *, size_t, size_t);
+	MRTP_API void mrtp_host_memory_limit(MRtpHost *, size_t, size_t);
 	extern void mrtp_host_bandwidth_throttle(MRtpHost *);
+	extern MRtpPeer * mrtp_host_grow_peers(MRtpHost *);
 	extern mrtp_uint32 mrtp_host_random_seed(void);
 	MRTP_API void mrtp_host_set_redundancy_num(MRtpHost *host, mrtp_uint32 redundancy_num);
 	MRTP_API void mrtp_host_shutdown_quick_retransmit(MRtpHost * host);
 	MRTP_API void mrtp_host_open_quick_retransmit(MRtpHost *host, mrtp_uint32 quickRetransmit);
+	MRTP_API int mrtp_host_segment_offload(MRtpHost * host, int enable);
+	MRTP_API int mrtp_host_receive_offload(MRtpHost * host, int enable);
+	MRTP_API int mrtp_host_io_ring(MRtpHost * host, int enable);
+	MRTP_API int mrtp_host_zero_copy(MRtpHost * host, size_t threshold);
+	MRTP_API MRtpPacingMode mrtp_host_pacing(MRtpHost * host, MRtpPacingMode pacing);
+	MRTP_API int mrtp_host_packet_pool(MRtpHost * host, int enable);
+	MRTP_API MRtpPacket * mrtp_host_packet_create(MRtpHost * host, const void * data, size_t dataLength, mrtp_uint32 flags);
+	MRTP_API int mrtp_host_zero_copy_receive(MRtpHost * host, int enable);
+	MRTP_API void mrtp_host_reap_zero_copy(MRtpHost * host);
+	MRTP_API mrtp_uint32 mrtp_host_next_timeout(MRtpHost * host);
+	MRTP_API MRtpSocket mrtp_host_wait_socket(MRtpHost * host, size_t socketIndex);
+
+	MRTP_API MRtpReactor * mrtp_reactor_create(void);
+	MRTP_API void mrtp_reactor_destroy(MRtpReactor * reactor);
+	MRTP_API int mrtp_reactor_add_host(MRtpReactor * reactor, MRtpHost * host);
+	MRTP_API void mrtp_reactor_remove_host(MRtpReactor * reactor, MRtpHost * host);
+	MRTP_API int mrtp_reactor_service(MRtpReactor * reactor, MRtpEvent * event, mrtp_uint32 timeout);
 
 	MRTP_API int mrtp_peer_send_reliable(MRtpPeer * peer, MRtpPacket * packet);
 	MRTP_API int mrtp_peer_send(MRtpPeer *peer, MRtpPacket *packet);
+	extern size_t mrtp_peer_fragment_length(MRtpPeer *, MRtpPacket *);
+	extern void mrtp_peer_encode_fragments(MRtpPacket *, size_t, MRtpProtocol *);
+	extern int mrtp_peer_send_fragments(MRtpPeer *, MRtpPacket *, const MRtpProtocol *, mrtp_uint32, size_t);
 	MRTP_API MRtpPacket * mrtp_peer_receive(MRtpPeer *, mrtp_uint8 * channelID);
 	MRTP_API void mrtp_peer_ping(MRtpPeer *);
 	MRTP_API void mrtp_peer_ping_interval(MRtpPeer *, mrtp_uint32);
@@ -405,21 +772,33 @@ extern "C"
 	extern int mrtp_peer_throttle(MRtpPeer *, mrtp_uint32);
 	extern void mrtp_peer_reset_queues(MRtpPeer *);
 	extern void mrtp_peer_setup_outgoing_command(MRtpPeer *, MRtpOutgoingCommand *);
+	extern void mrtp_peer_queue_send(MRtpPeer *);
 	extern MRtpOutgoingCommand * mrtp_peer_queue_outgoing_command(MRtpPeer *, const MRtpProtocol *, MRtpPacket *, mrtp_uint32, mrtp_uint16);
 	extern MRtpIncomingCommand * mrtp_peer_queue_incoming_command(MRtpPeer *, const MRtpProtocol *, const void *, size_t, mrtp_uint32, mrtp_uint32);
 	extern MRtpAcknowledgement * mrtp_peer_queue_acknowledgement(MRtpPeer *, const MRtpProtocol *, mrtp_uint16);
 	extern void mrtp_peer_dispatch_incoming_reliable_commands(MRtpPeer *, MRtpChannel *);
-	extern void mrtp_peer_dispatch_incoming_redundancy_noack_commands(MRtpPeer*, MRtpChannel *);
+	extern void mrtp_peer_dispatch_incoming_redundancy_noack_commands(MRtpPeer*, MRtpChannel *, MRtpIncomingCommand *);
 	extern void mrtp_peer_dispatch_incoming_redundancy_commands(MRtpPeer * peer, MRtpChannel * channel);
 	extern void mrtp_peer_dispatch_incoming_unsequenced_commands(MRtpPeer * peer, MRtpChannel * channel);
+	extern void mrtp_peer_set_state(MRtpPeer *, MRtpPeerState);
+	extern void mrtp_peer_set_address(MRtpPeer *, const MRtpAddress *);
+	extern int mrtp_peer_reserve_reassembly(MRtpPeer *, size_t);
+	extern void mrtp_peer_finish_reassembly(MRtpIncomingCommand *);
+	extern void mrtp_peer_complete_reassembly(MRtpIncomingCommand *);
+	extern void mrtp_peer_evict_stale_reassemblies(MRtpHost *);
 	extern void mrtp_peer_on_connect(MRtpPeer *);
 	extern void mrtp_peer_on_disconnect(MRtpPeer *);
 	extern void mrtp_peer_reset_redundancy_noack_buffer(MRtpPeer* peer, size_t redundancyNum);
+	extern MRtpSentCommandRing * mrtp_peer_sent_command_ring(MRtpPeer *, mrtp_uint8);
+	extern int mrtp_peer_insert_sent_command(MRtpPeer *, MRtpOutgoingCommand *);
+	extern MRtpOutgoingCommand * mrtp_peer_find_sent_command(MRtpSentCommandRing *, mrtp_uint16);
+	extern void mrtp_peer_remove_sent_command(MRtpSentCommandRing *, mrtp_uint16);
+	extern MRtpIncomingCommand * mrtp_peer_find_incoming_command(MRtpChannel *, mrtp_uint16);
 	extern MRtpAcknowledgement * mrtp_peer_queue_redundancy_acknowldegement(MRtpPeer* peer, const MRtpProtocol * command,
 		mrtp_uint16 sentTime);
 
 	extern size_t mrtp_protocol_command_size(mrtp_uint8);
-	extern void mrtp_protocol_remove_redundancy_buffer_commands(MRtpRedundancyNoAckBuffer* mrtpRedundancyBuffer);
+	extern void mrtp_protocol_remove_redundancy_buffer_commands(MRtpHost * host, MRtpRedundancyNoAckBuffer* mrtpRedundancyBuffer);
 
 
 #ifdef __cplusplus
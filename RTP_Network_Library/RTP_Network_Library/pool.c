@@ -0,0 +1,77 @@
+#include <string.h>
+#include "utility.h"
+#include "mrtp.h"
+
+// an object pool hands out fixed size objects carved from slabs and takes them back on a free list,
+// free objects and slabs are linked through their first word, the first object of a slab holds the link
+// the slabs are charged to the arena of the pool when it has one, a pool over its budget doesn't grow
+
+void mrtp_object_pool_init(MRtpObjectPool * pool, size_t objectSize, size_t slabObjects) {
+
+	memset(pool, 0, sizeof(MRtpObjectPool));
+
+	// keep every object aligned like the link it holds while it is free
+	pool->objectSize = (MRTP_MAX(objectSize, sizeof(void *)) + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+	pool->slabObjects = MRTP_MAX(slabObjects, 1);
+}
+
+// free the slabs, the objects still in use go with them
+void mrtp_object_pool_clear(MRtpObjectPool * pool) {
+
+	while (pool->slabs != NULL) {
+		void * slab = pool->slabs;
+
+		pool->slabs = *(void **)slab;
+		mrtp_arena_free(pool->arena, NULL, pool->memoryType, slab, (pool->slabObjects + 1) * pool->objectSize);
+	}
+
+	pool->freeObjects = NULL;
+	pool->slabCount = 0;
+	pool->usedObjects = 0;
+}
+
+static int mrtp_object_pool_grow(MRtpObjectPool * pool) {
+
+	mrtp_uint8 * slab = (mrtp_uint8 *)mrtp_arena_malloc(pool->arena, NULL, pool->memoryType, (pool->slabObjects + 1) * pool->objectSize);
+	mrtp_uint8 * object;
+
+	if (slab == NULL)
+		return -1;
+
+	*(void **)slab = pool->slabs;
+	pool->slabs = slab;
+	++pool->slabCount;
+
+	for (object = slab + pool->slabObjects * pool->objectSize; object > slab; object -= pool->objectSize) {
+		*(void **)object = pool->freeObjects;
+		pool->freeObjects = object;
+	}
+
+	return 0;
+}
+
+void * mrtp_object_pool_acquire(MRtpObjectPool * pool) {
+
+	void * object;
+
+	if (pool->freeObjects == NULL && mrtp_object_pool_grow(pool) < 0)
+		return NULL;
+
+	object = pool->freeObjects;
+	pool->freeObjects = *(void **)object;
+
+	++pool->usedObjects;
+	++pool->totalObjects;
+	if (pool->usedObjects > pool->peakObjects)
+		pool->peakObjects = pool->usedObjects;
+
+	return object;
+}
+
+void mrtp_object_pool_release(MRtpObjectPool * pool, void * object) {
+
+	*(void **)object = pool->freeObjects;
+	pool->freeObjects = object;
+
+	--pool->usedObjects;
+}
@@ -78,7 +78,7 @@ static void mrtp_protocol_change_state(MRtpHost * host, MRtpPeer * peer, MRtpPee
 	else
 		mrtp_peer_on_disconnect(peer);
 
-	peer->state = state;
+	mrtp_peer_set_state(peer, state);
 }
 
 static void mrtp_protocol_dispatch_state(MRtpHost * host, MRtpPeer * peer, MRtpPeerState state) {
@@ -181,6 +181,7 @@ static int mrtp_protocol_check_timeouts(MRtpHost * host, MRtpPeer * peer, MRtpEv
 #endif
 
 			mrtp_list_insert(insertPosition, mrtp_list_remove(&outgoingCommand->outgoingCommandList));
+			outgoingCommand->inTransit = 0;
 
 			if (currentCommand == mrtp_list_begin(&peer->sentReliableCommands) &&
 				!mrtp_list_empty(&peer->sentReliableCommands))
@@ -198,21 +199,30 @@ static int mrtp_protocol_check_redundancy_timeouts(MRtpHost * host, MRtpPeer * p
 
 	MRtpOutgoingCommand * outgoingCommand;
 	MRtpListIterator currentCommand, insertPosition;
+	mrtp_uint32 nextTimeout = 0;
+	int hasNextTimeout = 0;
 
 	if (MRTP_TIME_GREATER_EQUAL(host->serviceTime, peer->nextRedundancyTimeout)) {
 
-		currentCommand = mrtp_list_begin(&peer->sentRedundancyLastTimeCommands);
+		currentCommand = mrtp_list_begin(&peer->sentRedundancyCommands);
 		insertPosition = mrtp_list_begin(&peer->outgoingRedundancyCommands);
 
-		while (currentCommand != mrtp_list_end(&peer->sentRedundancyLastTimeCommands)) {
+		while (currentCommand != mrtp_list_end(&peer->sentRedundancyCommands)) {
 
 			outgoingCommand = (MRtpOutgoingCommand *)currentCommand;
 
 			currentCommand = mrtp_list_next(currentCommand);
 
-			// if the outgoing command doexn't timeout
-			if (MRTP_TIME_DIFFERENCE(host->serviceTime, outgoingCommand->sentTime) < outgoingCommand->roundTripTimeout)
+			// if the outgoing command doexn't timeout, the earliest of them is the next to check
+			if (MRTP_TIME_DIFFERENCE(host->serviceTime, outgoingCommand->sentTime) < outgoingCommand->roundTripTimeout) {
+				if (!hasNextTimeout ||
+					MRTP_TIME_LESS(outgoingCommand->sentTime + outgoingCommand->roundTripTimeout, nextTimeout))
+				{
+					nextTimeout = outgoingCommand->sentTime + outgoingCommand->roundTripTimeout;
+					hasNextTimeout = 1;
+				}
 				continue;
+			}
 
 			// the peer time out after the last time receive acknowledge
 			// the erliestTimeout will reset after receive acknowledge
@@ -220,7 +230,7 @@ static int mrtp_protocol_check_redundancy_timeouts(MRtpHost * host, MRtpPeer * p
 				peer->earliestTimeout = outgoingCommand->sentTime;
 
 			// judge whether a peer has disconnected
-			if (peer->sentRedundancyLastTimeSize >= MRTP_PROTOCOL_MAXIMUM_REDUNDANCY_COMMAND_QUEUE_SiZE ||
+			if (peer->sentRedundancySize >= MRTP_PROTOCOL_MAXIMUM_REDUNDANCY_COMMAND_QUEUE_SiZE ||
 				MRTP_TIME_DIFFERENCE(host->serviceTime, peer->earliestTimeout) >= peer->timeoutMaximum ||
 				(outgoingCommand->roundTripTimeout >= outgoingCommand->roundTripTimeoutLimit &&
 					MRTP_TIME_DIFFERENCE(host->serviceTime, peer->earliestTimeout) >= peer->timeoutMinimum))
@@ -250,17 +260,14 @@ static int mrtp_protocol_check_redundancy_timeouts(MRtpHost * host, MRtpPeer * p
 				outgoingCommand->roundTripTimeout);
 #endif // DEBUG
 
-
+			// it stays in the channel ring while it waits to be sent again
 			mrtp_list_insert(insertPosition, mrtp_list_remove(&outgoingCommand->outgoingCommandList));
-			--peer->sentRedundancyLastTimeSize;
-
-			if (currentCommand == mrtp_list_begin(&peer->sentRedundancyLastTimeCommands) &&
-				!mrtp_list_empty(&peer->sentRedundancyLastTimeCommands))
-			{
-				outgoingCommand = (MRtpOutgoingCommand *)currentCommand;
-				peer->nextTimeout = outgoingCommand->sentTime + outgoingCommand->roundTripTimeout;
-			}
+			outgoingCommand->inTransit = 0;
+			--peer->sentRedundancySize;
 		}
+
+		if (hasNextTimeout)
+			peer->nextRedundancyTimeout = nextTimeout;
 	}
 
 	return 0;
@@ -286,11 +293,11 @@ static void mrtp_protocol_remove_sent_redundancy_noack_commands(MRtpPeer * peer)
 			}
 		}
 
-		mrtp_free(outgoingCommand);
+		mrtp_object_pool_release(&peer->host->outgoingCommandPool, outgoingCommand);
 	}
 }
 
-void mrtp_protocol_remove_redundancy_buffer_commands(MRtpRedundancyNoAckBuffer* mrtpRedundancyBuffer) {
+void mrtp_protocol_remove_redundancy_buffer_commands(MRtpHost * host, MRtpRedundancyNoAckBuffer* mrtpRedundancyBuffer) {
 
 	MRtpOutgoingCommand* outgoingCommand;
 	while (!mrtp_list_empty(&mrtpRedundancyBuffer->sentCommands)) {
@@ -304,7 +311,7 @@ void mrtp_protocol_remove_redundancy_buffer_commands(MRtpRedundancyNoAckBuffer*
 				mrtp_packet_destroy(outgoingCommand->packet);
 			}
 		}
-		mrtp_free(outgoingCommand);
+		mrtp_object_pool_release(&host->outgoingCommandPool, outgoingCommand);
 	}
 }
 
@@ -312,43 +319,39 @@ static void mrtp_protocol_send_acknowledgements(MRtpHost * host, MRtpPeer * peer
 
 	MRtpProtocol *command = &host->commands[host->commandCount];
 	MRtpBuffer *buffer = &host->buffers[host->bufferCount];
+	MRtpAcknowledgementRing * ring = &peer->acknowledgements;
 	MRtpAcknowledgement * acknowledgement;
-	MRtpListIterator currentAcknowledgement;
 	mrtp_uint16 reliableSequenceNumber;
 
-	currentAcknowledgement = mrtp_list_begin(&peer->acknowledgements);
+	while (ring->count > 0) {
 
-	while (currentAcknowledgement != mrtp_list_end(&peer->acknowledgements)) {
-
-		if (command >= &host->commands[sizeof(host->commands) / sizeof(MRtpProtocol)] ||
-			buffer >= &host->buffers[sizeof(host->buffers) / sizeof(MRtpBuffer)] ||
+		if (command >= &host->commands[MRTP_PROTOCOL_MAXIMUM_PACKET_COMMANDS] ||
+			buffer >= &host->buffers[MRTP_BUFFER_MAXIMUM] ||
 			peer->mtu - host->packetSize < sizeof(MRtpProtocolAcknowledge))
 		{
 			host->continueSending = 1;
 			break;
 		}
 
-		acknowledgement = (MRtpAcknowledgement *)currentAcknowledgement;
-		currentAcknowledgement = mrtp_list_next(currentAcknowledgement);
+		acknowledgement = &ring->acknowledgements[ring->first];
 
 		buffer->data = command;
 		buffer->dataLength = sizeof(MRtpProtocolAcknowledge);
 
 		host->packetSize += buffer->dataLength;
 
-		reliableSequenceNumber = MRTP_HOST_TO_NET_16(acknowledgement->command.header.sequenceNumber);
+		reliableSequenceNumber = MRTP_HOST_TO_NET_16(acknowledgement->command.sequenceNumber);
 
+		// the command slot may hold a command of an earlier datagram, an acknowledgement is never acknowledged
 		command->header.command = MRTP_PROTOCOL_COMMAND_ACKNOWLEDGE;
+		command->header.flag = 0;
 		command->header.sequenceNumber = reliableSequenceNumber;
 		command->acknowledge.receivedReliableSequenceNumber = reliableSequenceNumber;
 		command->acknowledge.receivedSentTime = MRTP_HOST_TO_NET_16(acknowledgement->sentTime);
-		command->acknowledge.channelID = channelIDs[acknowledgement->command.header.command & MRTP_PROTOCOL_COMMAND_MASK];
+		command->acknowledge.channelID = channelIDs[acknowledgement->command.command & MRTP_PROTOCOL_COMMAND_MASK];
 		if (command->acknowledge.channelID < peer->channelCount) {
-			// maybe 
-			if (peer->channels) {
-				command->acknowledge.nextUnackSequenceNumber =
-					MRTP_HOST_TO_NET_16(peer->channels[command->acknowledge.channelID].incomingSequenceNumber + 1);
-			}
+			command->acknowledge.nextUnackSequenceNumber =
+				MRTP_HOST_TO_NET_16(peer->channels[command->acknowledge.channelID].incomingSequenceNumber + 1);
 		}
 		else {
 			command->acknowledge.nextUnackSequenceNumber = 0;
@@ -357,20 +360,20 @@ static void mrtp_protocol_send_acknowledgements(MRtpHost * host, MRtpPeer * peer
 #if defined(PRINTLOG) && defined(SENDANDRECEIVE)
 		fprintf(host->logFile, "add buffer [ack]: (%d) at channel: [%d]\n",
 			MRTP_NET_TO_HOST_16(command->header.sequenceNumber),
-			channelIDs[acknowledgement->command.header.command & MRTP_PROTOCOL_COMMAND_MASK]);
+			channelIDs[acknowledgement->command.command & MRTP_PROTOCOL_COMMAND_MASK]);
 #endif // SENDANDRECEIVE
 #if defined(SENDANDRECEIVE)
 		printf("add buffer [ack]: (%d) at channel: [%d]\n",
 			MRTP_NET_TO_HOST_16(command->header.sequenceNumber),
-			channelIDs[acknowledgement->command.header.command & MRTP_PROTOCOL_COMMAND_MASK]);
+			channelIDs[acknowledgement->command.command & MRTP_PROTOCOL_COMMAND_MASK]);
 #endif // SENDANDRECEIVE
 
 		//if the command to ack is disconnect, change the peer state to ZOMBIE
-		if ((acknowledgement->command.header.command & MRTP_PROTOCOL_COMMAND_MASK) == MRTP_PROTOCOL_COMMAND_DISCONNECT)
+		if ((acknowledgement->command.command & MRTP_PROTOCOL_COMMAND_MASK) == MRTP_PROTOCOL_COMMAND_DISCONNECT)
 			mrtp_protocol_dispatch_state(host, peer, MRTP_PEER_STATE_ZOMBIE);
 
-		mrtp_list_remove(&acknowledgement->acknowledgementList);
-		mrtp_free(acknowledgement);
+		ring->first = (ring->first + 1) & (ring->capacity - 1);
+		--ring->count;
 
 		++command;
 		++buffer;
@@ -384,22 +387,19 @@ static int mrtp_protocol_send_redundancy_acknowledgements(MRtpHost* host, MRtpPe
 
 	MRtpProtocol *command = &host->commands[host->commandCount];
 	MRtpBuffer *buffer = &host->buffers[host->bufferCount];
+	MRtpAcknowledgementRing * ring = &peer->redundancyAcknowledgemets;
 	MRtpAcknowledgement * acknowledgement;
-	MRtpListIterator currentAcknowledgement;
 	mrtp_uint16 sequenceNumber;
 
 	mrtp_uint16 nextRedundancyNumber = peer->channels[MRTP_PROTOCOL_REDUNDANCY_CHANNEL_NUM].incomingSequenceNumber + 1;
 
-	currentAcknowledgement = mrtp_list_begin(&peer->redundancyAcknowledgemets);
-
-	while (currentAcknowledgement != mrtp_list_end(&peer->redundancyAcknowledgemets)) {
+	while (ring->count > 0) {
 
-		acknowledgement = (MRtpAcknowledgement *)currentAcknowledgement;
-		sequenceNumber = acknowledgement->command.header.sequenceNumber;
-		currentAcknowledgement = mrtp_list_next(currentAcknowledgement);
+		acknowledgement = &ring->acknowledgements[ring->first];
+		sequenceNumber = acknowledgement->command.sequenceNumber;
 
-		if (command >= &host->commands[sizeof(host->commands) / sizeof(MRtpProtocol)] ||
-			buffer >= &host->buffers[sizeof(host->buffers) / sizeof(MRtpBuffer)] ||
+		if (command >= &host->commands[MRTP_PROTOCOL_MAXIMUM_PACKET_COMMANDS] ||
+			buffer >= &host->buffers[MRTP_BUFFER_MAXIMUM] ||
 			peer->mtu - host->packetSize < sizeof(MRtpProtocolRedundancyAcknowledge))
 		{
 			host->continueSending = 1;
@@ -412,7 +412,9 @@ static int mrtp_protocol_send_redundancy_acknowledgements(MRtpHost* host, MRtpPe
 
 		host->packetSize += buffer->dataLength;
 
+		// a stale acknowledge flag would have the peer acknowledge this sequence number of its own commands
 		command->header.command = MRTP_PROTOCOL_COMMAND_REDUNDANCY_ACKNOWLEDGE;
+		command->header.flag = 0;
 		command->header.sequenceNumber = MRTP_HOST_TO_NET_16(sequenceNumber);
 		command->redundancyAcknowledge.receivedSequenceNumber = MRTP_HOST_TO_NET_16(sequenceNumber);
 		command->redundancyAcknowledge.receivedSentTime = MRTP_HOST_TO_NET_16(acknowledgement->sentTime);
@@ -423,21 +425,21 @@ static int mrtp_protocol_send_redundancy_acknowledgements(MRtpHost* host, MRtpPe
 		fprintf(host->logFile, "add buffer [redundancy ack]: (%d) nextunack: [%d] at channel: [%d]\n",
 			MRTP_NET_TO_HOST_16(command->header.sequenceNumber),
 			MRTP_NET_TO_HOST_16(command->redundancyAcknowledge.nextUnackSequenceNumber),
-			channelIDs[acknowledgement->command.header.command & MRTP_PROTOCOL_COMMAND_MASK]);
+			channelIDs[acknowledgement->command.command & MRTP_PROTOCOL_COMMAND_MASK]);
 #endif // SENDANDRECEIVE
 #if defined(SENDANDRECEIVE)
 		printf("add buffer [redundancy ack]: (%d) nextunack: [%d] at channel: [%d]\n",
 			MRTP_NET_TO_HOST_16(command->header.sequenceNumber),
 			MRTP_NET_TO_HOST_16(command->redundancyAcknowledge.nextUnackSequenceNumber),
-			channelIDs[acknowledgement->command.header.command & MRTP_PROTOCOL_COMMAND_MASK]);
+			channelIDs[acknowledgement->command.command & MRTP_PROTOCOL_COMMAND_MASK]);
 #endif // SENDANDRECEIVE
 
 		++command;
 		++buffer;
 
 
-		mrtp_list_remove(&acknowledgement->acknowledgementList);
-		mrtp_free(acknowledgement);
+		ring->first = (ring->first + 1) & (ring->capacity - 1);
+		--ring->count;
 
 	}
 
@@ -445,6 +447,26 @@ static int mrtp_protocol_send_redundancy_acknowledgements(MRtpHost* host, MRtpPe
 	host->bufferCount = buffer - host->buffers;
 }
 
+// whether the first command of a new window would overrun a window of the channel still in use
+static int mrtp_protocol_window_wraps(MRtpChannel * channel, MRtpOutgoingCommand * outgoingCommand) {
+
+	mrtp_uint16 commandWindow = outgoingCommand->sequenceNumber / MRTP_PEER_WINDOW_SIZE;
+
+	return outgoingCommand->sendAttempts < 1 &&
+		!(outgoingCommand->sequenceNumber % MRTP_PEER_WINDOW_SIZE) &&
+		(channel->commandWindows[(commandWindow + MRTP_PEER_WINDOWS - 1) % MRTP_PEER_WINDOWS] >= MRTP_PEER_WINDOW_SIZE ||
+			channel->usedWindows & ((((1 << MRTP_PEER_FREE_WINDOWS) - 1) << commandWindow) |
+			(((1 << MRTP_PEER_FREE_WINDOWS) - 1) >> (MRTP_PEER_WINDOWS - commandWindow))));
+}
+
+// whether the data of the command would put more in transit than the throttled window of the peer
+static int mrtp_protocol_window_exceeded(MRtpPeer * peer, MRtpOutgoingCommand * outgoingCommand) {
+
+	mrtp_uint32 windowSize = (peer->packetThrottle * peer->windowSize) / MRTP_PEER_PACKET_THROTTLE_SCALE;
+
+	return peer->reliableDataInTransit + outgoingCommand->fragmentLength > MRTP_MAX(windowSize, peer->mtu);
+}
+
 static int mrtp_protocol_send_reliable_commands(MRtpHost * host, MRtpPeer * peer) {
 
 	MRtpProtocol * command = &host->commands[host->commandCount];
@@ -467,12 +489,7 @@ static int mrtp_protocol_send_reliable_commands(MRtpHost * host, MRtpPeer * peer
 		commandWindow = outgoingCommand->sequenceNumber / MRTP_PEER_WINDOW_SIZE;
 
 		if (channel != NULL) {
-			if (!windowWrap &&
-				outgoingCommand->sendAttempts < 1 &&
-				!(outgoingCommand->sequenceNumber % MRTP_PEER_WINDOW_SIZE) &&
-				(channel->commandWindows[(commandWindow + MRTP_PEER_WINDOWS - 1) % MRTP_PEER_WINDOWS] >= MRTP_PEER_WINDOW_SIZE ||
-					channel->usedWindows & ((((1 << MRTP_PEER_FREE_WINDOWS) - 1) << commandWindow) |
-					(((1 << MRTP_PEER_FREE_WINDOWS) - 1) >> (MRTP_PEER_WINDOWS - commandWindow)))))
+			if (!windowWrap && mrtp_protocol_window_wraps(channel, outgoingCommand))
 				windowWrap = 1;
 #if defined(PRINTLOG) && defined(RELIABLEWINDOWDEBUG)
 			fprintf(host->logFile, "channel: %d,realiableSeqNum: %d, reliableWindow: %d, number in window:[%d]\n",
@@ -492,12 +509,8 @@ static int mrtp_protocol_send_reliable_commands(MRtpHost * host, MRtpPeer * peer
 
 		// if the data in transmit is lager than the window size
 		if (outgoingCommand->packet != NULL) {
-			if (!windowExceeded) {
-				mrtp_uint32 windowSize = (peer->packetThrottle * peer->windowSize) / MRTP_PEER_PACKET_THROTTLE_SCALE;
-
-				if (peer->reliableDataInTransit + outgoingCommand->fragmentLength > MRTP_MAX(windowSize, peer->mtu))
-					windowExceeded = 1;
-			}
+			if (!windowExceeded && mrtp_protocol_window_exceeded(peer, outgoingCommand))
+				windowExceeded = 1;
 			if (windowExceeded) {
 				currentCommand = mrtp_list_next(currentCommand);
 
@@ -509,8 +522,8 @@ static int mrtp_protocol_send_reliable_commands(MRtpHost * host, MRtpPeer * peer
 
 		// if the data in host buffer is full
 		commandSize = commandSizes[outgoingCommand->command.header.command & MRTP_PROTOCOL_COMMAND_MASK];
-		if (command >= &host->commands[sizeof(host->commands) / sizeof(MRtpProtocol)] ||	//	the command buffer is full
-			buffer + 1 >= &host->buffers[sizeof(host->buffers) / sizeof(MRtpBuffer)] ||	// host's send buffer is full
+		if (command >= &host->commands[MRTP_PROTOCOL_MAXIMUM_PACKET_COMMANDS] ||	//	the command buffer is full
+			buffer + 1 >= &host->buffers[MRTP_BUFFER_MAXIMUM] ||	// host's send buffer is full
 			peer->mtu - host->packetSize < commandSize ||	// the total send packetSize is larger than mtu
 			(outgoingCommand->packet != NULL &&
 			(mrtp_uint16)(peer->mtu - host->packetSize) < (mrtp_uint16)(commandSize + outgoingCommand->fragmentLength)))
@@ -520,6 +533,10 @@ static int mrtp_protocol_send_reliable_commands(MRtpHost * host, MRtpPeer * peer
 			break;
 		}
 
+		// index the command by its sequence number the first time it goes out, acknowledgements look it up there
+		if (outgoingCommand->sendAttempts < 1 && mrtp_peer_insert_sent_command(peer, outgoingCommand) < 0)
+			break;
+
 		currentCommand = mrtp_list_next(currentCommand);
 
 		if (channel != NULL && outgoingCommand->sendAttempts < 1) {
@@ -540,6 +557,7 @@ static int mrtp_protocol_send_reliable_commands(MRtpHost * host, MRtpPeer * peer
 
 		// transter command from outgoing queue to sent queue
 		mrtp_list_insert(mrtp_list_end(&peer->sentReliableCommands), mrtp_list_remove(&outgoingCommand->outgoingCommandList));
+		outgoingCommand->inTransit = 1;
 
 		outgoingCommand->sentTime = host->serviceTime;
 
@@ -557,6 +575,7 @@ static int mrtp_protocol_send_reliable_commands(MRtpHost * host, MRtpPeer * peer
 
 			buffer->data = outgoingCommand->packet->data + outgoingCommand->fragmentOffset;
 			buffer->dataLength = outgoingCommand->fragmentLength;
+			host->sendPackets[buffer - host->sendBuffers] = outgoingCommand->packet;
 
 			host->packetSize += outgoingCommand->fragmentLength;
 
@@ -653,7 +672,7 @@ static int mrtp_protocol_send_redundancy_noack_commands(MRtpHost * host, MRtpPee
 		mrtp_list_empty(&peer->outgoingUnsequencedCommands) &&
 		mrtp_list_empty(&peer->sentReliableCommands) &&
 		mrtp_list_empty(&peer->outgoingRedundancyCommands) &&
-		mrtp_list_empty(&peer->sentRedundancyLastTimeCommands) &&
+		mrtp_list_empty(&peer->sentRedundancyCommands) &&
 		mrtp_list_empty(&peer->outgoingRedundancyNoAckCommands))
 		mrtp_peer_disconnect(peer);
 
@@ -666,47 +685,55 @@ static int mrtp_protocol_send_redundancy_commands(MRtpHost * host, MRtpPeer * pe
 	MRtpBuffer * buffer = &host->buffers[host->bufferCount];
 	MRtpOutgoingCommand * outgoingCommand;
 	MRtpListIterator currentCommand;
+	MRtpSentCommandRing * ring;
 	MRtpChannel *channel;
-	mrtp_uint16 commandWindow;
+	mrtp_uint16 commandWindow, sequenceNumber;
 	size_t commandSize;
 	mrtp_uint8 channelID;
 	int windowWrap = 0, windowExceeded = 0;
 
 	// if too many command can't get ack from the peer
-	if (peer->sentRedundancyLastTimeSize >= MRTP_PROTOCOL_MAXIMUM_REDUNDANCY_COMMAND_QUEUE_SiZE) {
+	if (peer->sentRedundancySize >= MRTP_PROTOCOL_MAXIMUM_REDUNDANCY_COMMAND_QUEUE_SiZE) {
 		mrtp_protocol_notify_disconnect(host, peer, event);
 		return 1;
 	}
 
 	// if hasn't resend the command after last receive
 	// or need to send new command and maybe already has received the ack, but the ack command has lost
-	if (!mrtp_list_empty(&peer->sentRedundancyLastTimeCommands) && (peer->sendRedundancyAfterReceive == FALSE ||
+	if (!mrtp_list_empty(&peer->sentRedundancyCommands) && (peer->sendRedundancyAfterReceive == FALSE ||
 		(!mrtp_list_empty(&peer->outgoingRedundancyCommands) && (peer->redundancyLastSentTimeStamp == 0 ||
 		(MRTP_TIME_DIFFERENCE(host->serviceTime, peer->redundancyLastSentTimeStamp) >= peer->roundTripTime) ||
 			(peer->roundTripTime > 2 * peer->roundTripTimeVariance &&
 				MRTP_TIME_DIFFERENCE(host->serviceTime, peer->redundancyLastSentTimeStamp) >=
 				peer->roundTripTime - 2 * peer->roundTripTimeVariance)))))
 	{
-		currentCommand = mrtp_list_begin(&peer->sentRedundancyLastTimeCommands);
+		// walk the commands in flight in sequence order, a walk cut short by a full datagram goes on from there
+		ring = &peer->channels[MRTP_PROTOCOL_REDUNDANCY_CHANNEL_NUM].sentCommands;
+		sequenceNumber = peer->redundancyResendSequenceNumber;
+		if ((mrtp_uint16)(sequenceNumber - ring->first) >= (mrtp_uint16)(ring->last - ring->first))
+			sequenceNumber = ring->first;
 
-		while (currentCommand != mrtp_list_end(&peer->sentRedundancyLastTimeCommands)) {
+		for (; sequenceNumber != ring->last && ring->count > 0; ++sequenceNumber) {
+
+			outgoingCommand = ring->commands[sequenceNumber & (ring->capacity - 1)];
+
+			// acknowledged, waiting on the outgoing queue, or already sent in this round
+			if (outgoingCommand == NULL || !outgoingCommand->inTransit ||
+				outgoingCommand->sentEpoch == peer->redundancySendEpoch)
+				continue;
 
-			outgoingCommand = (MRtpOutgoingCommand *)currentCommand;
 			channelID = channelIDs[outgoingCommand->command.header.command & MRTP_PROTOCOL_COMMAND_MASK];
 
 			// maybe this command is put in the queue just now
 			if (peer->roundTripTime > peer->roundTripTimeVariance &&
 				MRTP_TIME_DIFFERENCE(host->serviceTime, outgoingCommand->sentTime) <
 				peer->roundTripTime - 2 * peer->roundTripTimeVariance)
-			{
-				currentCommand = mrtp_list_next(currentCommand);
 				continue;
-			}
 
 			commandSize = commandSizes[outgoingCommand->command.header.command & MRTP_PROTOCOL_COMMAND_MASK];
 
-			if (command >= &host->commands[sizeof(host->commands) / sizeof(MRtpProtocol)] ||
-				buffer + 1 >= &host->buffers[sizeof(host->buffers) / sizeof(MRtpBuffer)] ||
+			if (command >= &host->commands[MRTP_PROTOCOL_MAXIMUM_PACKET_COMMANDS] ||
+				buffer + 1 >= &host->buffers[MRTP_BUFFER_MAXIMUM] ||
 				peer->mtu - host->packetSize < commandSize ||
 				(outgoingCommand->packet != NULL &&
 				(mrtp_uint16)(peer->mtu - host->packetSize) < (mrtp_uint16)(commandSize + outgoingCommand->fragmentLength)))
@@ -716,8 +743,6 @@ static int mrtp_protocol_send_redundancy_commands(MRtpHost * host, MRtpPeer * pe
 				break;
 			}
 
-			currentCommand = mrtp_list_next(currentCommand);
-
 			++outgoingCommand->sendAttempts;
 
 			// if retransmit too many times, then disconnect
@@ -732,11 +757,8 @@ static int mrtp_protocol_send_redundancy_commands(MRtpHost * host, MRtpPeer * pe
 				outgoingCommand->roundTripTimeoutLimit = peer->timeoutLimit * outgoingCommand->roundTripTimeout;
 			}
 
-			mrtp_list_insert(mrtp_list_end(&peer->sentRedundancyThisTimeCommands), mrtp_list_remove(&outgoingCommand->outgoingCommandList));
-			--peer->sentRedundancyLastTimeSize;
-			++peer->sentRedundancyThisTimeSize;
-
 			outgoingCommand->sentTime = host->serviceTime;
+			outgoingCommand->sentEpoch = peer->redundancySendEpoch;
 
 			buffer->data = command;
 			buffer->dataLength = commandSize;
@@ -751,6 +773,7 @@ static int mrtp_protocol_send_redundancy_commands(MRtpHost * host, MRtpPeer * pe
 
 				buffer->data = outgoingCommand->packet->data + outgoingCommand->fragmentOffset;
 				buffer->dataLength = outgoingCommand->fragmentLength;
+				host->sendPackets[buffer - host->sendBuffers] = outgoingCommand->packet;
 
 				host->packetSize += outgoingCommand->fragmentLength;
 
@@ -770,10 +793,7 @@ static int mrtp_protocol_send_redundancy_commands(MRtpHost * host, MRtpPeer * pe
 			++buffer;
 		}
 
-		if (mrtp_list_empty(&peer->sentRedundancyLastTimeCommands)) {
-			outgoingCommand = (MRtpOutgoingCommand *)mrtp_list_begin(&peer->sentRedundancyLastTimeCommands);
-			peer->nextRedundancyTimeout = host->serviceTime + outgoingCommand->roundTripTimeout;
-		}
+		peer->redundancyResendSequenceNumber = sequenceNumber;
 
 		// after all command has send, then refresh the sent time stamp
 		if (host->continueSending == 0) {
@@ -791,12 +811,7 @@ static int mrtp_protocol_send_redundancy_commands(MRtpHost * host, MRtpPeer * pe
 		channel = channelID < peer->channelCount ? &peer->channels[channelID] : NULL;
 		commandWindow = outgoingCommand->sequenceNumber / MRTP_PEER_WINDOW_SIZE;
 
-		if (!windowWrap &&
-			outgoingCommand->sendAttempts < 1 &&
-			!(outgoingCommand->sequenceNumber % MRTP_PEER_WINDOW_SIZE) &&
-			(channel->commandWindows[(commandWindow + MRTP_PEER_WINDOWS - 1) % MRTP_PEER_WINDOWS] >= MRTP_PEER_WINDOW_SIZE ||
-				channel->usedWindows & ((((1 << MRTP_PEER_FREE_WINDOWS) - 1) << commandWindow) |
-				(((1 << MRTP_PEER_FREE_WINDOWS) - 1) >> (MRTP_PEER_WINDOWS - commandWindow)))))
+		if (!windowWrap && mrtp_protocol_window_wraps(channel, outgoingCommand))
 			windowWrap = 1;
 
 		if (windowWrap) {
@@ -807,9 +822,7 @@ static int mrtp_protocol_send_redundancy_commands(MRtpHost * host, MRtpPeer * pe
 		// to ensure that the data in transmit is not too mush
 		if (outgoingCommand->packet != NULL) {
 			if (!windowExceeded) {
-				mrtp_uint32 windowSize = (peer->packetThrottle * peer->windowSize) / MRTP_PEER_PACKET_THROTTLE_SCALE;
-
-				if (peer->reliableDataInTransit + outgoingCommand->fragmentLength > MRTP_MAX(windowSize, peer->mtu))
+				if (mrtp_protocol_window_exceeded(peer, outgoingCommand))
 					windowExceeded = 1;
 			}
 			else break;
@@ -818,8 +831,8 @@ static int mrtp_protocol_send_redundancy_commands(MRtpHost * host, MRtpPeer * pe
 		// if the data in host buffer is full
 		commandSize = commandSizes[outgoingCommand->command.header.command & MRTP_PROTOCOL_COMMAND_MASK];
 
-		if (command >= &host->commands[sizeof(host->commands) / sizeof(MRtpProtocol)] ||// the host->commands is full
-			buffer + 1 >= &host->buffers[sizeof(host->buffers) / sizeof(MRtpBuffer)] ||	// the host->buffers is full
+		if (command >= &host->commands[MRTP_PROTOCOL_MAXIMUM_PACKET_COMMANDS] ||// the host->commands is full
+			buffer + 1 >= &host->buffers[MRTP_BUFFER_MAXIMUM] ||	// the host->buffers is full
 			peer->mtu - host->packetSize < commandSize ||	// total size is larger than mtu
 			(outgoingCommand->packet != NULL &&
 			(mrtp_uint16)(peer->mtu - host->packetSize) < (mrtp_uint16)(commandSize + outgoingCommand->fragmentLength)))
@@ -829,6 +842,10 @@ static int mrtp_protocol_send_redundancy_commands(MRtpHost * host, MRtpPeer * pe
 			break;
 		}
 
+		// index the command by its sequence number the first time it goes out, a resend stays indexed
+		if (outgoingCommand->sendAttempts < 1 && mrtp_peer_insert_sent_command(peer, outgoingCommand) < 0)
+			break;
+
 		currentCommand = mrtp_list_next(currentCommand);
 
 		if (channel != NULL && outgoingCommand->sendAttempts < 1) {
@@ -850,17 +867,19 @@ static int mrtp_protocol_send_redundancy_commands(MRtpHost * host, MRtpPeer * pe
 			outgoingCommand->roundTripTimeoutLimit = peer->timeoutLimit * outgoingCommand->roundTripTimeout;
 		}
 
-		if (mrtp_list_empty(&peer->sentRedundancyLastTimeCommands) &&
-			mrtp_list_empty(&peer->sentRedundancyThisTimeCommands))
+		if (mrtp_list_empty(&peer->sentRedundancyCommands) ||
+			MRTP_TIME_LESS(host->serviceTime + outgoingCommand->roundTripTimeout, peer->nextRedundancyTimeout))
 		{
 			peer->nextRedundancyTimeout = host->serviceTime + outgoingCommand->roundTripTimeout;
 		}
 
 		// move the command from outgoing queue to sent queue
-		mrtp_list_insert(mrtp_list_end(&peer->sentRedundancyThisTimeCommands), mrtp_list_remove(&outgoingCommand->outgoingCommandList));
-		++peer->sentRedundancyThisTimeSize;
+		mrtp_list_insert(mrtp_list_end(&peer->sentRedundancyCommands), mrtp_list_remove(&outgoingCommand->outgoingCommandList));
+		outgoingCommand->inTransit = 1;
+		++peer->sentRedundancySize;
 
 		outgoingCommand->sentTime = host->serviceTime;
+		outgoingCommand->sentEpoch = peer->redundancySendEpoch;
 
 		// add the command to host->buffer
 		buffer->data = command;
@@ -877,6 +896,7 @@ static int mrtp_protocol_send_redundancy_commands(MRtpHost * host, MRtpPeer * pe
 
 			buffer->data = outgoingCommand->packet->data + outgoingCommand->fragmentOffset;
 			buffer->dataLength = outgoingCommand->fragmentLength;
+			host->sendPackets[buffer - host->sendBuffers] = outgoingCommand->packet;
 
 			host->packetSize += outgoingCommand->fragmentLength;
 
@@ -922,8 +942,8 @@ static int mrtp_protocol_send_unsequenced_commands(MRtpHost * host, MRtpPeer * p
 
 		commandSize = commandSizes[outgoingCommand->command.header.command & MRTP_PROTOCOL_COMMAND_MASK];
 
-		if (command >= &host->commands[sizeof(host->commands) / sizeof(MRtpProtocol)] ||
-			buffer + 1 >= &host->buffers[sizeof(host->buffers) / sizeof(MRtpBuffer)] ||
+		if (command >= &host->commands[MRTP_PROTOCOL_MAXIMUM_PACKET_COMMANDS] ||
+			buffer + 1 >= &host->buffers[MRTP_BUFFER_MAXIMUM] ||
 			peer->mtu - host->packetSize < commandSize ||
 			(outgoingCommand->packet != NULL &&
 				peer->mtu - host->packetSize < commandSize + outgoingCommand->fragmentLength))
@@ -949,7 +969,7 @@ static int mrtp_protocol_send_unsequenced_commands(MRtpHost * host, MRtpPeer * p
 					mrtp_packet_destroy(outgoingCommand->packet);
 				}
 				mrtp_list_remove(&outgoingCommand->outgoingCommandList);
-				mrtp_free(outgoingCommand);
+				mrtp_object_pool_release(&host->outgoingCommandPool, outgoingCommand);
 
 				continue;
 			}
@@ -971,6 +991,7 @@ static int mrtp_protocol_send_unsequenced_commands(MRtpHost * host, MRtpPeer * p
 
 			buffer->data = outgoingCommand->packet->data + outgoingCommand->fragmentOffset;
 			buffer->dataLength = outgoingCommand->fragmentLength;
+			host->sendPackets[buffer - host->sendBuffers] = outgoingCommand->packet;
 
 			host->packetSize += buffer->dataLength;
 
@@ -978,7 +999,7 @@ static int mrtp_protocol_send_unsequenced_commands(MRtpHost * host, MRtpPeer * p
 			mrtp_list_insert(mrtp_list_end(&peer->sentUnsequencedCommands), outgoingCommand);
 		}
 		else
-			mrtp_free(outgoingCommand);
+			mrtp_object_pool_release(&host->outgoingCommandPool, outgoingCommand);
 
 #if defined(PRINTLOG) && defined(SENDANDRECEIVE)
 		if (outgoingCommand->command.header.command & MRTP_PROTOCOL_COMMAND_MASK == MRTP_PROTOCOL_COMMAND_SEND_UNSEQUENCED) {
@@ -1025,65 +1046,477 @@ static int mrtp_protocol_send_unsequenced_commands(MRtpHost * host, MRtpPeer * p
 		mrtp_list_empty(&peer->outgoingUnsequencedCommands) &&
 		mrtp_list_empty(&peer->sentReliableCommands) &&
 		mrtp_list_empty(&peer->outgoingRedundancyCommands) &&
-		mrtp_list_empty(&peer->sentRedundancyLastTimeCommands) &&
+		mrtp_list_empty(&peer->sentRedundancyCommands) &&
 		mrtp_list_empty(&peer->outgoingRedundancyNoAckCommands))
 		mrtp_peer_disconnect(peer);
 
 }
 
+static size_t mrtp_protocol_message_length(const MRtpSocketMessage * message) {
+
+	size_t i, length = 0;
+
+	for (i = 0; i < message->bufferCount; ++i)
+		length += message->buffers[i].dataLength;
+
+	return length;
+}
+
+// merge the runs of equal sized datagrams to one peer, which were staged back to back,
+// into single messages that the kernel splits again (UDP GSO)
+static size_t mrtp_protocol_coalesce_segments(const MRtpSocketMessage * messages, size_t messageCount,
+	MRtpSocketMessage * segmentMessages, size_t * firstMessages) {
+
+	size_t segmentMessageCount = 0, i = 0, j;
+
+	while (i < messageCount) {
+
+		const MRtpSocketMessage * message = &messages[i];
+		size_t segmentSize = mrtp_protocol_message_length(message);
+		size_t dataLength = segmentSize, bufferCount = message->bufferCount, segments = 1;
+
+		for (j = i + 1; j < messageCount; ++j) {
+
+			const MRtpSocketMessage * nextMessage = &messages[j];
+			size_t nextLength = mrtp_protocol_message_length(nextMessage);
+
+			if (nextMessage->address.host != message->address.host ||
+				nextMessage->address.port != message->address.port ||
+				nextMessage->buffers != &message->buffers[bufferCount] ||
+				nextMessage->sendTime != message->sendTime ||
+				nextLength > segmentSize ||
+				segments >= MRTP_HOST_MAXIMUM_SEGMENTS ||
+				dataLength + nextLength > MRTP_HOST_MAXIMUM_SEGMENT_DATA ||
+				bufferCount + nextMessage->bufferCount > MRTP_HOST_MAXIMUM_SEGMENT_BUFFERS)
+				break;
+
+			dataLength += nextLength;
+			bufferCount += nextMessage->bufferCount;
+			++segments;
+
+			// only the last segment may be shorter
+			if (nextLength < segmentSize) {
+				++j;
+				break;
+			}
+		}
+
+		firstMessages[segmentMessageCount] = i;
+		segmentMessages[segmentMessageCount] = *message;
+		segmentMessages[segmentMessageCount].bufferCount = bufferCount;
+		segmentMessages[segmentMessageCount].segmentSize = segments > 1 ? segmentSize : 0;
+		++segmentMessageCount;
+
+		i = j;
+	}
+
+	return segmentMessageCount;
+}
+
+// the packet data a staged datagram carries, which can be sent without copying it
+static size_t mrtp_protocol_zero_copy_length(MRtpHost * host, const MRtpSocketMessage * message) {
+
+	size_t first = message->buffers - host->sendBuffers, length = 0, i;
+
+	for (i = 0; i < message->bufferCount; ++i) {
+		if (host->sendPackets[first + i] != NULL)
+			length += message->buffers[i].dataLength;
+	}
+
+	return length;
+}
+
+// send a staged datagram with MSG_ZEROCOPY and hold its packets until the kernel reports the send done
+// the headers and commands are copied out, their staging slots are reused by the next batch
+// return 1 if it was sent, 0 if it has to be sent by copy
+static int mrtp_protocol_send_zero_copy(MRtpHost * host, size_t socketIndex, MRtpSocketMessage * message) {
+
+	size_t first = message->buffers - host->sendBuffers, packetCount = 0, copyLength = 0, i;
+	MRtpSocketMessage zeroCopyMessage;
+	MRtpZeroCopySend * zeroCopySend;
+	mrtp_uint8 * copyData;
+	int result;
+
+	for (i = 0; i < message->bufferCount; ++i) {
+		if (host->sendPackets[first + i] != NULL)
+			++packetCount;
+		else
+			copyLength += message->buffers[i].dataLength;
+	}
+
+	zeroCopySend = (MRtpZeroCopySend *)mrtp_malloc(sizeof(MRtpZeroCopySend) +
+		message->bufferCount * sizeof(MRtpBuffer) + packetCount * sizeof(MRtpPacket *) + copyLength);
+	if (zeroCopySend == NULL)
+		return 0;
+
+	zeroCopySend->buffers = (MRtpBuffer *)&zeroCopySend[1];
+	zeroCopySend->bufferCount = message->bufferCount;
+	zeroCopySend->packets = (MRtpPacket **)&zeroCopySend->buffers[message->bufferCount];
+	zeroCopySend->packetCount = 0;
+	copyData = (mrtp_uint8 *)&zeroCopySend->packets[packetCount];
+
+	for (i = 0; i < message->bufferCount; ++i) {
+		MRtpBuffer * buffer = &zeroCopySend->buffers[i];
+
+		*buffer = message->buffers[i];
+
+		if (host->sendPackets[first + i] != NULL)
+			zeroCopySend->packets[zeroCopySend->packetCount++] = host->sendPackets[first + i];
+		else {
+			memcpy(copyData, message->buffers[i].data, message->buffers[i].dataLength);
+			buffer->data = copyData;
+			copyData += buffer->dataLength;
+		}
+	}
+
+	zeroCopyMessage = *message;
+	zeroCopyMessage.buffers = zeroCopySend->buffers;
+
+	result = mrtp_socket_send_zero_copy(host->sockets[socketIndex], &zeroCopyMessage);
+	if (result <= 0) {
+		mrtp_free(zeroCopySend);
+		return result;
+	}
+
+	message->sentLength = zeroCopyMessage.sentLength;
+
+	for (i = 0; i < zeroCopySend->packetCount; ++i)
+		++zeroCopySend->packets[i]->referenceCount;
+
+	// the kernel numbers the zero copy sends of a socket one after another
+	zeroCopySend->socketIndex = socketIndex;
+	zeroCopySend->sequence = host->zeroCopySequences[socketIndex]++;
+	mrtp_list_insert(mrtp_list_end(&host->zeroCopySends), zeroCopySend);
+
+	return 1;
+}
+
+// send staged datagrams out of one socket
+// if the socket would block, the rest are dropped as a single send would drop them
+static int mrtp_protocol_send_messages(MRtpHost * host, size_t socketIndex, MRtpSocketMessage * messages, size_t messageCount) {
+
+	MRtpSocketMessage segmentMessages[MRTP_HOST_SEND_BATCH_SIZE];
+	size_t firstMessages[MRTP_HOST_SEND_BATCH_SIZE];
+	MRtpSocketMessage * sendMessages = messages;
+	size_t sendMessageCount = messageCount, sentMessages = 0, batchCount;
+	int sentCount, i;
+
+	if (host->segmentOffload && messageCount > 1) {
+		sendMessages = segmentMessages;
+		sendMessageCount = mrtp_protocol_coalesce_segments(messages, messageCount, segmentMessages, firstMessages);
+	}
+
+	while (sentMessages < sendMessageCount) {
+
+		batchCount = sendMessageCount - sentMessages;
+
+		// the datagrams with enough packet data go out one at a time with MSG_ZEROCOPY,
+		// the others are batched up to the next such datagram
+		if (host->zeroCopyThreshold != 0 && host->socketRings[socketIndex] == NULL) {
+			for (batchCount = 0; sentMessages + batchCount < sendMessageCount; ++batchCount) {
+				if (mrtp_protocol_zero_copy_length(host, &sendMessages[sentMessages + batchCount]) >= host->zeroCopyThreshold)
+					break;
+			}
+
+			if (batchCount == 0) {
+				sentCount = mrtp_protocol_send_zero_copy(host, socketIndex, &sendMessages[sentMessages]);
+				if (sentCount == 0)
+					batchCount = 1;
+			}
+		}
+
+		if (batchCount > 0) {
+			if (host->socketRings[socketIndex] != NULL)
+				sentCount = mrtp_socket_ring_send_batch(host->socketRings[socketIndex], &sendMessages[sentMessages], batchCount);
+			else
+				sentCount = mrtp_socket_send_batch(host->sockets[socketIndex], &sendMessages[sentMessages], batchCount);
+		}
+
+		if (sentCount < 0) {
+			// the kernel or the device can't segment the datagrams, resend the rest as plain datagrams,
+			// the other errors leave segmentation on
+			if (sentCount == -2 && sendMessages != messages) {
+				size_t firstUnsent = firstMessages[sentMessages];
+
+				host->segmentOffload = 0;
+
+				return mrtp_protocol_send_messages(host, socketIndex, &messages[firstUnsent], messageCount - firstUnsent);
+			}
+
+			return -1;
+		}
+
+		if (sentCount == 0)
+			break;
+
+		for (i = 0; i < sentCount; ++i) {
+			MRtpSocketMessage * message = &sendMessages[sentMessages + i];
+#if defined(PRINTLOG) && defined(SENDANDRECEIVE)
+			fprintf(host->logFile, "send: %d to port: <%d> at {%d}\n",
+				(int)message->sentLength, message->address.port, host->serviceTime);
+#endif // SENDANDRECEIVE
+#ifdef SENDANDRECEIVE
+			printf("send: %d to port: <%d> at {%d}\n",
+				(int)message->sentLength, message->address.port, host->serviceTime);
+#endif // SENDANDRECEIVE
+
+			host->totalSentData += message->sentLength;
+			if (message->segmentSize != 0)
+				host->totalSentPackets += (message->sentLength + message->segmentSize - 1) / message->segmentSize;
+			else
+				host->totalSentPackets++;
+		}
+
+		sentMessages += sentCount;
+	}
+
+	return 0;
+}
+
+// send all the datagrams staged by the send pass, grouped by the socket they go out on
+static int mrtp_protocol_flush_send_batch(MRtpHost * host) {
+
+	MRtpSocketMessage messages[MRTP_HOST_SEND_BATCH_SIZE];
+	size_t messageCount, socketIndex, i;
+	int result = 0;
+
+	if (host->socketCount <= 1)
+		result = mrtp_protocol_send_messages(host, 0, host->sendMessages, host->sendMessageCount);
+	else {
+		for (socketIndex = 0; socketIndex < host->socketCount && result == 0; ++socketIndex) {
+
+			messageCount = 0;
+			for (i = 0; i < host->sendMessageCount; ++i) {
+				if (host->sendSockets[i] == host->sockets[socketIndex])
+					messages[messageCount++] = host->sendMessages[i];
+			}
+
+			if (messageCount > 0)
+				result = mrtp_protocol_send_messages(host, socketIndex, messages, messageCount);
+		}
+	}
+
+	host->sendMessageCount = 0;
+	host->sendBufferCount = 0;
+
+	return result;
+}
+
+// the rate a peer is paced at in bytes per millisecond, a little more than its throttled window per round trip time
+static mrtp_uint32 mrtp_protocol_pacing_rate(MRtpPeer * peer) {
+
+	mrtp_uint32 windowSize = (peer->packetThrottle * peer->windowSize) / MRTP_PEER_PACKET_THROTTLE_SCALE;
+
+	windowSize = MRTP_MAX(windowSize, peer->mtu);
+
+	return MRTP_MAX(windowSize / 100 * MRTP_PEER_PACING_GAIN / MRTP_MAX(peer->roundTripTime, 1), 1);
+}
+
+// the milliseconds until the next datagram of a paced peer may carry data, 0 if it may now
+// the kernel holds back the datagrams stamped up to a round trip time ahead, user space pacing only the slack
+static mrtp_uint32 mrtp_protocol_pacing_wait(MRtpHost * host, MRtpPeer * peer) {
+
+	int ahead = (int)(peer->pacingTime - mrtp_time_micro());
+	int slack = MRTP_PEER_PACING_SLACK;
+
+	if (host->pacing == MRTP_PACING_KERNEL)
+		slack = MRTP_MAX(slack, (int)peer->roundTripTime * 1000);
+
+	// a pacing time far ahead is left from before the clock wrapped
+	if (ahead <= slack || ahead > MRTP_PEER_PACING_HORIZON)
+		return 0;
+
+	return (ahead - slack + 999) / 1000;
+}
+
+// return 1 if a paced peer has to hold back its data, and remember when the host has to send it
+static int mrtp_protocol_pacing_hold(MRtpHost * host, MRtpPeer * peer) {
+
+	mrtp_uint32 pacingWait = mrtp_protocol_pacing_wait(host, peer);
+
+	if (pacingWait == 0)
+		return 0;
+
+	if (host->pacedPeers == 0 || MRTP_TIME_LESS(host->serviceTime + pacingWait, host->pacingTimeout))
+		host->pacingTimeout = host->serviceTime + pacingWait;
+
+	++host->pacedPeers;
+
+	return 1;
+}
+
+// move the pacing time of a peer past a staged datagram, with kernel pacing the datagram leaves at the time it was due
+static void mrtp_protocol_pace(MRtpHost * host, MRtpPeer * peer, MRtpSocketMessage * message) {
+
+	mrtp_uint32 currentTime = mrtp_time_micro();
+	int ahead = (int)(peer->pacingTime - currentTime);
+
+	// an idle peer doesn't save up its rate for a burst
+	if (ahead <= 0 || ahead > MRTP_PEER_PACING_HORIZON)
+		peer->pacingTime = currentTime;
+	else if (host->pacing == MRTP_PACING_KERNEL)
+		message->sendTime = peer->pacingTime != 0 ? peer->pacingTime : 1;
+
+	peer->pacingRate = mrtp_protocol_pacing_rate(peer);
+	peer->pacingTime += (mrtp_uint32)(mrtp_protocol_message_length(message) * 1000 / peer->pacingRate);
+}
+
+#define MRTP_TIMER_PEER(timer) ((MRtpPeer *)((mrtp_uint8 *)(timer) - (size_t) & ((MRtpPeer *)0)->timeoutTimer))
+#define MRTP_SEND_QUEUE_PEER(node) ((MRtpPeer *)((mrtp_uint8 *)(node) - (size_t) & ((MRtpPeer *)0)->sendList))
+
+// arm the timer of a peer at the earliest of its retransmit, ping and redundancy resend deadlines
+static void mrtp_protocol_schedule_timeouts(MRtpHost * host, MRtpPeer * peer) {
+
+	mrtp_uint32 nextTimeout = 0;
+	int hasNextTimeout = 0;
+
+	if (!mrtp_list_empty(&peer->sentReliableCommands)) {
+		nextTimeout = peer->nextTimeout;
+		hasNextTimeout = 1;
+	}
+	else if (peer->state == MRTP_PEER_STATE_CONNECTED || peer->state == MRTP_PEER_STATE_DISCONNECT_LATER) {
+		nextTimeout = peer->lastReceiveTime + peer->pingInterval;
+		hasNextTimeout = 1;
+	}
+
+	if (!mrtp_list_empty(&peer->sentRedundancyCommands) &&
+		(!hasNextTimeout || MRTP_TIME_LESS(peer->nextRedundancyTimeout, nextTimeout)))
+	{
+		nextTimeout = peer->nextRedundancyTimeout;
+		hasNextTimeout = 1;
+	}
+
+	if (hasNextTimeout)
+		mrtp_timer_wheel_schedule(&host->timers, &peer->timeoutTimer, nextTimeout);
+	else
+		mrtp_timer_wheel_cancel(&host->timers, &peer->timeoutTimer);
+}
+
+// mark the peers whose timers expired, only they check their deadlines in this send pass
+static void mrtp_protocol_fire_timers(MRtpHost * host) {
+
+	MRtpList expired;
+	MRtpTimer * timer;
+
+	mrtp_list_clear(&expired);
+	mrtp_timer_wheel_advance(&host->timers, host->serviceTime, &expired);
+
+	while (!mrtp_list_empty(&expired)) {
+		timer = (MRtpTimer *)mrtp_list_remove(mrtp_list_begin(&expired));
+		timer->timerList.next = NULL;
+
+		MRTP_TIMER_PEER(timer)->timeoutsDue = 1;
+		mrtp_peer_queue_send(MRTP_TIMER_PEER(timer));
+	}
+}
+
+// whether a peer has to stay in the send queue after a send pass
+static int mrtp_protocol_peer_needs_send(MRtpPeer * peer) {
+	return peer->acknowledgements.count > 0 ||
+		peer->redundancyAcknowledgemets.count > 0 ||
+		!mrtp_list_empty(&peer->outgoingReliableCommands) ||
+		!mrtp_list_empty(&peer->outgoingRedundancyCommands) ||
+		!mrtp_list_empty(&peer->outgoingUnsequencedCommands) ||
+		!mrtp_list_empty(&peer->outgoingRedundancyNoAckCommands);
+}
+
 static int mrtp_protocol_send_outgoing_commands(MRtpHost * host, MRtpEvent * event, int checkForTimeouts) {
 
-	mrtp_uint8 headerData[sizeof(MRtpProtocolHeader) + sizeof(mrtp_uint32)];
-	MRtpProtocolHeader *header = (MRtpProtocolHeader *)headerData;
+	MRtpProtocolHeader *header;
 	MRtpPeer * currentPeer;
-	int sentLength;
+	MRtpListIterator currentNode, nextNode;
+	size_t peerSegments, acknowledgementBuffers;
+	int continueSending, paced;
 
 	host->continueSending = 1;
+	host->pacedPeers = 0;
+
+	if (checkForTimeouts != 0) {
+		mrtp_protocol_fire_timers(host);
+		mrtp_peer_evict_stale_reassemblies(host);
+
+		// the blocks of a large message come in slabs of several 64KB blocks, they aren't kept once free
+		if (host->reassemblyPool != NULL)
+			mrtp_packet_pool_trim(host->reassemblyPool);
+		if (host->packetPool != NULL)
+			mrtp_packet_pool_trim(host->packetPool);
+	}
 
 	while (host->continueSending) {
 
 		host->continueSending = 0;
-		for (currentPeer = host->peers; currentPeer < &host->peers[host->peerCount]; ++currentPeer) {
+		continueSending = 0;
+		// only the peers with something to do, a peer reset while it is visited leaves the queue
+		for (currentNode = mrtp_list_begin(&host->sendQueue); currentNode != mrtp_list_end(&host->sendQueue); currentNode = nextNode) {
+			currentPeer = MRTP_SEND_QUEUE_PEER(currentNode);
+			nextNode = mrtp_list_next(currentNode);
 
 			if (currentPeer->state == MRTP_PEER_STATE_DISCONNECTED || currentPeer->state == MRTP_PEER_STATE_ZOMBIE)
 				continue;
 
+			peerSegments = 0;
+
+nextSegment:
+			// track whether this peer has more to send
+			continueSending |= host->continueSending;
+			host->continueSending = 0;
+
+			// assemble the datagram of this peer in the next free staging slot
+			header = (MRtpProtocolHeader *)host->sendHeaders[host->sendMessageCount];
+			host->commands = host->sendCommands[host->sendMessageCount];
+			host->buffers = &host->sendBuffers[host->sendBufferCount];
+
+			// only the data buffers set their packet, the slots may still hold the packets of a datagram
+			// of an earlier batch, or of one that was given up before it was staged
+			memset(&host->sendPackets[host->sendBufferCount], 0, MRTP_BUFFER_MAXIMUM * sizeof(MRtpPacket *));
+
 			host->headerFlags = 0;
 			host->commandCount = 0;
 			host->bufferCount = 1;
 			host->packetSize = sizeof(MRtpProtocolHeader);
 
 			// first to hanle the acknowledgements
-			if (!mrtp_list_empty(&currentPeer->acknowledgements))
+			if (currentPeer->acknowledgements.count > 0)
 				mrtp_protocol_send_acknowledgements(host, currentPeer);
 
-			if (!mrtp_list_empty(&currentPeer->redundancyAcknowledgemets))
+			if (currentPeer->redundancyAcknowledgemets.count > 0)
 				mrtp_protocol_send_redundancy_acknowledgements(host, currentPeer);
 
-			if (checkForTimeouts != 0 &&
+			if (checkForTimeouts != 0 && currentPeer->timeoutsDue &&
 				!mrtp_list_empty(&currentPeer->sentReliableCommands) &&
 				MRTP_TIME_GREATER_EQUAL(host->serviceTime, currentPeer->nextTimeout) &&
 				mrtp_protocol_check_timeouts(host, currentPeer, event) == 1)
 			{
-				if (event != NULL && event->type != MRTP_EVENT_TYPE_NONE)
+				if (event != NULL && event->type != MRTP_EVENT_TYPE_NONE) {
+					mrtp_protocol_flush_send_batch(host);
 					return 1;
+				}
 				else
 					continue;
 			}
 
-			if (checkForTimeouts != 0 && !mrtp_list_empty(&currentPeer->sentRedundancyLastTimeCommands) &&
+			if (checkForTimeouts != 0 && currentPeer->timeoutsDue && !mrtp_list_empty(&currentPeer->sentRedundancyCommands) &&
 				MRTP_TIME_GREATER_EQUAL(host->serviceTime, currentPeer->nextRedundancyTimeout) &&
 				mrtp_protocol_check_redundancy_timeouts(host, currentPeer, event) == 1)
 			{
-				if (event != NULL && event->type != MRTP_EVENT_TYPE_NONE)
+				if (event != NULL && event->type != MRTP_EVENT_TYPE_NONE) {
+					mrtp_protocol_flush_send_batch(host);
 					return 1;
+				}
 				else
 					continue;
 			}
 
+			// a paced peer whose next datagram isn't due yet only sends its acknowledgements
+			acknowledgementBuffers = host->bufferCount;
+			paced = host->pacing != MRTP_PACING_NONE;
+			if (paced && mrtp_protocol_pacing_hold(host, currentPeer))
+				goto sendAcknowledgements;
+
 			if ((mrtp_list_empty(&currentPeer->outgoingReliableCommands) ||
 				mrtp_protocol_send_reliable_commands(host, currentPeer)) && // try to send data
 				mrtp_list_empty(&currentPeer->sentReliableCommands) &&		// nothing to send
+				currentPeer->timeoutsDue &&									// the ping deadline may have passed
 				MRTP_TIME_DIFFERENCE(host->serviceTime, currentPeer->lastReceiveTime) >= currentPeer->pingInterval && // the interval to last receive command > pingInterval
 				currentPeer->mtu - host->packetSize >= sizeof(MRtpProtocolPing))	// there is still space for ping command
 			{
@@ -1093,11 +1526,13 @@ static int mrtp_protocol_send_outgoing_commands(MRtpHost * host, MRtpEvent * eve
 
 
 			if (!mrtp_list_empty(&currentPeer->outgoingRedundancyCommands) ||
-				(!mrtp_list_empty(&currentPeer->sentRedundancyLastTimeCommands) && currentPeer->sendRedundancyAfterReceive == FALSE))
+				(!mrtp_list_empty(&currentPeer->sentRedundancyCommands) && currentPeer->sendRedundancyAfterReceive == FALSE))
 			{
 				if (mrtp_protocol_send_redundancy_commands(host, currentPeer, event) == 1) {
-					if (event != NULL && event->type != MRTP_EVENT_TYPE_NONE)
+					if (event != NULL && event->type != MRTP_EVENT_TYPE_NONE) {
+						mrtp_protocol_flush_send_batch(host);
 						return 1;
+					}
 				}
 			}
 
@@ -1107,6 +1542,9 @@ static int mrtp_protocol_send_outgoing_commands(MRtpHost * host, MRtpEvent * eve
 			if (!mrtp_list_empty(&currentPeer->outgoingRedundancyNoAckCommands))
 				mrtp_protocol_send_redundancy_noack_commands(host, currentPeer);
 
+sendAcknowledgements:
+			paced = paced && host->bufferCount > acknowledgementBuffers;
+
 			MRtpRedundancyNoAckBuffer* currentRedundancyNoackBuffer =
 				&currentPeer->redundancyNoAckBuffers[currentPeer->currentRedundancyNoAckBufferNum];
 
@@ -1115,7 +1553,7 @@ static int mrtp_protocol_send_outgoing_commands(MRtpHost * host, MRtpEvent * eve
 			if (host->bufferCount > 1 ||
 				(currentRedundancyNoackBuffer && currentRedundancyNoackBuffer->buffercount > 0))
 			{
-				host->buffers->data = headerData;
+				host->buffers->data = header;
 				if (host->headerFlags & MRTP_PROTOCOL_HEADER_FLAG_SENT_TIME) {
 					header->sentTime = MRTP_HOST_TO_NET_16(host->serviceTime & 0xFFFF);
 					host->buffers->dataLength = sizeof(MRtpProtocolHeader);
@@ -1145,7 +1583,7 @@ static int mrtp_protocol_send_outgoing_commands(MRtpHost * host, MRtpEvent * eve
 						}
 					}
 
-					if (host->bufferCount + redundancyNoackBufferCount <= sizeof(host->buffers) / sizeof(MRtpBuffer) &&
+					if (host->bufferCount + redundancyNoackBufferCount <= MRTP_BUFFER_MAXIMUM &&
 						host->mtu > host->packetSize + redundancyNoackPacketSize)
 					{
 						// copy the peer redundancy buffer to host buffer to send 
@@ -1168,7 +1606,7 @@ static int mrtp_protocol_send_outgoing_commands(MRtpHost * host, MRtpEvent * eve
 							% (currentPeer->redundancyNum + 1);
 						currentRedundancyNoackBuffer = &currentPeer->redundancyNoAckBuffers[currentPeer->currentRedundancyNoAckBufferNum];
 						if (currentRedundancyNoackBuffer->buffercount != 0) {
-							mrtp_protocol_remove_redundancy_buffer_commands(currentRedundancyNoackBuffer);
+							mrtp_protocol_remove_redundancy_buffer_commands(host, currentRedundancyNoackBuffer);
 							currentRedundancyNoackBuffer->buffercount = 0;
 							currentRedundancyNoackBuffer->packetSize = 0;
 						}
@@ -1179,42 +1617,69 @@ static int mrtp_protocol_send_outgoing_commands(MRtpHost * host, MRtpEvent * eve
 
 				}
 
-				sentLength = mrtp_socket_send(host->socket, &currentPeer->address, host->buffers, host->bufferCount);
-				assert(sentLength != 2);
-#if defined(PRINTLOG) && defined(SENDANDRECEIVE)
-				fprintf(host->logFile, "send: %d to peer: <%d> at {%d}\n",
-					sentLength, currentPeer->incomingPeerID, host->serviceTime);
-#endif // SENDANDRECEIVE
-#ifdef SENDANDRECEIVE
-				printf("send: %d to peer: <%d> at {%d}\n",
-					sentLength, currentPeer->incomingPeerID, host->serviceTime);
-#endif // SENDANDRECEIVE
+				MRtpSocketMessage * message = &host->sendMessages[host->sendMessageCount];
+
+				host->sendSockets[host->sendMessageCount++] = currentPeer->socket;
+
+				message->address = currentPeer->address;
+				message->buffers = host->buffers;
+				message->bufferCount = host->bufferCount;
+				message->segmentSize = 0;
+				message->sendTime = 0;
+				message->sentLength = 0;
+
+				// acknowledgements go out at once, they don't use up the pacing rate
+				if (paced)
+					mrtp_protocol_pace(host, currentPeer, message);
 
+				host->sendBufferCount += host->bufferCount;
 
-				if (sentLength < 0)
+				if (host->sendMessageCount >= MRTP_HOST_SEND_BATCH_SIZE &&
+					mrtp_protocol_flush_send_batch(host) < 0)
 					return -1;
 
-				host->totalSentData += sentLength;
-				host->totalSentPackets++;
+				// with segment offload, stage the next datagram of this peer right behind this one
+				// a peer with pending redundancy noack commands waits for the next sweep, its buffers rotate on every datagram
+				if (host->segmentOffload && host->continueSending &&
+					++peerSegments < MRTP_HOST_MAXIMUM_SEGMENTS &&
+					mrtp_list_empty(&currentPeer->outgoingRedundancyNoAckCommands))
+					goto nextSegment;
 			}
 		}
-	}
 
-	for (currentPeer = host->peers; currentPeer < &host->peers[host->peerCount]; ++currentPeer) {
+		host->continueSending |= continueSending;
 
-		if (currentPeer->state == MRTP_PEER_STATE_DISCONNECTED || currentPeer->state == MRTP_PEER_STATE_ZOMBIE)
-			continue;
+		// the redundancy noack buffers of a peer are recycled on its next datagram,
+		// so the staged datagrams must be sent before the peers are visited again
+		if (mrtp_protocol_flush_send_batch(host) < 0)
+			return -1;
+	}
 
-		if (!mrtp_list_empty(&currentPeer->sentRedundancyThisTimeCommands)) {
-			mrtp_list_move(mrtp_list_end(&currentPeer->sentRedundancyLastTimeCommands),
-				mrtp_list_begin(&currentPeer->sentRedundancyThisTimeCommands),
-				mrtp_list_previous(mrtp_list_end(&currentPeer->sentRedundancyThisTimeCommands)));
+	for (currentNode = mrtp_list_begin(&host->sendQueue); currentNode != mrtp_list_end(&host->sendQueue); currentNode = nextNode) {
+		currentPeer = MRTP_SEND_QUEUE_PEER(currentNode);
+		nextNode = mrtp_list_next(currentNode);
 
-			currentPeer->sentRedundancyLastTimeSize += currentPeer->sentRedundancyThisTimeSize;
-			currentPeer->sentRedundancyThisTimeSize = 0;
+		if (currentPeer->state == MRTP_PEER_STATE_DISCONNECTED || currentPeer->state == MRTP_PEER_STATE_ZOMBIE) {
+			mrtp_list_remove(&currentPeer->sendList);
+			currentPeer->needsSend = 0;
+			continue;
 		}
 
+		// the commands sent in this round may be resent in the next one
+		++currentPeer->redundancySendEpoch;
+		currentPeer->redundancyResendSequenceNumber =
+			currentPeer->channels[MRTP_PROTOCOL_REDUNDANCY_CHANNEL_NUM].sentCommands.first;
+
 		currentPeer->sendRedundancyAfterReceive = TRUE;
+
+		currentPeer->timeoutsDue = 0;
+		mrtp_protocol_schedule_timeouts(host, currentPeer);
+
+		// a peer that sent everything is queued again by its next command, acknowledgement, datagram or timer
+		if (!mrtp_protocol_peer_needs_send(currentPeer)) {
+			mrtp_list_remove(&currentPeer->sendList);
+			currentPeer->needsSend = 0;
+		}
 	}
 
 	return 0;
@@ -1244,7 +1709,9 @@ static int mrtp_protocol_delete_reliable_command(MRtpHost * host, MRtpPeer * pee
 
 	if (outgoingCommand->packet != NULL) {
 
-		peer->reliableDataInTransit -= outgoingCommand->fragmentLength;
+		// a command waiting to be resent was taken out of the data in transit already
+		if (outgoingCommand->inTransit)
+			peer->reliableDataInTransit -= outgoingCommand->fragmentLength;
 		--outgoingCommand->packet->referenceCount;
 
 		if (outgoingCommand->packet->referenceCount == 0) {
@@ -1254,7 +1721,7 @@ static int mrtp_protocol_delete_reliable_command(MRtpHost * host, MRtpPeer * pee
 		}
 	}
 
-	mrtp_free(outgoingCommand);
+	mrtp_object_pool_release(&host->outgoingCommandPool, outgoingCommand);
 
 	switch (peer->state)
 	{
@@ -1275,7 +1742,7 @@ static int mrtp_protocol_delete_reliable_command(MRtpHost * host, MRtpPeer * pee
 	case MRTP_PEER_STATE_DISCONNECT_LATER:
 		// after send all the outgoing data then disconnect
 		if (mrtp_list_empty(&peer->outgoingReliableCommands) && mrtp_list_empty(&peer->sentReliableCommands) &&
-			mrtp_list_empty(&peer->outgoingRedundancyCommands) && mrtp_list_empty(&peer->sentRedundancyLastTimeCommands))
+			mrtp_list_empty(&peer->outgoingRedundancyCommands) && mrtp_list_empty(&peer->sentRedundancyCommands))
 			mrtp_peer_disconnect(peer);
 		break;
 
@@ -1293,109 +1760,110 @@ static int mrtp_protocol_delete_reliable_command(MRtpHost * host, MRtpPeer * pee
 	return 0;
 }
 
-static int mrtp_protocol_remove_sent_reliable_command(MRtpHost* host, MRtpPeer * peer, MRtpEvent * event,
-	mrtp_uint16 reliableSequenceNumber, mrtp_uint32 nextUnackSequenceNumber, mrtp_uint8 channelID)
+// the commands sent before the acknowledged one and still not acknowledged count toward a quick retransmit
+// only that prefix of the sent queue is walked, with no loss it is empty
+static void mrtp_protocol_count_fast_acknowledgements(MRtpPeer * peer,
+	MRtpOutgoingCommand * acknowledgedCommand, mrtp_uint16 nextUnackSequenceNumber, mrtp_uint8 channelID)
 {
-	MRtpOutgoingCommand * outgoingCommand = NULL;
+	MRtpOutgoingCommand * outgoingCommand;
 	MRtpListIterator currentCommand, nextCommand;
-	mrtp_uint32 currentSequenceNumber, waitNum;
-	int wasSent = 1;
-	int result = 0;
-	BOOL hasFound = FALSE;
+	mrtp_uint32 waitNum;
 
 	for (currentCommand = mrtp_list_begin(&peer->sentReliableCommands);
-		currentCommand != mrtp_list_end(&peer->sentReliableCommands);
+		currentCommand != &acknowledgedCommand->outgoingCommandList;
 		currentCommand = nextCommand)
 	{
 		outgoingCommand = (MRtpOutgoingCommand *)currentCommand;
 		nextCommand = mrtp_list_next(currentCommand);
-		currentSequenceNumber = outgoingCommand->sequenceNumber;
 
 		if (channelIDs[outgoingCommand->command.header.command & MRTP_PROTOCOL_COMMAND_MASK] != channelID)
 			continue;
 
-		if (outgoingCommand->sequenceNumber == reliableSequenceNumber) {
-			hasFound = TRUE;
-			result |= mrtp_protocol_delete_reliable_command(host, peer, event, reliableSequenceNumber, channelID,
-				outgoingCommand, wasSent);
-		}
-		// remove the already received command and the outgoing command is not disconnect
-		else if (channelID < peer->channelCount && (currentSequenceNumber < nextUnackSequenceNumber ||
-			(currentSequenceNumber - nextUnackSequenceNumber > MRTP_PROTOCOL_MAXIMUM_WINDOW_SIZE / 2 &&
-				currentSequenceNumber < nextUnackSequenceNumber + MRTP_PROTOCOL_MAXIMUM_WINDOW_SIZE)))
+		// received already, the next unack sequence number removes it
+		if (channelID < peer->channelCount &&
+			(mrtp_uint16)(outgoingCommand->sequenceNumber - nextUnackSequenceNumber) >= 0x8000)
+			continue;
+
+		++outgoingCommand->fastAck;
+		waitNum = 1;
+		if ((outgoingCommand->command.header.command & MRTP_PROTOCOL_COMMAND_MASK) ==
+			MRTP_PROTOCOL_COMMAND_SEND_FRAGMENT)
 		{
-			result |= mrtp_protocol_delete_reliable_command(host, peer, event, reliableSequenceNumber, channelID,
-				outgoingCommand);
+			waitNum = MRTP_NET_TO_HOST_32(outgoingCommand->command.sendFragment.fragmentCount);
 		}
-		else if (peer->host->openQuickRetransmit) {
-
-			++outgoingCommand->fastAck;
-			waitNum = 1;
-			if ((outgoingCommand->command.header.command & MRTP_PROTOCOL_COMMAND_MASK) ==
-				MRTP_PROTOCOL_COMMAND_SEND_FRAGMENT)
-			{
-				waitNum = MRTP_NET_TO_HOST_32(outgoingCommand->command.sendFragment.fragmentCount);
-			}
 
-			// quickly retransmit, if the command are jumped quickRetransmitNum, then quickly retransmit
-			if (outgoingCommand->fastAck > peer->quickRetransmitNum + waitNum - 1) {
+		// quickly retransmit, if the command are jumped quickRetransmitNum, then quickly retransmit
+		if (outgoingCommand->fastAck > peer->quickRetransmitNum + waitNum - 1) {
 
-				outgoingCommand->fastAck = 0;
-				mrtp_list_insert(mrtp_list_begin(&peer->outgoingReliableCommands), mrtp_list_remove(&outgoingCommand->outgoingCommandList));
+			outgoingCommand->fastAck = 0;
+			mrtp_list_insert(mrtp_list_begin(&peer->outgoingReliableCommands), mrtp_list_remove(&outgoingCommand->outgoingCommandList));
+			outgoingCommand->inTransit = 0;
+			if (outgoingCommand->packet != NULL)
+				peer->reliableDataInTransit -= outgoingCommand->fragmentLength;
 
 #if defined(PRINTLOG) && defined(PACKETLOSSDEBUG)
-				fprintf(host->logFile, "[%s]: [%d] Loss!\n",
-					commandName[outgoingCommand->command.header.command & MRTP_PROTOCOL_COMMAND_MASK],
-					MRTP_NET_TO_HOST_16(outgoingCommand->command.header.sequenceNumber));
+			fprintf(peer->host->logFile, "[%s]: [%d] Loss!\n",
+				commandName[outgoingCommand->command.header.command & MRTP_PROTOCOL_COMMAND_MASK],
+				MRTP_NET_TO_HOST_16(outgoingCommand->command.header.sequenceNumber));
 #endif // PACKETLOSSDEBUG
 #ifdef PACKETLOSSDEBUG
-				printf("[%s]: [%d] Loss!\n",
-					commandName[outgoingCommand->command.header.command & MRTP_PROTOCOL_COMMAND_MASK],
-					MRTP_NET_TO_HOST_16(outgoingCommand->command.header.sequenceNumber));
+			printf("[%s]: [%d] Loss!\n",
+				commandName[outgoingCommand->command.header.command & MRTP_PROTOCOL_COMMAND_MASK],
+				MRTP_NET_TO_HOST_16(outgoingCommand->command.header.sequenceNumber));
 #endif // PACKETLOSSDEBUG
 
-
-				if (currentCommand == mrtp_list_begin(&peer->sentReliableCommands) &&
-					!mrtp_list_empty(&peer->sentReliableCommands))
-				{
-					outgoingCommand = (MRtpOutgoingCommand *)currentCommand;
-					peer->nextTimeout = outgoingCommand->sentTime + outgoingCommand->roundTripTimeout;
-				}
-
+			if (nextCommand == mrtp_list_begin(&peer->sentReliableCommands)) {
+				outgoingCommand = (MRtpOutgoingCommand *)nextCommand;
+				peer->nextTimeout = outgoingCommand->sentTime + outgoingCommand->roundTripTimeout;
 			}
 		}
 	}
+}
 
-	// if can't find command in sentReliableCommands queue
-	// then find the command in outgoingReliableCommands queue(maybe the command has been retransmited）
-	if (hasFound == FALSE) {
+// look the acknowledged command up by its sequence number, it may be on the sent queue or waiting to be resent
+// then drop every command of the channel before the next unack sequence number, the peer has received them all
+static int mrtp_protocol_remove_sent_reliable_command(MRtpHost* host, MRtpPeer * peer, MRtpEvent * event,
+	mrtp_uint16 reliableSequenceNumber, mrtp_uint16 nextUnackSequenceNumber, mrtp_uint8 channelID)
+{
+	MRtpSentCommandRing * ring = mrtp_peer_sent_command_ring(peer, channelID);
+	MRtpOutgoingCommand * outgoingCommand;
+	int result = 0;
 
-		for (currentCommand = mrtp_list_begin(&peer->outgoingReliableCommands);
-			currentCommand != mrtp_list_end(&peer->outgoingReliableCommands);
-			currentCommand = mrtp_list_next(currentCommand))
-		{
-			outgoingCommand = (MRtpOutgoingCommand *)currentCommand;
+	outgoingCommand = mrtp_peer_find_sent_command(ring, reliableSequenceNumber);
+	if (outgoingCommand != NULL) {
+		if (host->openQuickRetransmit && outgoingCommand->inTransit)
+			mrtp_protocol_count_fast_acknowledgements(peer, outgoingCommand, nextUnackSequenceNumber, channelID);
 
-			if (outgoingCommand->sendAttempts < 1) return MRTP_PROTOCOL_COMMAND_NONE;
+		mrtp_peer_remove_sent_command(ring, reliableSequenceNumber);
+		result |= mrtp_protocol_delete_reliable_command(host, peer, event, reliableSequenceNumber, channelID,
+			outgoingCommand);
+	}
 
-			if (outgoingCommand->sequenceNumber == reliableSequenceNumber &&
-				channelIDs[outgoingCommand->command.header.command & MRTP_PROTOCOL_COMMAND_MASK] == channelID)
-			{
-				wasSent = 0;
-				result |= mrtp_protocol_delete_reliable_command(host, peer, event, reliableSequenceNumber, channelID,
-					outgoingCommand, wasSent);
-				break;
-			}
-		}
+	if (channelID >= peer->channelCount)
+		return result;
 
-		if (currentCommand == mrtp_list_end(&peer->outgoingReliableCommands))
-			return result;
-	}
+	// deleting a command may reset the peer, that empties the ring
+	while (ring->count > 0 && (mrtp_uint16)(ring->first - nextUnackSequenceNumber) >= 0x8000) {
+		mrtp_uint16 sequenceNumber = ring->first;
 
+		outgoingCommand = mrtp_peer_find_sent_command(ring, sequenceNumber);
+		mrtp_peer_remove_sent_command(ring, sequenceNumber);
+		result |= mrtp_protocol_delete_reliable_command(host, peer, event, sequenceNumber, channelID,
+			outgoingCommand);
+	}
 
 	return result;
 }
 
+// measure to when the acknowledgement came in, not to when the service loop got to it
+static mrtp_uint32 mrtp_protocol_round_trip_time(MRtpHost * host, mrtp_uint32 receivedSentTime) {
+
+	if (MRTP_TIME_GREATER_EQUAL(host->receivedTime, receivedSentTime))
+		return MRTP_TIME_DIFFERENCE(host->receivedTime, receivedSentTime);
+
+	return MRTP_TIME_DIFFERENCE(host->serviceTime, receivedSentTime);
+}
+
 // handle the acknowledge
 static int mrtp_protocol_handle_acknowledge(MRtpHost * host, MRtpEvent * event,
 	MRtpPeer * peer, const MRtpProtocol * command)
@@ -1419,7 +1887,7 @@ static int mrtp_protocol_handle_acknowledge(MRtpHost * host, MRtpEvent * event,
 
 	peer->earliestTimeout = 0;
 
-	roundTripTime = MRTP_TIME_DIFFERENCE(host->serviceTime, receivedSentTime);
+	roundTripTime = mrtp_protocol_round_trip_time(host, receivedSentTime);
 	// adjust the throttle according to the roundTripTime
 	mrtp_peer_throttle(peer, roundTripTime);
 
@@ -1460,15 +1928,14 @@ static int mrtp_protocol_handle_acknowledge(MRtpHost * host, MRtpEvent * event,
 
 }
 
-static void mrtp_protocol_delete_redundancy_command(MRtpPeer * peer, MRtpOutgoingCommand* outgoingCommand,
-	mrtp_uint16 sequenceNumber) {
+static void mrtp_protocol_delete_redundancy_command(MRtpPeer * peer, MRtpOutgoingCommand* outgoingCommand) {
 
 	mrtp_uint8 channelID = channelIDs[outgoingCommand->command.header.command];
 
 	if (channelID < peer->channelCount) {
 
 		MRtpChannel * channel = &peer->channels[channelID];
-		mrtp_uint16 window = sequenceNumber / MRTP_PEER_WINDOW_SIZE;
+		mrtp_uint16 window = outgoingCommand->sequenceNumber / MRTP_PEER_WINDOW_SIZE;
 
 		if (channel->commandWindows[window] > 0) {
 			--channel->commandWindows[window];
@@ -1479,9 +1946,16 @@ static void mrtp_protocol_delete_redundancy_command(MRtpPeer * peer, MRtpOutgoin
 
 	mrtp_list_remove(&outgoingCommand->outgoingCommandList);
 
+	// a command waiting on the outgoing queue to be resent has left the data in transit already
+	if (outgoingCommand->inTransit) {
+		if (outgoingCommand->packet != NULL)
+			peer->reliableDataInTransit -= outgoingCommand->fragmentLength;
+
+		--peer->sentRedundancySize;
+	}
+
 	if (outgoingCommand->packet != NULL) {
 
-		peer->reliableDataInTransit -= outgoingCommand->fragmentLength;
 		--outgoingCommand->packet->referenceCount;
 
 		if (outgoingCommand->packet->referenceCount == 0) {
@@ -1490,119 +1964,49 @@ static void mrtp_protocol_delete_redundancy_command(MRtpPeer * peer, MRtpOutgoin
 			mrtp_packet_destroy(outgoingCommand->packet);
 		}
 	}
-	mrtp_free(outgoingCommand);
+	mrtp_object_pool_release(&peer->host->outgoingCommandPool, outgoingCommand);
 
 	if (peer->state == MRTP_PEER_STATE_DISCONNECT_LATER) {
 		if (mrtp_list_empty(&peer->outgoingReliableCommands) && mrtp_list_empty(&peer->sentReliableCommands) &&
-			mrtp_list_empty(&peer->outgoingRedundancyCommands) && mrtp_list_empty(&peer->sentRedundancyLastTimeCommands))
+			mrtp_list_empty(&peer->outgoingRedundancyCommands) && mrtp_list_empty(&peer->sentRedundancyCommands))
 			mrtp_peer_disconnect(peer);
 	}
 }
 
-// because all the retransmit commands are using the reliable
-// so the commands in the sentRedundancyCommands are ascending
-static void mrtp_protocol_remove_sent_redundancy_command(MRtpHost * host, MRtpPeer * peer,
-	mrtp_uint16 sequenceNumber, mrtp_uint32 nextUnackSequenceNumber)
+// look the acknowledged command up in the channel ring, whether it is in flight or waits to be resent
+// then drop every command before the next unack sequence number, the peer has received them all
+static void mrtp_protocol_remove_sent_redundancy_command(MRtpPeer * peer,
+	mrtp_uint16 sequenceNumber, mrtp_uint16 nextUnackSequenceNumber)
 {
-	MRtpOutgoingCommand * outgoingCommand = NULL;
-	MRtpOutgoingCommand * alreadyReceivedCommand = NULL;
-	MRtpListIterator currentCommand, nextCommand = NULL;
-	MRtpProtocolCommand commandNumber;
-	mrtp_uint32 currentSequenceNumber;
-	mrtp_uint32 waitNum;
-
-	if (mrtp_list_empty(&peer->sentRedundancyLastTimeCommands))
-		return MRTP_PROTOCOL_COMMAND_NONE;
-
-	for (currentCommand = mrtp_list_begin(&peer->sentRedundancyLastTimeCommands);
-		currentCommand != mrtp_list_end(&peer->sentRedundancyLastTimeCommands);
-		currentCommand = nextCommand)
-	{
-		outgoingCommand = (MRtpOutgoingCommand *)currentCommand;
-		nextCommand = mrtp_list_next(currentCommand);
-		currentSequenceNumber = outgoingCommand->sequenceNumber;
-
-		if (currentSequenceNumber == sequenceNumber) {
-			mrtp_protocol_delete_redundancy_command(peer, outgoingCommand, sequenceNumber);
-			--peer->sentRedundancyLastTimeSize;
-		}
-		// if peer already receive the command
-		else if (currentSequenceNumber < nextUnackSequenceNumber ||
-			(currentSequenceNumber - nextUnackSequenceNumber > MRTP_PROTOCOL_MAXIMUM_WINDOW_SIZE / 2 &&
-				currentSequenceNumber < nextUnackSequenceNumber + MRTP_PROTOCOL_MAXIMUM_WINDOW_SIZE))
-		{
-			mrtp_protocol_delete_redundancy_command(peer, outgoingCommand, sequenceNumber);
-			--peer->sentRedundancyLastTimeSize;
-		}
+	MRtpSentCommandRing * ring = &peer->channels[MRTP_PROTOCOL_REDUNDANCY_CHANNEL_NUM].sentCommands;
+	MRtpOutgoingCommand * outgoingCommand;
 
+	outgoingCommand = mrtp_peer_find_sent_command(ring, sequenceNumber);
+	if (outgoingCommand != NULL) {
+		mrtp_peer_remove_sent_command(ring, sequenceNumber);
+		mrtp_protocol_delete_redundancy_command(peer, outgoingCommand);
 	}
 
-	if (currentCommand == mrtp_list_end(&peer->sentRedundancyLastTimeCommands)) {
+	// deleting a command may disconnect the peer, that empties the ring
+	while (ring->count > 0 && (mrtp_uint16)(ring->first - nextUnackSequenceNumber) >= 0x8000) {
+		sequenceNumber = ring->first;
 
-		for (currentCommand = mrtp_list_begin(&peer->sentRedundancyThisTimeCommands);
-			currentCommand != mrtp_list_end(&peer->sentRedundancyThisTimeCommands);
-			currentCommand = nextCommand)
-		{
-			outgoingCommand = (MRtpOutgoingCommand *)currentCommand;
-			nextCommand = mrtp_list_next(currentCommand);
-			currentSequenceNumber = outgoingCommand->sequenceNumber;
-
-			if (currentSequenceNumber == sequenceNumber) {
-				mrtp_protocol_delete_redundancy_command(peer, outgoingCommand, sequenceNumber);
-				--peer->sentRedundancyThisTimeSize;
-			}
-			// if peer already receive the command
-			else if (currentSequenceNumber < nextUnackSequenceNumber ||
-				(currentSequenceNumber - nextUnackSequenceNumber > MRTP_PROTOCOL_MAXIMUM_WINDOW_SIZE / 2 &&
-					currentSequenceNumber < nextUnackSequenceNumber + MRTP_PROTOCOL_MAXIMUM_WINDOW_SIZE))
-			{
-				mrtp_protocol_delete_redundancy_command(peer, outgoingCommand, sequenceNumber);
-				--peer->sentRedundancyThisTimeSize;
-			}
-
-		}
+		outgoingCommand = mrtp_peer_find_sent_command(ring, sequenceNumber);
+		mrtp_peer_remove_sent_command(ring, sequenceNumber);
+		mrtp_protocol_delete_redundancy_command(peer, outgoingCommand);
 	}
 
-	// maybe has been retransmit
-	if (currentCommand == mrtp_list_end(&peer->sentRedundancyThisTimeCommands)) {
-
-		for (currentCommand = mrtp_list_begin(&peer->outgoingRedundancyCommands);
-			currentCommand != mrtp_list_end(&peer->outgoingRedundancyCommands);
-			currentCommand = mrtp_list_next(currentCommand))
-		{
-			outgoingCommand = (MRtpOutgoingCommand *)currentCommand;
+	if (ring->count == 0)
+		return;
 
-			if (outgoingCommand->sendAttempts < 1) continue;
-
-			if (outgoingCommand->sequenceNumber == sequenceNumber) {
-				mrtp_protocol_delete_redundancy_command(peer, outgoingCommand, sequenceNumber);
-			}
-			else if (currentSequenceNumber < nextUnackSequenceNumber ||
-				(currentSequenceNumber - nextUnackSequenceNumber > MRTP_PROTOCOL_MAXIMUM_WINDOW_SIZE / 2 &&
-					currentSequenceNumber < nextUnackSequenceNumber + MRTP_PROTOCOL_MAXIMUM_WINDOW_SIZE))
-			{
-				mrtp_protocol_delete_redundancy_command(peer, outgoingCommand, sequenceNumber);
-			}
-		}
-
-	}
-
-	if (mrtp_list_empty(&peer->sentRedundancyLastTimeCommands)) {
-		if (mrtp_list_empty(&peer->sentRedundancyThisTimeCommands)) {
-			return;
-		}
-		else {
-			outgoingCommand = (MRtpOutgoingCommand *)mrtp_list_begin(&peer->sentRedundancyThisTimeCommands);
-		}
-	}
-	else {
-		outgoingCommand = (MRtpOutgoingCommand *)mrtp_list_begin(&peer->sentRedundancyLastTimeCommands);
-	}
+	outgoingCommand = mrtp_peer_find_sent_command(ring, ring->first);
+	if (!outgoingCommand->inTransit)
+		return;
 
 	peer->nextRedundancyTimeout = outgoingCommand->sentTime + outgoingCommand->roundTripTimeout;
 
 #if defined(PRINTLOG) && defined(PACKETLOSSDEBUG)
-	fprintf(host->logFile, "peer nextRedundancyTimeout: %d host service time: %d\n",
+	fprintf(peer->host->logFile, "peer nextRedundancyTimeout: %d host service time: %d\n",
 		peer->nextRedundancyTimeout, peer->host->serviceTime);
 #endif // PACKETLOSSDEBUG
 #ifdef PACKETLOSSDEBUG
@@ -1634,7 +2038,7 @@ static int mrtp_protocol_handle_redundancy_acknowledge(MRtpHost * host, MRtpEven
 
 	peer->earliestTimeout = 0;
 
-	roundTripTime = MRTP_TIME_DIFFERENCE(host->serviceTime, receivedSentTime);
+	roundTripTime = mrtp_protocol_round_trip_time(host, receivedSentTime);
 	mrtp_peer_throttle(peer, roundTripTime);
 
 
@@ -1673,7 +2077,7 @@ static int mrtp_protocol_handle_redundancy_acknowledge(MRtpHost * host, MRtpEven
 	越界的情况先没考虑
 	*/
 	//if (receivedSequenceNumber >= nextUnackSequenceNumber - 1) {
-	mrtp_protocol_remove_sent_redundancy_command(host, peer, receivedSequenceNumber, nextUnackSequenceNumber);
+	mrtp_protocol_remove_sent_redundancy_command(peer, receivedSequenceNumber, nextUnackSequenceNumber);
 	//}
 
 	return 0;
@@ -1685,30 +2089,40 @@ static MRtpPeer * mrtp_protocol_handle_connect(MRtpHost * host, MRtpProtocolHead
 	mrtp_uint32 mtu, windowSize;
 	size_t duplicatePeers = 0;
 	MRtpPeer * currentPeer, *peer = NULL;
+	MRtpPeerSlot * peerSlot;
 	MRtpProtocol verifyCommand;
 
-	for (currentPeer = host->peers; currentPeer < &host->peers[host->peerCount]; ++currentPeer) {
+	for (peerSlot = host->peerSlots; peerSlot < &host->peerSlots[host->peerCount]; ++peerSlot) {
+		currentPeer = MRTP_HOST_PEER(host, peerSlot - host->peerSlots);
 		// find the first disconnected location in peers
-		if (currentPeer->state == MRTP_PEER_STATE_DISCONNECTED) {
+		if (peerSlot->state == MRTP_PEER_STATE_DISCONNECTED) {
 			if (peer == NULL)
 				peer = currentPeer;
 		}
-		else if (currentPeer->state != MRTP_PEER_STATE_CONNECTING &&
-			currentPeer->address.host == host->receivedAddress.host)
+		else if (peerSlot->state != MRTP_PEER_STATE_CONNECTING &&
+			peerSlot->address.host == host->receivedAddress.host)
 		{
-			if (currentPeer->address.port == host->receivedAddress.port &&
+			if (peerSlot->address.port == host->receivedAddress.port &&
 				currentPeer->connectID == command->connect.connectID)
 				return NULL;
 			++duplicatePeers;
 		}
 	}
 
-	if (peer == NULL || duplicatePeers >= host->duplicatePeers)
+	if (duplicatePeers >= host->duplicatePeers)
 		return NULL;
 
-	peer->state = MRTP_PEER_STATE_ACKNOWLEDGING_CONNECT;
+	// every materialized peer is busy, add the next chunk of the table
+	if (peer == NULL) {
+		peer = mrtp_host_grow_peers(host);
+		if (peer == NULL)
+			return NULL;
+	}
+
+	mrtp_peer_set_state(peer, MRTP_PEER_STATE_ACKNOWLEDGING_CONNECT);
 	peer->connectID = command->connect.connectID;
-	peer->address = host->receivedAddress;
+	mrtp_peer_set_address(peer, &host->receivedAddress);
+	peer->socket = host->receivedSocket;
 	peer->outgoingPeerID = MRTP_NET_TO_HOST_16(command->connect.outgoingPeerID);
 	peer->incomingBandwidth = MRTP_NET_TO_HOST_32(command->connect.incomingBandwidth);
 	peer->outgoingBandwidth = MRTP_NET_TO_HOST_32(command->connect.outgoingBandwidth);
@@ -1929,7 +2343,6 @@ static int mrtp_protocol_handle_send_fragment(MRtpHost * host, MRtpPeer * peer,
 		totalLength;
 	MRtpChannel * channel;
 	mrtp_uint16 startWindow, currentWindow;
-	MRtpListIterator currentCommand;
 	MRtpIncomingCommand * startCommand = NULL;
 
 	if (peer->state != MRTP_PEER_STATE_CONNECTED && peer->state != MRTP_PEER_STATE_DISCONNECT_LATER)
@@ -1967,33 +2380,13 @@ static int mrtp_protocol_handle_send_fragment(MRtpHost * host, MRtpPeer * peer,
 		fragmentLength > totalLength - fragmentOffset)
 		return -1;
 
-	// first try to find the start command in incomingReliableCommands queue
-	for (currentCommand = mrtp_list_previous(mrtp_list_end(&channel->incomingCommands));
-		currentCommand != mrtp_list_end(&channel->incomingCommands);
-		currentCommand = mrtp_list_previous(currentCommand))
-	{
-		MRtpIncomingCommand * incomingCommand = (MRtpIncomingCommand *)currentCommand;
-
-		if (startSequenceNumber >= channel->incomingSequenceNumber) {
-			if (incomingCommand->sequenceNumber < channel->incomingSequenceNumber)
-				continue;
-		}
-		else if (incomingCommand->sequenceNumber >= channel->incomingSequenceNumber)
-			break;
-
-		if (incomingCommand->sequenceNumber <= startSequenceNumber) {
-			if (incomingCommand->sequenceNumber < startSequenceNumber)
-				break;
-
-			if ((incomingCommand->command.header.command & MRTP_PROTOCOL_COMMAND_MASK) != MRTP_PROTOCOL_COMMAND_SEND_FRAGMENT ||
-				totalLength != incomingCommand->packet->dataLength ||
-				fragmentCount != incomingCommand->fragmentCount)
-				return -1;
-			// find the startCommand
-			startCommand = incomingCommand;
-			break;
-		}
-	}
+	// first try to find the start command among the commands waiting to be dispatched
+	startCommand = mrtp_peer_find_incoming_command(channel, startSequenceNumber);
+	if (startCommand != NULL &&
+		((startCommand->command.header.command & MRTP_PROTOCOL_COMMAND_MASK) != MRTP_PROTOCOL_COMMAND_SEND_FRAGMENT ||
+		totalLength != startCommand->packet->dataLength ||
+		fragmentCount != startCommand->fragmentCount))
+		return -1;
 
 	if (startCommand == NULL) {
 		MRtpProtocol hostCommand = *command;
@@ -2020,8 +2413,10 @@ static int mrtp_protocol_handle_send_fragment(MRtpHost * host, MRtpPeer * peer,
 			fragmentLength);
 
 		// after all fragments have received, then dispatch
-		if (startCommand->fragmentsRemaining <= 0)
+		if (startCommand->fragmentsRemaining <= 0) {
+			mrtp_peer_complete_reassembly(startCommand);
 			mrtp_peer_dispatch_incoming_reliable_commands(peer, channel);
+		}
 	}
 
 	return 0;
@@ -2059,7 +2454,6 @@ static int mrtp_protocol_handle_send_redundancy_fragment_noack(MRtpHost* host, M
 	mrtp_uint32 totalLength;
 	mrtp_uint16 startWindow, currentWindow;
 	MRtpChannel * channel;
-	MRtpListIterator currentCommand;
 	MRtpIncomingCommand * startCommand = NULL;
 
 	if (peer->state != MRTP_PEER_STATE_CONNECTED && peer->state != MRTP_PEER_STATE_DISCONNECT_LATER)
@@ -2096,33 +2490,13 @@ static int mrtp_protocol_handle_send_redundancy_fragment_noack(MRtpHost* host, M
 		return -1;
 	}
 
-	for (currentCommand = mrtp_list_previous(mrtp_list_end(&channel->incomingCommands));
-		currentCommand != mrtp_list_end(&channel->incomingCommands);
-		currentCommand = mrtp_list_previous(currentCommand))
-	{
-		MRtpIncomingCommand * incomingCommand = (MRtpIncomingCommand *)currentCommand;
-
-		if (startSequenceNumber >= channel->incomingSequenceNumber) {
-			if (incomingCommand->sequenceNumber < channel->incomingSequenceNumber)
-				continue;
-		}
-		else if (incomingCommand->sequenceNumber >= channel->incomingSequenceNumber)
-			break;
-
-		if (incomingCommand->sequenceNumber <= startSequenceNumber) {
-
-			if (incomingCommand->sequenceNumber < startSequenceNumber)
-				break;
-
-			if ((incomingCommand->command.header.command & MRTP_PROTOCOL_COMMAND_MASK) != MRTP_PROTOCOL_COMMAND_SEND_REDUNDANCY_FRAGEMENT_NO_ACK ||
-				totalLength != incomingCommand->packet->dataLength ||
-				fragmentCount != incomingCommand->fragmentCount)
-				return -1;
-
-			startCommand = incomingCommand;
-			break;
-		}
-	}
+	// first try to find the start command among the commands waiting to be dispatched
+	startCommand = mrtp_peer_find_incoming_command(channel, startSequenceNumber);
+	if (startCommand != NULL &&
+		((startCommand->command.header.command & MRTP_PROTOCOL_COMMAND_MASK) != MRTP_PROTOCOL_COMMAND_SEND_REDUNDANCY_FRAGEMENT_NO_ACK ||
+		totalLength != startCommand->packet->dataLength ||
+		fragmentCount != startCommand->fragmentCount))
+		return -1;
 
 	if (startCommand == NULL) {
 
@@ -2150,8 +2524,10 @@ static int mrtp_protocol_handle_send_redundancy_fragment_noack(MRtpHost* host, M
 			(mrtp_uint8 *)command + sizeof(MRtpProtocolSendFragment),
 			fragmentLength);
 
-		if (startCommand->fragmentsRemaining <= 0)
-			mrtp_peer_dispatch_incoming_redundancy_noack_commands(peer, channel);
+		if (startCommand->fragmentsRemaining <= 0) {
+			mrtp_peer_complete_reassembly(startCommand);
+			mrtp_peer_dispatch_incoming_redundancy_noack_commands(peer, channel, startCommand);
+		}
 	}
 
 	return 0;
@@ -2189,7 +2565,6 @@ static int mrtp_protocol_handle_send_redundancy_fragment(MRtpHost * host, MRtpPe
 	mrtp_uint32 totalLength;
 	mrtp_uint16 startWindow, currentWindow;
 	MRtpChannel * channel;
-	MRtpListIterator currentCommand;
 	MRtpIncomingCommand * startCommand = NULL;
 
 	if (peer->state != MRTP_PEER_STATE_CONNECTED && peer->state != MRTP_PEER_STATE_DISCONNECT_LATER)
@@ -2227,34 +2602,13 @@ static int mrtp_protocol_handle_send_redundancy_fragment(MRtpHost * host, MRtpPe
 		return -1;
 	}
 
-	// first try to find the start command
-	for (currentCommand = mrtp_list_previous(mrtp_list_end(&channel->incomingCommands));
-		currentCommand != mrtp_list_end(&channel->incomingCommands);
-		currentCommand = mrtp_list_previous(currentCommand))
-	{
-		MRtpIncomingCommand * incomingCommand = (MRtpIncomingCommand *)currentCommand;
-
-		if (startSequenceNumber >= channel->incomingSequenceNumber) {
-			if (incomingCommand->sequenceNumber < channel->incomingSequenceNumber)
-				continue;
-		}
-		else if (incomingCommand->sequenceNumber >= channel->incomingSequenceNumber)
-			break;
-
-		if (incomingCommand->sequenceNumber <= startSequenceNumber) {
-
-			if (incomingCommand->sequenceNumber < startSequenceNumber)
-				break;
-
-			if ((incomingCommand->command.header.command & MRTP_PROTOCOL_COMMAND_MASK) != MRTP_PROTOCOL_COMMAND_SEND_REDUNDANCY_FRAGMENT ||
-				totalLength != incomingCommand->packet->dataLength ||
-				fragmentCount != incomingCommand->fragmentCount)
-				return -1;
-
-			startCommand = incomingCommand;
-			break;
-		}
-	}
+	// first try to find the start command among the commands waiting to be dispatched
+	startCommand = mrtp_peer_find_incoming_command(channel, startSequenceNumber);
+	if (startCommand != NULL &&
+		((startCommand->command.header.command & MRTP_PROTOCOL_COMMAND_MASK) != MRTP_PROTOCOL_COMMAND_SEND_REDUNDANCY_FRAGMENT ||
+		totalLength != startCommand->packet->dataLength ||
+		fragmentCount != startCommand->fragmentCount))
+		return -1;
 
 	if (startCommand == NULL) {
 
@@ -2281,8 +2635,10 @@ static int mrtp_protocol_handle_send_redundancy_fragment(MRtpHost * host, MRtpPe
 			(mrtp_uint8 *)command + sizeof(MRtpProtocolSendFragment),
 			fragmentLength);
 
-		if (startCommand->fragmentsRemaining <= 0)
+		if (startCommand->fragmentsRemaining <= 0) {
+			mrtp_peer_complete_reassembly(startCommand);
 			mrtp_peer_dispatch_incoming_redundancy_commands(peer, channel);
+		}
 	}
 
 	return 0;
@@ -2380,23 +2736,14 @@ static int mrtp_protocol_handle_send_unsequenced_fragment(MRtpHost * host, MRtpP
 		return -1;
 	}
 
-	for (currentCommand = mrtp_list_previous(mrtp_list_end(&channel->incomingCommands));
+	// the queue only holds the partial messages, in arrival order, so look the start up by its sequence number
+	for (currentCommand = mrtp_list_begin(&channel->incomingCommands);
 		currentCommand != mrtp_list_end(&channel->incomingCommands);
-		currentCommand = mrtp_list_previous(currentCommand))
+		currentCommand = mrtp_list_next(currentCommand))
 	{
 		MRtpIncomingCommand * incomingCommand = (MRtpIncomingCommand *)currentCommand;
 
-		if (startSequenceNumber >= channel->incomingSequenceNumber) {
-			if (incomingCommand->sequenceNumber < channel->incomingSequenceNumber)
-				continue;
-		}
-		else if (incomingCommand->sequenceNumber >= channel->incomingSequenceNumber)
-			break;
-
-		if (incomingCommand->sequenceNumber <= startSequenceNumber) {
-
-			if (incomingCommand->sequenceNumber < startSequenceNumber)
-				break;
+		if (incomingCommand->sequenceNumber == startSequenceNumber) {
 
 			if ((incomingCommand->command.header.command & MRTP_PROTOCOL_COMMAND_MASK) != MRTP_PROTOCOL_COMMAND_SEND_UNSEQUENCED_FRAGMENT ||
 				totalLength != incomingCommand->packet->dataLength ||
@@ -2434,8 +2781,10 @@ static int mrtp_protocol_handle_send_unsequenced_fragment(MRtpHost * host, MRtpP
 			(mrtp_uint8 *)command + sizeof(MRtpProtocolSendFragment),
 			fragmentLength);
 
-		if (startCommand->fragmentsRemaining <= 0)
+		if (startCommand->fragmentsRemaining <= 0) {
+			mrtp_peer_complete_reassembly(startCommand);
 			mrtp_peer_dispatch_incoming_unsequenced_commands(peer, channel);
+		}
 	}
 
 	return 0;
@@ -2481,7 +2830,7 @@ static int mrtp_protocol_handle_incoming_commands(MRtpHost * host, MRtpEvent * e
 	else if (peerID >= host->peerCount)
 		return 0;
 	else {
-		peer = &host->peers[peerID];
+		peer = MRTP_HOST_PEER(host, peerID);
 
 		if (peer->state == MRTP_PEER_STATE_DISCONNECTED || peer->state == MRTP_PEER_STATE_ZOMBIE ||
 			((host->receivedAddress.host != peer->address.host || host->receivedAddress.port != peer->address.port) &&
@@ -2491,8 +2840,7 @@ static int mrtp_protocol_handle_incoming_commands(MRtpHost * host, MRtpEvent * e
 	}
 
 	if (peer != NULL) {
-		peer->address.host = host->receivedAddress.host;
-		peer->address.port = host->receivedAddress.port;
+		mrtp_peer_set_address(peer, &host->receivedAddress);
 		peer->incomingDataTotal += host->receivedDataLength;
 	}
 
@@ -2687,6 +3035,10 @@ static int mrtp_protocol_handle_incoming_commands(MRtpHost * host, MRtpEvent * e
 	}
 
 commandError:
+	// the datagram may owe acknowledgements, trigger quick retransmits or move the deadlines of the peer
+	if (peer != NULL)
+		mrtp_peer_queue_send(peer);
+
 	if (event != NULL && event->type != MRTP_EVENT_TYPE_NONE)
 		return 1;
 
@@ -2697,38 +3049,101 @@ static int mrtp_protocol_receive_incoming_commands(MRtpHost * host, MRtpEvent *
 
 	int packets;
 
-	// at most receive 256 times
-	// if there is none data to receive or there is an error, then return
+	// at most handle 256 datagrams
+	// datagrams are received in batches into the host receive ring, if handling one of them produces
+	// an event, the rest stay in the ring and are handled at the next call
 	for (packets = 0; packets < 256; ++packets) {
 
-		int receivedLength;
-		MRtpBuffer buffer;
+		size_t receivedLength, segmentSize;
 
-		buffer.data = host->packetData[0];
-		buffer.dataLength = sizeof(host->packetData[0]);
+		if (host->receiveBatchIndex >= host->receiveBatchCount) {
 
-		receivedLength = mrtp_socket_receive(host->socket, &host->receivedAddress, &buffer, 1);
+			int receivedCount = 0, i;
+			size_t socketsPolled, socketIndex;
 
-		if (receivedLength < 0) {
-			printf("socket receive error!\n");
-			return -1;
-		}
+			for (i = 0; i < MRTP_HOST_RECEIVE_BATCH_SIZE; ++i) {
+				// packets of the last batch still point into the slab, receive into a fresh one
+				if (host->receiveSlabs[i] != NULL && host->receiveSlabs[i]->referenceCount > 1) {
+					mrtp_receive_slab_release(host->receiveSlabs[i]);
 
-		if (receivedLength == 0) {
-			return 0;
+					host->receiveSlabs[i] = mrtp_receive_slab_acquire(host->receiveSlabPool);
+					if (host->receiveSlabs[i] != NULL)
+						host->receiveBuffers[i] = MRTP_RECEIVE_SLAB_DATA(host->receiveSlabs[i]);
+					else
+						host->receiveBuffers[i] = host->receiveSegmentData != NULL ?
+							&host->receiveSegmentData[i * MRTP_HOST_SEGMENT_RECEIVE_BUFFER_SIZE] : host->receiveBufferData[i];
+				}
+
+				host->receiveBatch[i].data = host->receiveBuffers[i];
+				host->receiveBatch[i].dataLength = host->receiveBufferSize;
+			}
+
+			host->receiveBatchIndex = 0;
+			host->receiveBatchCount = 0;
+			host->receiveSegmentOffset = 0;
+
+			// take turns on the host sockets, until one of them has data
+			for (socketsPolled = 0; socketsPolled < host->socketCount; ++socketsPolled) {
+
+				socketIndex = host->receiveSocketIndex;
+				host->receivedSocket = host->sockets[socketIndex];
+				host->receiveSocketIndex = (host->receiveSocketIndex + 1) % host->socketCount;
+
+				// the io ring hands out its own buffers instead of filling the host ones
+				if (host->socketRings[socketIndex] != NULL)
+					receivedCount = mrtp_socket_ring_receive_batch(host->socketRings[socketIndex], host->receiveAddresses,
+						host->receiveBatch, host->receiveLengths, host->receiveSegmentSizes, host->receiveTimes, MRTP_HOST_RECEIVE_BATCH_SIZE);
+				else
+					receivedCount = mrtp_socket_receive_batch(host->receivedSocket, host->receiveAddresses, host->receiveBatch,
+						host->receiveLengths, host->receiveSegmentSizes, host->receiveTimes, MRTP_HOST_RECEIVE_BATCH_SIZE);
+
+				if (receivedCount < 0) {
+					printf("socket receive error!\n");
+					return -1;
+				}
+
+				if (receivedCount > 0)
+					break;
+			}
+
+			if (receivedCount == 0) {
+				return 0;
+			}
+
+			host->receiveBatchCount = receivedCount;
 		}
 
+		// a coalesced buffer holds datagrams of segmentSize, only the last one may be shorter
+		receivedLength = host->receiveLengths[host->receiveBatchIndex] - host->receiveSegmentOffset;
+		segmentSize = host->receiveSegmentSizes[host->receiveBatchIndex];
+		if (segmentSize != 0 && receivedLength > segmentSize)
+			receivedLength = segmentSize;
 
 #if defined(PRINTLOG) && defined(SENDANDRECEIVE)
-		fprintf(host->logFile, "receive %d at {%d}\n", receivedLength, host->serviceTime);
+		fprintf(host->logFile, "receive %d at {%d}\n", (int)receivedLength, host->serviceTime);
 #endif
 #ifdef SENDANDRECEIVE
-		printf("receive %d at {%d}\n", receivedLength, host->serviceTime);
+		printf("receive %d at {%d}\n", (int)receivedLength, host->serviceTime);
 #endif // SENDANDRECEIVE
 
 
-		host->receivedData = host->packetData[0];
+		host->receivedAddress = host->receiveAddresses[host->receiveBatchIndex];
+		host->receivedData = (mrtp_uint8 *)host->receiveBatch[host->receiveBatchIndex].data + host->receiveSegmentOffset;
 		host->receivedDataLength = receivedLength;
+		host->receivedTime = host->receiveTimes[host->receiveBatchIndex];
+		host->receivedSlab = host->receiveSlabs[host->receiveBatchIndex] != NULL &&
+			host->receiveBatch[host->receiveBatchIndex].data == host->receiveBuffers[host->receiveBatchIndex] ?
+			host->receiveSlabs[host->receiveBatchIndex] : NULL;
+
+		host->receiveSegmentOffset += receivedLength;
+		if (host->receiveSegmentOffset >= host->receiveLengths[host->receiveBatchIndex]) {
+			++host->receiveBatchIndex;
+			host->receiveSegmentOffset = 0;
+		}
+
+		// the socket dropped a truncated datagram
+		if (receivedLength == 0)
+			continue;
 
 		host->totalReceivedData += receivedLength;
 		host->totalReceivedPackets++;
@@ -2744,7 +3159,9 @@ static int mrtp_protocol_receive_incoming_commands(MRtpHost * host, MRtpEvent *
 			break;
 		}
 	}
-	return -1;
+
+	// the rest of the datagrams are handled at the next service
+	return 0;
 }
 
 static int mrtp_protocol_dispatch_incoming_commands(MRtpHost * host, MRtpEvent * event) {
@@ -2806,9 +3223,36 @@ static int mrtp_protocol_dispatch_incoming_commands(MRtpHost * host, MRtpEvent *
 	return 0;
 }
 
+// wait on the host sockets, or on their io rings when those are on
+static int mrtp_protocol_wait_sockets(MRtpHost * host, mrtp_uint32 * condition, mrtp_uint32 timeout) {
+
+	MRtpSocket waitSockets[MRTP_HOST_MAXIMUM_SOCKETS];
+	size_t i;
+
+	if (host->socketRings[0] == NULL) {
+		if (host->socketCount > 1)
+			return mrtp_socket_wait_multiple(host->sockets, host->socketCount, condition, timeout);
+
+		return mrtp_socket_wait(host->socket, condition, timeout);
+	}
+
+	// the completions reaped while sending don't make the ring readable again
+	for (i = 0; i < host->socketCount; ++i) {
+		if (host->socketRings[i] != NULL && mrtp_socket_ring_pending(host->socketRings[i])) {
+			*condition = MRTP_SOCKET_WAIT_RECEIVE;
+			return 0;
+		}
+
+		waitSockets[i] = mrtp_host_wait_socket(host, i);
+	}
+
+	return mrtp_socket_wait_multiple(waitSockets, host->socketCount, condition, timeout);
+}
+
 int mrtp_host_service(MRtpHost * host, MRtpEvent * event, mrtp_uint32 timeout) {
 
-	mrtp_uint32 waitCondition;
+	mrtp_uint32 waitCondition, waitTimeout, timerTimeout;
+	int timerWait;
 
 	if (event != NULL) {
 		event->type = MRTP_EVENT_TYPE_NONE;
@@ -2829,6 +3273,9 @@ int mrtp_host_service(MRtpHost * host, MRtpEvent * event, mrtp_uint32 timeout) {
 	timeout += host->serviceTime;
 
 	do {
+		if (!mrtp_list_empty(&host->zeroCopySends))
+			mrtp_host_reap_zero_copy(host);
+
 		if (MRTP_TIME_DIFFERENCE(host->serviceTime, host->bandwidthThrottleEpoch) >=
 			MRTP_HOST_BANDWIDTH_THROTTLE_INTERVAL)
 			mrtp_host_bandwidth_throttle(host);
@@ -2882,21 +3329,138 @@ int mrtp_host_service(MRtpHost * host, MRtpEvent * event, mrtp_uint32 timeout) {
 				return 0;
 
 			waitCondition = MRTP_SOCKET_WAIT_RECEIVE | MRTP_SOCKET_WAIT_INTERRUPT;
+			waitTimeout = MRTP_TIME_DIFFERENCE(timeout, host->serviceTime);
+
+			// wake up for the next datagram of a paced peer
+			if (host->pacedPeers > 0)
+				waitTimeout = MRTP_TIME_LESS(host->serviceTime, host->pacingTimeout) ?
+					MRTP_MIN(waitTimeout, MRTP_TIME_DIFFERENCE(host->pacingTimeout, host->serviceTime)) : 0;
 
-			if (mrtp_socket_wait(host->socket, &waitCondition, MRTP_TIME_DIFFERENCE(timeout, host->serviceTime)) != 0)
+			// and for the next retransmit, ping or disconnect deadline
+			timerWait = mrtp_timer_wheel_next(&host->timers, &timerTimeout) &&
+				MRTP_TIME_LESS(timerTimeout, host->serviceTime + waitTimeout);
+			if (timerWait)
+				waitTimeout = MRTP_TIME_LESS(host->serviceTime, timerTimeout) ? MRTP_TIME_DIFFERENCE(timerTimeout, host->serviceTime) : 0;
+
+			if (mrtp_protocol_wait_sockets(host, &waitCondition, waitTimeout) != 0)
 				return -1;
 
 		} while (waitCondition & MRTP_SOCKET_WAIT_INTERRUPT);
 
 		host->serviceTime = mrtp_time_get();
 
-	} while (waitCondition & MRTP_SOCKET_WAIT_RECEIVE);
+	} while ((waitCondition & MRTP_SOCKET_WAIT_RECEIVE) || host->pacedPeers > 0 || timerWait);
 	return 0;
 }
 
 void mrtp_host_flush(MRtpHost * host) {
 	host->serviceTime = mrtp_time_get();
 
+	if (!mrtp_list_empty(&host->zeroCopySends))
+		mrtp_host_reap_zero_copy(host);
+
 	mrtp_protocol_send_outgoing_commands(host, NULL, 0);
 	//mrtp_protocol_send_redundancy_outgoing_commands(host, NULL, 0);
+}
+
+// whether a send pass would put anything of the peer on the wire, the reliable commands
+// are walked with the same window checks as mrtp_protocol_send_reliable_commands
+static int mrtp_protocol_peer_can_send(MRtpPeer * peer) {
+
+	MRtpOutgoingCommand * outgoingCommand;
+	MRtpListIterator currentCommand;
+	MRtpChannel * channel;
+	mrtp_uint8 channelID;
+	int windowExceeded = 0, windowWrap = 0;
+
+	if (!mrtp_list_empty(&peer->outgoingUnsequencedCommands) ||
+		!mrtp_list_empty(&peer->outgoingRedundancyNoAckCommands) ||
+		(!mrtp_list_empty(&peer->sentRedundancyCommands) && peer->sendRedundancyAfterReceive == FALSE))
+		return 1;
+
+	// the first redundancy command is sent even when it exceeds the window, unless its window wraps
+	if (!mrtp_list_empty(&peer->outgoingRedundancyCommands)) {
+		outgoingCommand = (MRtpOutgoingCommand *)mrtp_list_front(&peer->outgoingRedundancyCommands);
+		channelID = channelIDs[outgoingCommand->command.header.command & MRTP_PROTOCOL_COMMAND_MASK];
+		channel = channelID < peer->channelCount ? &peer->channels[channelID] : NULL;
+		if (channel == NULL || !mrtp_protocol_window_wraps(channel, outgoingCommand))
+			return 1;
+	}
+
+	for (currentCommand = mrtp_list_begin(&peer->outgoingReliableCommands);
+		currentCommand != mrtp_list_end(&peer->outgoingReliableCommands);
+		currentCommand = mrtp_list_next(currentCommand))
+	{
+		outgoingCommand = (MRtpOutgoingCommand *)currentCommand;
+		channelID = channelIDs[outgoingCommand->command.header.command & MRTP_PROTOCOL_COMMAND_MASK];
+		channel = channelID < peer->channelCount ? &peer->channels[channelID] : NULL;
+
+		if (channel != NULL) {
+			if (!windowWrap && mrtp_protocol_window_wraps(channel, outgoingCommand))
+				windowWrap = 1;
+			if (windowWrap)
+				continue;
+		}
+		if (outgoingCommand->packet != NULL) {
+			if (!windowExceeded && mrtp_protocol_window_exceeded(peer, outgoingCommand))
+				windowExceeded = 1;
+			if (windowExceeded)
+				continue;
+		}
+		return 1;
+	}
+	return 0;
+}
+
+// the earliest time the host has protocol work to do without receiving anything,
+// so that a caller waiting on many hosts knows when this one has to be serviced again
+mrtp_uint32 mrtp_host_next_timeout(MRtpHost * host) {
+
+	mrtp_uint32 nextTimeout = host->bandwidthThrottleEpoch + MRTP_HOST_BANDWIDTH_THROTTLE_INTERVAL;
+	MRtpPeer * currentPeer;
+	MRtpListIterator currentNode;
+	mrtp_uint32 pacingWait, timerTimeout;
+	size_t i;
+
+	// events are still waiting to be dispatched
+	if (!mrtp_list_empty(&host->dispatchQueue))
+		return host->serviceTime;
+
+	// datagrams were reaped from an io ring while sending, its descriptor won't wake the caller for them
+	for (i = 0; i < host->socketCount; ++i) {
+		if (host->socketRings[i] != NULL && mrtp_socket_ring_pending(host->socketRings[i]))
+			return host->serviceTime;
+	}
+
+	// a peer with nothing queued isn't in the send queue, its deadlines are in the timer wheel
+	for (currentNode = mrtp_list_begin(&host->sendQueue); currentNode != mrtp_list_end(&host->sendQueue); currentNode = mrtp_list_next(currentNode)) {
+		currentPeer = MRTP_SEND_QUEUE_PEER(currentNode);
+
+		if (currentPeer->state == MRTP_PEER_STATE_DISCONNECTED || currentPeer->state == MRTP_PEER_STATE_ZOMBIE)
+			continue;
+
+		// something is queued for sending, or its timer fired in a send pass cut short by an event
+		if (currentPeer->acknowledgements.count > 0 ||
+			currentPeer->redundancyAcknowledgemets.count > 0 ||
+			currentPeer->timeoutsDue)
+			return host->serviceTime;
+
+		// a peer whose queued commands are held back by its windows waits for acknowledgements,
+		// which wake the caller, or for its retransmit deadline in the timer wheel
+		if (mrtp_protocol_peer_can_send(currentPeer)) {
+			// a paced peer sends its data when its next datagram is due
+			pacingWait = host->pacing != MRTP_PACING_NONE ? mrtp_protocol_pacing_wait(host, currentPeer) : 0;
+			if (pacingWait == 0)
+				return host->serviceTime;
+
+			if (MRTP_TIME_LESS(host->serviceTime + pacingWait, nextTimeout))
+				nextTimeout = host->serviceTime + pacingWait;
+		}
+	}
+
+	// the retransmit, ping and disconnect deadlines of the peers
+	if (mrtp_timer_wheel_next(&host->timers, &timerTimeout) && MRTP_TIME_LESS(timerTimeout, nextTimeout))
+		nextTimeout = timerTimeout;
+
+	return nextTimeout;
 }
\ No newline at end of file
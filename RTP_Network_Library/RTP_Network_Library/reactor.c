@@ -0,0 +1,246 @@
+#include <string.h>
+#include "utility.h"
+#include "time.h"
+#include "mrtp.h"
+
+// a reactor waits on the sockets of many hosts at once and services only the hosts
+// whose sockets are readable or whose protocol deadlines have come up
+
+MRtpReactor * mrtp_reactor_create(void) {
+
+	MRtpReactor * reactor = (MRtpReactor *)mrtp_malloc(sizeof(MRtpReactor));
+	if (reactor == NULL)
+		return NULL;
+
+	memset(reactor, 0, sizeof(MRtpReactor));
+
+	// without epoll the reactor falls back to select over all the host sockets
+	reactor->poller = mrtp_socket_poller_create();
+	reactor->hosts = NULL;
+	reactor->hostCount = 0;
+	reactor->hostCapacity = 0;
+	reactor->nextHost = 0;
+
+	return reactor;
+}
+
+// the hosts are left alone, they are destroyed by their owner, before or after the reactor
+void mrtp_reactor_destroy(MRtpReactor * reactor) {
+
+	size_t i;
+
+	if (reactor == NULL)
+		return;
+
+	// the hosts still in it can be added to another reactor, a destroyed host has left already
+	for (i = 0; i < reactor->hostCount; ++i)
+		reactor->hosts[i].host->reactor = NULL;
+
+	if (reactor->poller != MRTP_SOCKET_NULL)
+		mrtp_socket_destroy(reactor->poller);
+
+	if (reactor->hosts != NULL)
+		mrtp_free(reactor->hosts);
+
+	mrtp_free(reactor);
+}
+
+static int mrtp_reactor_watch_host(MRtpReactor * reactor, size_t index) {
+
+	MRtpHost * host = reactor->hosts[index].host;
+	size_t i;
+
+	if (reactor->poller == MRTP_SOCKET_NULL)
+		return 0;
+
+	for (i = 0; i < host->socketCount; ++i) {
+		if (mrtp_socket_poller_add(reactor->poller, mrtp_host_wait_socket(host, i), index) < 0)
+			return -1;
+	}
+
+	return 0;
+}
+
+static void mrtp_reactor_unwatch_host(MRtpReactor * reactor, size_t index) {
+
+	MRtpHost * host = reactor->hosts[index].host;
+	size_t i;
+
+	if (reactor->poller == MRTP_SOCKET_NULL)
+		return;
+
+	for (i = 0; i < host->socketCount; ++i)
+		mrtp_socket_poller_remove(reactor->poller, mrtp_host_wait_socket(host, i));
+}
+
+int mrtp_reactor_add_host(MRtpReactor * reactor, MRtpHost * host) {
+
+	MRtpReactorHost * reactorHost;
+	size_t i;
+
+	for (i = 0; i < reactor->hostCount; ++i) {
+		if (reactor->hosts[i].host == host)
+			return 0;
+	}
+
+	// the sockets of a host are watched by one reactor at a time
+	if (host->reactor != NULL)
+		return -1;
+
+	if (reactor->hostCount >= reactor->hostCapacity) {
+		size_t hostCapacity = reactor->hostCapacity > 0 ? 2 * reactor->hostCapacity : (size_t)MRTP_REACTOR_DEFAULT_HOSTS;
+		MRtpReactorHost * hosts = (MRtpReactorHost *)mrtp_malloc(hostCapacity * sizeof(MRtpReactorHost));
+
+		if (hosts == NULL)
+			return -1;
+
+		if (reactor->hosts != NULL) {
+			memcpy(hosts, reactor->hosts, reactor->hostCount * sizeof(MRtpReactorHost));
+			mrtp_free(reactor->hosts);
+		}
+
+		reactor->hosts = hosts;
+		reactor->hostCapacity = hostCapacity;
+	}
+
+	reactorHost = &reactor->hosts[reactor->hostCount];
+	reactorHost->host = host;
+	reactorHost->ready = 1;		// service it once to learn its deadlines
+	reactorHost->nextTimeout = mrtp_time_get();
+
+	if (mrtp_reactor_watch_host(reactor, reactor->hostCount) < 0) {
+		mrtp_reactor_unwatch_host(reactor, reactor->hostCount);
+		return -1;
+	}
+
+	++reactor->hostCount;
+	host->reactor = reactor;
+
+	return 0;
+}
+
+void mrtp_reactor_remove_host(MRtpReactor * reactor, MRtpHost * host) {
+
+	size_t i;
+
+	for (i = 0; i < reactor->hostCount; ++i) {
+		if (reactor->hosts[i].host == host)
+			break;
+	}
+
+	if (i >= reactor->hostCount)
+		return;
+
+	mrtp_reactor_unwatch_host(reactor, i);
+	host->reactor = NULL;
+
+	// move the last host into the free entry, its sockets are registered under their entry index
+	--reactor->hostCount;
+	if (i < reactor->hostCount) {
+		mrtp_reactor_unwatch_host(reactor, reactor->hostCount);
+		reactor->hosts[i] = reactor->hosts[reactor->hostCount];
+		mrtp_reactor_watch_host(reactor, i);
+	}
+
+	if (reactor->nextHost >= reactor->hostCount)
+		reactor->nextHost = 0;
+}
+
+// wait for readable sockets until the earliest host deadline or the end time, and mark their hosts ready
+static int mrtp_reactor_wait(MRtpReactor * reactor, mrtp_uint32 endTime) {
+
+	size_t readyHosts[MRTP_REACTOR_MAXIMUM_READY];
+	mrtp_uint32 currentTime = mrtp_time_get();
+	mrtp_uint32 timeout = MRTP_TIME_LESS(currentTime, endTime) ? MRTP_TIME_DIFFERENCE(endTime, currentTime) : 0;
+	MRtpReactorHost * reactorHost;
+	int readyCount, i;
+	size_t j;
+
+	for (reactorHost = reactor->hosts; reactorHost < &reactor->hosts[reactor->hostCount]; ++reactorHost) {
+		if (reactorHost->ready || MRTP_TIME_LESS_EQUAL(reactorHost->nextTimeout, currentTime))
+			timeout = 0;
+		else
+			timeout = MRTP_MIN(timeout, MRTP_TIME_DIFFERENCE(reactorHost->nextTimeout, currentTime));
+	}
+
+	if (reactor->poller != MRTP_SOCKET_NULL) {
+		readyCount = mrtp_socket_poller_wait(reactor->poller, readyHosts, MRTP_REACTOR_MAXIMUM_READY, timeout);
+		if (readyCount < 0)
+			return -1;
+
+		for (i = 0; i < readyCount; ++i) {
+			if (readyHosts[i] < reactor->hostCount)
+				reactor->hosts[readyHosts[i]].ready = 1;
+		}
+	}
+	else {
+		MRtpSocketSet readSet;
+		MRtpSocket maxSocket = 0;
+
+		MRTP_SOCKETSET_EMPTY(readSet);
+
+		for (reactorHost = reactor->hosts; reactorHost < &reactor->hosts[reactor->hostCount]; ++reactorHost) {
+			for (j = 0; j < reactorHost->host->socketCount; ++j) {
+				MRTP_SOCKETSET_ADD(readSet, mrtp_host_wait_socket(reactorHost->host, j));
+				maxSocket = MRTP_MAX(maxSocket, mrtp_host_wait_socket(reactorHost->host, j));
+			}
+		}
+
+		readyCount = mrtp_socketset_select(maxSocket, &readSet, NULL, timeout);
+		if (readyCount < 0)
+			return -1;
+
+		for (reactorHost = reactor->hosts; readyCount > 0 && reactorHost < &reactor->hosts[reactor->hostCount]; ++reactorHost) {
+			for (j = 0; j < reactorHost->host->socketCount; ++j) {
+				if (MRTP_SOCKETSET_CHECK(readSet, mrtp_host_wait_socket(reactorHost->host, j)))
+					reactorHost->ready = 1;
+			}
+		}
+	}
+
+	return 0;
+}
+
+// return 1 with an event of one of the hosts, event->peer->host tells which one
+// return 0 if no event came up within timeout milliseconds
+int mrtp_reactor_service(MRtpReactor * reactor, MRtpEvent * event, mrtp_uint32 timeout) {
+
+	mrtp_uint32 endTime = mrtp_time_get() + timeout;
+	MRtpReactorHost * reactorHost;
+	size_t serviced, index;
+
+	do {
+		if (mrtp_reactor_wait(reactor, endTime) < 0)
+			return -1;
+
+		// start after the host that returned the last event, so that a busy host can't starve the others
+		for (serviced = 0; serviced < reactor->hostCount; ++serviced) {
+
+			index = (reactor->nextHost + serviced) % reactor->hostCount;
+			reactorHost = &reactor->hosts[index];
+
+			if (!reactorHost->ready && MRTP_TIME_LESS(mrtp_time_get(), reactorHost->nextTimeout))
+				continue;
+
+			switch (mrtp_host_service(reactorHost->host, event, 0)) {
+			case 1:
+				// the host may have more events, keep it ready
+				reactorHost->ready = 1;
+				reactor->nextHost = (index + 1) % reactor->hostCount;
+				return 1;
+
+			case -1:
+				return -1;
+
+			default:
+				break;
+			}
+
+			reactorHost->ready = 0;
+			reactorHost->nextTimeout = mrtp_host_next_timeout(reactorHost->host);
+		}
+
+	} while (MRTP_TIME_LESS(mrtp_time_get(), endTime));
+
+	return 0;
+}
@@ -0,0 +1,662 @@
+
+#ifndef _WIN32
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE 1
+#endif
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <string.h>
+#include <errno.h>
+
+#define MRTP_BUILDING_LIB 1
+#include "mrtp.h"
+
+#ifdef __linux__
+#ifndef HAS_IO_URING
+#define HAS_IO_URING 1
+#endif
+#endif
+
+#if defined(HAS_IO_URING) && defined(__has_include)
+#if !__has_include(<linux/io_uring.h>)
+#undef HAS_IO_URING
+#endif
+#endif
+
+#ifdef HAS_IO_URING
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+// the multishot recvmsg came with the linux 6.0 headers, after the provided buffer rings it receives into,
+// older headers lack them and the backend is left out, mrtp_socket_ring_create returns NULL then
+#if !defined(IORING_RECV_MULTISHOT) || !defined(IORING_CQE_F_BUFFER) || !defined(IORING_CQE_F_MORE) || \
+	!defined(__NR_io_uring_setup) || !defined(__NR_io_uring_enter) || !defined(__NR_io_uring_register)
+#undef HAS_IO_URING
+#endif
+#endif
+
+#ifdef HAS_IO_URING
+#include <sys/mman.h>
+#include <netinet/udp.h>
+#include <time.h>
+
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif
+
+#ifndef SCM_TXTIME
+#define SCM_TXTIME 61
+#endif
+
+enum
+{
+	MRTP_SOCKET_RING_RECEIVE = 0,           // user data of the multishot receive
+	MRTP_SOCKET_RING_CANCEL = 1,
+	MRTP_SOCKET_RING_SEND = 2,              // user data of the sends is this plus the message index
+	MRTP_SOCKET_RING_ENTRIES = 2 * MRTP_HOST_SEND_BATCH_SIZE,
+	MRTP_SOCKET_RING_BUFFER_GROUP = 0
+};
+
+typedef struct _MRtpSocketRingCompletion {
+	__u64 userData;
+	int result;
+	unsigned flags;
+} MRtpSocketRingCompletion;
+
+// an io_uring on one socket: a multishot recvmsg fills buffers the kernel picks from a provided
+// buffer ring, sends are submitted as one linked chain per batch
+struct _MRtpSocketRing {
+	MRtpSocket socket;
+	int ringFd;
+	void * sqRing;
+	size_t sqRingSize;
+	void * cqRing;
+	size_t cqRingSize;
+	struct io_uring_sqe * sqes;
+	size_t sqesSize;
+	unsigned * sqHead;
+	unsigned * sqTail;
+	unsigned * sqArray;
+	unsigned sqMask;
+	unsigned * cqHead;
+	unsigned * cqTail;
+	unsigned cqMask;
+	struct io_uring_cqe * cqes;
+	struct io_uring_buf_ring * bufferRing;
+	size_t bufferRingSize;
+	mrtp_uint8 * bufferData;
+	size_t bufferSize;                  // size of one provided buffer, the recvmsg header, address and control data come first
+	unsigned bufferCount;
+	mrtp_uint16 bufferTail;
+	mrtp_uint16 heldBuffers[MRTP_HOST_RECEIVE_BATCH_SIZE];	// buffers handed out by the last receive, they go back to the kernel at the next one
+	size_t heldCount;
+	struct msghdr receiveMsgHdr;        // only the name and control lengths are used by the multishot receive
+	int receiveArmed;
+	MRtpSocketRingCompletion * pending; // receive completions reaped while waiting for sends
+	size_t pendingHead;
+	size_t pendingCount;
+};
+
+static int mrtp_socket_ring_enter(int ringFd, unsigned toSubmit, unsigned minComplete, unsigned flags) {
+	return (int)syscall(__NR_io_uring_enter, ringFd, toSubmit, minComplete, flags, NULL, 0);
+}
+
+static struct io_uring_sqe * mrtp_socket_ring_get_sqe(MRtpSocketRing * ring) {
+
+	unsigned tail = *ring->sqTail;
+	struct io_uring_sqe * sqe;
+
+	if (tail - __atomic_load_n(ring->sqHead, __ATOMIC_ACQUIRE) > ring->sqMask)
+		return NULL;
+
+	sqe = &ring->sqes[tail & ring->sqMask];
+	memset(sqe, 0, sizeof(struct io_uring_sqe));
+
+	ring->sqArray[tail & ring->sqMask] = tail & ring->sqMask;
+	__atomic_store_n(ring->sqTail, tail + 1, __ATOMIC_RELEASE);
+
+	return sqe;
+}
+
+static void mrtp_socket_ring_provide_buffer(MRtpSocketRing * ring, mrtp_uint16 bufferID) {
+
+	struct io_uring_buf * buffer = &ring->bufferRing->bufs[ring->bufferTail & (ring->bufferCount - 1)];
+
+	buffer->addr = (__u64)(size_t)&ring->bufferData[bufferID * ring->bufferSize];
+	buffer->len = (mrtp_uint32)ring->bufferSize;
+	buffer->bid = bufferID;
+
+	++ring->bufferTail;
+}
+
+static void mrtp_socket_ring_publish_buffers(MRtpSocketRing * ring) {
+	__atomic_store_n(&ring->bufferRing->tail, ring->bufferTail, __ATOMIC_RELEASE);
+}
+
+static int mrtp_socket_ring_arm_receive(MRtpSocketRing * ring) {
+
+	struct io_uring_sqe * sqe = mrtp_socket_ring_get_sqe(ring);
+	if (sqe == NULL)
+		return -1;
+
+	sqe->opcode = IORING_OP_RECVMSG;
+	sqe->fd = ring->socket;
+	sqe->addr = (__u64)(size_t)&ring->receiveMsgHdr;
+	sqe->len = 1;
+	sqe->ioprio = IORING_RECV_MULTISHOT;
+	sqe->flags = IOSQE_BUFFER_SELECT;
+	sqe->buf_group = MRTP_SOCKET_RING_BUFFER_GROUP;
+	sqe->user_data = MRTP_SOCKET_RING_RECEIVE;
+
+	if (mrtp_socket_ring_enter(ring->ringFd, 1, 0, 0) < 0)
+		return -1;
+
+	ring->receiveArmed = 1;
+
+	return 0;
+}
+
+static int mrtp_socket_ring_reap_completion(MRtpSocketRing * ring, MRtpSocketRingCompletion * completion) {
+
+	unsigned head = *ring->cqHead;
+
+	if (head == __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE))
+		return 0;
+
+	completion->userData = ring->cqes[head & ring->cqMask].user_data;
+	completion->result = ring->cqes[head & ring->cqMask].res;
+	completion->flags = ring->cqes[head & ring->cqMask].flags;
+
+	__atomic_store_n(ring->cqHead, head + 1, __ATOMIC_RELEASE);
+
+	return 1;
+}
+
+// take the next completion, the ones stashed while waiting for sends come first
+static int mrtp_socket_ring_next_completion(MRtpSocketRing * ring, MRtpSocketRingCompletion * completion) {
+
+	if (ring->pendingCount > 0) {
+		*completion = ring->pending[ring->pendingHead];
+		ring->pendingHead = (ring->pendingHead + 1) % (ring->bufferCount + 1);
+		--ring->pendingCount;
+
+		return 1;
+	}
+
+	return mrtp_socket_ring_reap_completion(ring, completion);
+}
+
+static void mrtp_socket_ring_stash_completion(MRtpSocketRing * ring, const MRtpSocketRingCompletion * completion) {
+
+	// every stashed receive holds a buffer, so there are never more of them than buffers
+	if (ring->pendingCount > ring->bufferCount)
+		return;
+
+	ring->pending[(ring->pendingHead + ring->pendingCount) % (ring->bufferCount + 1)] = *completion;
+	++ring->pendingCount;
+}
+#endif
+
+// create an io_uring for socket with bufferCount receive buffers of bufferSize bytes
+// return NULL if io_uring or the multishot receive is not available, the plain socket calls are used then
+MRtpSocketRing * mrtp_socket_ring_create(MRtpSocket socket, size_t bufferCount, size_t bufferSize) {
+
+#ifdef HAS_IO_URING
+	struct io_uring_params params;
+	struct io_uring_buf_reg bufferReg;
+	MRtpSocketRingCompletion completion;
+	MRtpSocketRing * ring;
+	unsigned i;
+
+	// the provided buffer ring size must be a power of 2
+	if (bufferCount == 0 || (bufferCount & (bufferCount - 1)) != 0 || bufferCount > 32768)
+		return NULL;
+
+	ring = (MRtpSocketRing *)mrtp_malloc(sizeof(MRtpSocketRing));
+	if (ring == NULL)
+		return NULL;
+
+	memset(ring, 0, sizeof(MRtpSocketRing));
+	ring->socket = socket;
+	ring->sqRing = MAP_FAILED;
+	ring->cqRing = MAP_FAILED;
+	ring->sqes = (struct io_uring_sqe *)MAP_FAILED;
+	ring->bufferRing = (struct io_uring_buf_ring *)MAP_FAILED;
+	ring->bufferCount = (unsigned)bufferCount;
+	ring->bufferSize = sizeof(struct io_uring_recvmsg_out) + sizeof(struct sockaddr_in) + CMSG_SPACE(sizeof(int)) + CMSG_SPACE(sizeof(struct timespec)) + bufferSize;
+
+	memset(&params, 0, sizeof(struct io_uring_params));
+	params.flags = IORING_SETUP_CQSIZE;
+	params.cq_entries = 2 * (unsigned)bufferCount;
+
+	ring->ringFd = (int)syscall(__NR_io_uring_setup, MRTP_SOCKET_RING_ENTRIES, &params);
+	if (ring->ringFd < 0) {
+		mrtp_free(ring);
+		return NULL;
+	}
+
+	ring->sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+	ring->cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+
+	if (params.features & IORING_FEAT_SINGLE_MMAP) {
+		if (ring->cqRingSize > ring->sqRingSize)
+			ring->sqRingSize = ring->cqRingSize;
+		ring->cqRingSize = ring->sqRingSize;
+	}
+
+	ring->sqRing = mmap(NULL, ring->sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->ringFd, IORING_OFF_SQ_RING);
+	if (ring->sqRing == MAP_FAILED)
+		goto ringError;
+
+	if (params.features & IORING_FEAT_SINGLE_MMAP)
+		ring->cqRing = ring->sqRing;
+	else {
+		ring->cqRing = mmap(NULL, ring->cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->ringFd, IORING_OFF_CQ_RING);
+		if (ring->cqRing == MAP_FAILED)
+			goto ringError;
+	}
+
+	ring->sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+	ring->sqes = (struct io_uring_sqe *)mmap(NULL, ring->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->ringFd, IORING_OFF_SQES);
+	if (ring->sqes == MAP_FAILED)
+		goto ringError;
+
+	ring->sqHead = (unsigned *)((mrtp_uint8 *)ring->sqRing + params.sq_off.head);
+	ring->sqTail = (unsigned *)((mrtp_uint8 *)ring->sqRing + params.sq_off.tail);
+	ring->sqArray = (unsigned *)((mrtp_uint8 *)ring->sqRing + params.sq_off.array);
+	ring->sqMask = *(unsigned *)((mrtp_uint8 *)ring->sqRing + params.sq_off.ring_mask);
+	ring->cqHead = (unsigned *)((mrtp_uint8 *)ring->cqRing + params.cq_off.head);
+	ring->cqTail = (unsigned *)((mrtp_uint8 *)ring->cqRing + params.cq_off.tail);
+	ring->cqMask = *(unsigned *)((mrtp_uint8 *)ring->cqRing + params.cq_off.ring_mask);
+	ring->cqes = (struct io_uring_cqe *)((mrtp_uint8 *)ring->cqRing + params.cq_off.cqes);
+
+	ring->pending = (MRtpSocketRingCompletion *)mrtp_malloc((bufferCount + 1) * sizeof(MRtpSocketRingCompletion));
+	ring->bufferData = (mrtp_uint8 *)mrtp_malloc(bufferCount * ring->bufferSize);
+	if (ring->pending == NULL || ring->bufferData == NULL)
+		goto ringError;
+
+	// the buffer ring is shared with the kernel and has to be page aligned
+	ring->bufferRingSize = bufferCount * sizeof(struct io_uring_buf);
+	ring->bufferRing = (struct io_uring_buf_ring *)mmap(NULL, ring->bufferRingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (ring->bufferRing == MAP_FAILED)
+		goto ringError;
+
+	memset(&bufferReg, 0, sizeof(struct io_uring_buf_reg));
+	bufferReg.ring_addr = (__u64)(size_t)ring->bufferRing;
+	bufferReg.ring_entries = (mrtp_uint32)bufferCount;
+	bufferReg.bgid = MRTP_SOCKET_RING_BUFFER_GROUP;
+
+	if (syscall(__NR_io_uring_register, ring->ringFd, IORING_REGISTER_PBUF_RING, &bufferReg, 1) < 0)
+		goto ringError;
+
+	for (i = 0; i < ring->bufferCount; ++i)
+		mrtp_socket_ring_provide_buffer(ring, (mrtp_uint16)i);
+	mrtp_socket_ring_publish_buffers(ring);
+
+	ring->receiveMsgHdr.msg_namelen = sizeof(struct sockaddr_in);
+	ring->receiveMsgHdr.msg_controllen = CMSG_SPACE(sizeof(int)) + CMSG_SPACE(sizeof(struct timespec));
+
+	if (mrtp_socket_ring_arm_receive(ring) < 0)
+		goto ringError;
+
+	// kernels without the multishot recvmsg fail the request right away
+	if (mrtp_socket_ring_next_completion(ring, &completion) > 0) {
+		if (!(completion.flags & IORING_CQE_F_MORE))
+			goto ringError;
+
+		mrtp_socket_ring_stash_completion(ring, &completion);
+	}
+
+	return ring;
+
+ringError:
+	mrtp_socket_ring_destroy(ring);
+
+	return NULL;
+#else
+	return NULL;
+#endif
+}
+
+void mrtp_socket_ring_destroy(MRtpSocketRing * ring) {
+
+#ifdef HAS_IO_URING
+	if (ring == NULL)
+		return;
+
+	// the ring is torn down asynchronously, stop the receive first so nothing lands in the freed buffers
+	if (ring->receiveArmed) {
+		MRtpSocketRingCompletion completion;
+		struct io_uring_sqe * sqe = mrtp_socket_ring_get_sqe(ring);
+
+		if (sqe != NULL) {
+			sqe->opcode = IORING_OP_ASYNC_CANCEL;
+			sqe->addr = MRTP_SOCKET_RING_RECEIVE;
+			sqe->user_data = MRTP_SOCKET_RING_CANCEL;
+
+			mrtp_socket_ring_enter(ring->ringFd, 1, 0, 0);
+
+			while (ring->receiveArmed) {
+				if (mrtp_socket_ring_next_completion(ring, &completion) == 0) {
+					if (mrtp_socket_ring_enter(ring->ringFd, 0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR)
+						break;
+
+					continue;
+				}
+
+				if (completion.userData == MRTP_SOCKET_RING_RECEIVE && !(completion.flags & IORING_CQE_F_MORE))
+					ring->receiveArmed = 0;
+			}
+		}
+	}
+
+	close(ring->ringFd);
+
+	if (ring->sqes != MAP_FAILED)
+		munmap(ring->sqes, ring->sqesSize);
+
+	if (ring->cqRing != MAP_FAILED && ring->cqRing != ring->sqRing)
+		munmap(ring->cqRing, ring->cqRingSize);
+
+	if (ring->sqRing != MAP_FAILED)
+		munmap(ring->sqRing, ring->sqRingSize);
+
+	if (ring->bufferRing != MAP_FAILED)
+		munmap(ring->bufferRing, ring->bufferRingSize);
+
+	if (ring->bufferData != NULL)
+		mrtp_free(ring->bufferData);
+
+	if (ring->pending != NULL)
+		mrtp_free(ring->pending);
+
+	mrtp_free(ring);
+#endif
+}
+
+// the descriptor to wait on for received datagrams, the socket itself no longer turns readable
+MRtpSocket mrtp_socket_ring_wait_socket(MRtpSocketRing * ring) {
+
+#ifdef HAS_IO_URING
+	return ring->ringFd;
+#else
+	return MRTP_SOCKET_NULL;
+#endif
+}
+
+// return 1 if completions are waiting to be received, waiting on the ring descriptor would miss the stashed ones
+int mrtp_socket_ring_pending(MRtpSocketRing * ring) {
+
+#ifdef HAS_IO_URING
+	return ring->pendingCount > 0 || *ring->cqHead != __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE);
+#else
+	return 0;
+#endif
+}
+
+// submit the datagrams as one linked chain and wait for it with a single system call
+// return the number of datagrams sent, which is less than messageCount if the socket would block
+// return -2 if the first datagram is segmented and the kernel or the device can't segment it
+int mrtp_socket_ring_send_batch(MRtpSocketRing * ring, MRtpSocketMessage * messages, size_t messageCount) {
+
+#ifdef HAS_IO_URING
+	struct msghdr msgHdrs[MRTP_HOST_SEND_BATCH_SIZE];
+	struct sockaddr_in sins[MRTP_HOST_SEND_BATCH_SIZE];
+	union {
+		char buf[CMSG_SPACE(sizeof(mrtp_uint16)) + CMSG_SPACE(sizeof(unsigned long long))];
+		struct cmsghdr align;
+	} controls[MRTP_HOST_SEND_BATCH_SIZE];
+	int results[MRTP_HOST_SEND_BATCH_SIZE];
+	MRtpSocketRingCompletion completion;
+	struct io_uring_sqe * sqe;
+	size_t completed = 0, i;
+	int sentCount;
+
+	if (messageCount > MRTP_HOST_SEND_BATCH_SIZE)
+		messageCount = MRTP_HOST_SEND_BATCH_SIZE;
+
+	if (messageCount == 0)
+		return 0;
+
+	memset(msgHdrs, 0, messageCount * sizeof(struct msghdr));
+	memset(sins, 0, messageCount * sizeof(struct sockaddr_in));
+
+	for (i = 0; i < messageCount; ++i) {
+		sins[i].sin_family = AF_INET;
+		sins[i].sin_port = MRTP_HOST_TO_NET_16(messages[i].address.port);
+		sins[i].sin_addr.s_addr = messages[i].address.host;
+
+		msgHdrs[i].msg_name = &sins[i];
+		msgHdrs[i].msg_namelen = sizeof(struct sockaddr_in);
+		msgHdrs[i].msg_iov = (struct iovec *) messages[i].buffers;
+		msgHdrs[i].msg_iovlen = messages[i].bufferCount;
+
+		if (messages[i].segmentSize != 0 || messages[i].sendTime != 0) {
+			struct cmsghdr * cmsg;
+			size_t controlLength = 0;
+
+			memset(&controls[i], 0, sizeof(controls[i]));
+			msgHdrs[i].msg_control = controls[i].buf;
+			msgHdrs[i].msg_controllen = sizeof(controls[i].buf);
+
+			cmsg = CMSG_FIRSTHDR(&msgHdrs[i]);
+
+			if (messages[i].segmentSize != 0) {
+				cmsg->cmsg_level = IPPROTO_UDP;
+				cmsg->cmsg_type = UDP_SEGMENT;
+				cmsg->cmsg_len = CMSG_LEN(sizeof(mrtp_uint16));
+				*(mrtp_uint16 *)CMSG_DATA(cmsg) = (mrtp_uint16)messages[i].segmentSize;
+
+				controlLength += CMSG_SPACE(sizeof(mrtp_uint16));
+				cmsg = CMSG_NXTHDR(&msgHdrs[i], cmsg);
+			}
+
+			// a kernel paced datagram, its microsecond send time is widened to the nanoseconds of the monotonic clock
+			if (messages[i].sendTime != 0) {
+				struct timespec timeSpec;
+				unsigned long long currentTime, txTime;
+
+				clock_gettime(CLOCK_MONOTONIC, &timeSpec);
+				currentTime = (unsigned long long)timeSpec.tv_sec * 1000000000 + timeSpec.tv_nsec;
+				txTime = currentTime + (long long)(int)(messages[i].sendTime - (mrtp_uint32)(currentTime / 1000)) * 1000;
+
+				cmsg->cmsg_level = SOL_SOCKET;
+				cmsg->cmsg_type = SCM_TXTIME;
+				cmsg->cmsg_len = CMSG_LEN(sizeof(unsigned long long));
+				memcpy(CMSG_DATA(cmsg), &txTime, sizeof(unsigned long long));
+
+				controlLength += CMSG_SPACE(sizeof(unsigned long long));
+			}
+
+			msgHdrs[i].msg_controllen = controlLength;
+		}
+
+		sqe = mrtp_socket_ring_get_sqe(ring);
+		if (sqe == NULL)
+			return -1;
+
+		sqe->opcode = IORING_OP_SENDMSG;
+		sqe->fd = ring->socket;
+		sqe->addr = (__u64)(size_t)&msgHdrs[i];
+		sqe->len = 1;
+		sqe->msg_flags = MSG_NOSIGNAL | MSG_DONTWAIT;
+		sqe->user_data = MRTP_SOCKET_RING_SEND + i;
+
+		// a failed send cancels the ones after it, so the datagrams still go out in order
+		if (i + 1 < messageCount)
+			sqe->flags = IOSQE_IO_LINK;
+
+		results[i] = 0;
+	}
+
+	if (mrtp_socket_ring_enter(ring->ringFd, (unsigned)messageCount, (unsigned)messageCount, IORING_ENTER_GETEVENTS) < 0 &&
+		errno != EINTR)
+		return -1;
+
+	while (completed < messageCount) {
+
+		if (mrtp_socket_ring_reap_completion(ring, &completion) == 0) {
+			if (mrtp_socket_ring_enter(ring->ringFd, 0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR)
+				return -1;
+
+			continue;
+		}
+
+		if (completion.userData < MRTP_SOCKET_RING_SEND) {
+			if (completion.userData == MRTP_SOCKET_RING_RECEIVE)
+				mrtp_socket_ring_stash_completion(ring, &completion);
+
+			continue;
+		}
+
+		results[completion.userData - MRTP_SOCKET_RING_SEND] = completion.result;
+		++completed;
+	}
+
+	for (sentCount = 0; sentCount < (int)messageCount; ++sentCount) {
+		if (results[sentCount] < 0) {
+			if (results[sentCount] == -EWOULDBLOCK || results[sentCount] == -ECANCELED)
+				break;
+
+			if (sentCount > 0)
+				return sentCount;
+
+			if (messages[0].segmentSize != 0 &&
+				(results[0] == -EIO || results[0] == -EINVAL || results[0] == -EOPNOTSUPP))
+				return -2;
+
+			return -1;
+		}
+
+		messages[sentCount].sentLength = results[sentCount];
+	}
+
+	return sentCount;
+#else
+	return -1;
+#endif
+}
+
+// hand out up to bufferCount received datagrams, their data points into the ring buffers
+// and stays valid until the next receive on the ring
+int mrtp_socket_ring_receive_batch(MRtpSocketRing * ring, MRtpAddress * addresses, MRtpBuffer * buffers,
+	size_t * receivedLengths, size_t * segmentSizes, mrtp_uint32 * receivedTimes, size_t bufferCount) {
+
+#ifdef HAS_IO_URING
+	MRtpSocketRingCompletion completion;
+	mrtp_uint32 currentTime = mrtp_time_get();
+	size_t recvCount = 0;
+	int result = 0;
+
+	if (bufferCount > MRTP_HOST_RECEIVE_BATCH_SIZE)
+		bufferCount = MRTP_HOST_RECEIVE_BATCH_SIZE;
+
+	// give the buffers of the last batch back to the kernel
+	if (ring->heldCount > 0) {
+		while (ring->heldCount > 0)
+			mrtp_socket_ring_provide_buffer(ring, ring->heldBuffers[--ring->heldCount]);
+		mrtp_socket_ring_publish_buffers(ring);
+	}
+
+	while (recvCount < bufferCount && mrtp_socket_ring_next_completion(ring, &completion) > 0) {
+
+		struct io_uring_recvmsg_out * recvOut;
+		struct sockaddr_in * sin;
+		struct msghdr controlHdr;
+		mrtp_uint8 * bufferData;
+		mrtp_uint16 bufferID;
+
+		if (completion.userData != MRTP_SOCKET_RING_RECEIVE)
+			continue;
+
+		if (!(completion.flags & IORING_CQE_F_MORE))
+			ring->receiveArmed = 0;
+
+		// the receive ran out of buffers or was interrupted, it is armed again below
+		if (!(completion.flags & IORING_CQE_F_BUFFER)) {
+			if (completion.result < 0 && completion.result != -ENOBUFS && completion.result != -EINTR && completion.result != -EAGAIN)
+				result = -1;
+
+			continue;
+		}
+
+		bufferID = (mrtp_uint16)(completion.flags >> IORING_CQE_BUFFER_SHIFT);
+		bufferData = &ring->bufferData[bufferID * ring->bufferSize];
+
+		// a datagram longer than the buffer, or a short completion, is dropped and its buffer goes back at once
+		recvOut = (struct io_uring_recvmsg_out *)bufferData;
+		if (completion.result < (int)(sizeof(struct io_uring_recvmsg_out) + ring->receiveMsgHdr.msg_namelen + ring->receiveMsgHdr.msg_controllen) ||
+			(recvOut->flags & MSG_TRUNC))
+		{
+			mrtp_socket_ring_provide_buffer(ring, bufferID);
+			mrtp_socket_ring_publish_buffers(ring);
+			continue;
+		}
+
+		ring->heldBuffers[ring->heldCount++] = bufferID;
+
+		sin = (struct sockaddr_in *)(recvOut + 1);
+
+		buffers[recvCount].data = (mrtp_uint8 *)sin + ring->receiveMsgHdr.msg_namelen + ring->receiveMsgHdr.msg_controllen;
+		buffers[recvCount].dataLength = recvOut->payloadlen;
+		receivedLengths[recvCount] = recvOut->payloadlen;
+
+		if (segmentSizes != NULL || receivedTimes != NULL) {
+			struct cmsghdr * cmsg;
+
+			if (segmentSizes != NULL)
+				segmentSizes[recvCount] = 0;
+
+			if (receivedTimes != NULL)
+				receivedTimes[recvCount] = currentTime;
+
+			memset(&controlHdr, 0, sizeof(struct msghdr));
+			controlHdr.msg_control = (mrtp_uint8 *)sin + ring->receiveMsgHdr.msg_namelen;
+			controlHdr.msg_controllen = recvOut->controllen;
+
+			for (cmsg = CMSG_FIRSTHDR(&controlHdr); cmsg != NULL; cmsg = CMSG_NXTHDR(&controlHdr, cmsg)) {
+				if (segmentSizes != NULL && cmsg->cmsg_level == IPPROTO_UDP && cmsg->cmsg_type == UDP_GRO) {
+					int segmentSize;
+
+					memcpy(&segmentSize, CMSG_DATA(cmsg), sizeof(int));
+					if (segmentSize > 0 && (size_t)segmentSize < receivedLengths[recvCount])
+						segmentSizes[recvCount] = segmentSize;
+				}
+
+				if (receivedTimes != NULL && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SO_TIMESTAMPNS) {
+					struct timespec timeSpec;
+
+					memcpy(&timeSpec, CMSG_DATA(cmsg), sizeof(struct timespec));
+					receivedTimes[recvCount] = mrtp_time_from_system((mrtp_uint32)(timeSpec.tv_sec * 1000 + timeSpec.tv_nsec / 1000000));
+				}
+			}
+		}
+
+		if (addresses != NULL) {
+			addresses[recvCount].host = (mrtp_uint32)sin->sin_addr.s_addr;
+			addresses[recvCount].port = MRTP_NET_TO_HOST_16(sin->sin_port);
+		}
+
+		++recvCount;
+	}
+
+	if (!ring->receiveArmed && mrtp_socket_ring_arm_receive(ring) < 0)
+		result = -1;
+
+	if (result < 0 && recvCount == 0)
+		return -1;
+
+	return (int)recvCount;
+#else
+	return -1;
+#endif
+}
+
+#endif
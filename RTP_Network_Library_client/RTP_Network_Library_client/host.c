@@ -1,46 +1,99 @@
 ﻿#include <string.h>
+#include "utility.h"
 #include "mrtp.h"
 
 MRtpHost * mrtp_host_create(const MRtpAddress * address, size_t peerCount,
 	mrtp_uint32 incomingBandwidth, mrtp_uint32 outgoingBandwidth) {
 
+	return mrtp_host_create_sharded(address, peerCount, 1, incomingBandwidth, outgoingBandwidth);
+}
+
+static void mrtp_host_destroy_sockets(MRtpHost * host) {
+
+	size_t i;
+
+	for (i = 0; i < host->socketCount; ++i) {
+		if (host->socketRings[i] != NULL) {
+			mrtp_socket_ring_destroy(host->socketRings[i]);
+			host->socketRings[i] = NULL;
+		}
+
+		mrtp_socket_destroy(host->sockets[i]);
+	}
+
+	host->socketCount = 0;
+}
+
+// open socketCount sockets bound to the same address with SO_REUSEPORT, so that the kernel spreads
+// the incoming datagrams over them by source address, every peer sticks to the socket its CONNECT came in on
+MRtpHost * mrtp_host_create_sharded(const MRtpAddress * address, size_t peerCount, size_t socketCount,
+	mrtp_uint32 incomingBandwidth, mrtp_uint32 outgoingBandwidth) {
+
 	MRtpHost * host;
-	MRtpPeer * currentPeer;
+	MRtpSocket socket;
 
 	if (peerCount > MRTP_PROTOCOL_MAXIMUM_PEER_ID)
 		return NULL;
 
+	if (socketCount < 1 || socketCount > MRTP_HOST_MAXIMUM_SOCKETS || (socketCount > 1 && address == NULL))
+		return NULL;
+
 	host = (MRtpHost *)mrtp_malloc(sizeof(MRtpHost));
 	if (host == NULL)
 		return NULL;
 	memset(host, 0, sizeof(MRtpHost));
 
-	host->peers = (MRtpPeer *)mrtp_malloc(peerCount * sizeof(MRtpPeer));
-	if (host->peers == NULL) {
+	// the peers are added as they connect, the slots of the peers not added yet are left untouched
+	host->peerChunks = (MRtpPeer **)mrtp_malloc((peerCount / MRTP_HOST_PEER_CHUNK + 1) * sizeof(MRtpPeer *));
+	if (host->peerChunks == NULL) {
 		mrtp_free(host);
 
 		return NULL;
 	}
-	memset(host->peers, 0, peerCount * sizeof(MRtpPeer));
+	memset(host->peerChunks, 0, (peerCount / MRTP_HOST_PEER_CHUNK + 1) * sizeof(MRtpPeer *));
 
-	host->socket = mrtp_socket_create(MRTP_SOCKET_TYPE_DATAGRAM);
-	if (host->socket == MRTP_SOCKET_NULL || (address != NULL && mrtp_socket_bind(host->socket, address) < 0)) {
-		if (host->socket != MRTP_SOCKET_NULL)
-			mrtp_socket_destroy(host->socket);
-
-		mrtp_free(host->peers);
+	host->peerSlots = (MRtpPeerSlot *)mrtp_malloc(peerCount * sizeof(MRtpPeerSlot));
+	if (host->peerSlots == NULL) {
+		mrtp_free(host->peerChunks);
 		mrtp_free(host);
 
 		return NULL;
 	}
 
-	mrtp_socket_set_option(host->socket, MRTP_SOCKOPT_NONBLOCK, 1);
-	mrtp_socket_set_option(host->socket, MRTP_SOCKOPT_BROADCAST, 1);
-	mrtp_socket_set_option(host->socket, MRTP_SOCKOPT_RCVBUF, MRTP_HOST_RECEIVE_BUFFER_SIZE);
-	mrtp_socket_set_option(host->socket, MRTP_SOCKOPT_SNDBUF, MRTP_HOST_SEND_BUFFER_SIZE);
+	for (host->socketCount = 0; host->socketCount < socketCount; ++host->socketCount) {
+
+		socket = mrtp_socket_create(MRTP_SOCKET_TYPE_DATAGRAM);
+		if (socket == MRTP_SOCKET_NULL ||
+			(socketCount > 1 && mrtp_socket_set_option(socket, MRTP_SOCKOPT_REUSEPORT, 1) < 0) ||
+			// the later sockets bind to the port the first one got
+			(address != NULL && mrtp_socket_bind(socket, host->socketCount > 0 ? &host->address : address) < 0))
+		{
+			if (socket != MRTP_SOCKET_NULL)
+				mrtp_socket_destroy(socket);
+
+			mrtp_host_destroy_sockets(host);
+			mrtp_free(host->peerSlots);
+			mrtp_free(host->peerChunks);
+			mrtp_free(host);
+
+			return NULL;
+		}
+
+		mrtp_socket_set_option(socket, MRTP_SOCKOPT_NONBLOCK, 1);
+		mrtp_socket_set_option(socket, MRTP_SOCKOPT_BROADCAST, 1);
+		mrtp_socket_set_option(socket, MRTP_SOCKOPT_RCVBUF, MRTP_HOST_RECEIVE_BUFFER_SIZE);
+		mrtp_socket_set_option(socket, MRTP_SOCKOPT_SNDBUF, MRTP_HOST_SEND_BUFFER_SIZE);
+		mrtp_socket_set_option(socket, MRTP_SOCKOPT_TIMESTAMP, 1);
 
-	if (address != NULL && mrtp_socket_get_address(host->socket, &host->address) < 0)
-		host->address = *address;
+		if (host->socketCount == 0 && address != NULL && mrtp_socket_get_address(socket, &host->address) < 0)
+			host->address = *address;
+
+		host->sockets[host->socketCount] = socket;
+	}
+
+	host->socket = host->sockets[0];
+	host->receiveSocketIndex = 0;
+	host->reactor = NULL;
 
 	host->randomSeed = (mrtp_uint32)(size_t)host;
 	host->randomSeed += mrtp_host_random_seed();
@@ -50,13 +103,27 @@ MRtpHost * mrtp_host_create(const MRtpAddress * address, size_t peerCount,
 	host->bandwidthThrottleEpoch = 0;
 	host->recalculateBandwidthLimits = 0;
 	host->mtu = MRTP_HOST_DEFAULT_MTU;
-	host->peerCount = peerCount;
+	host->peerCount = 0;
+	host->peerLimit = peerCount;
+	host->commands = host->sendCommands[0];
 	host->commandCount = 0;
+	host->buffers = host->sendBuffers;
 	host->bufferCount = 0;
+	host->sendBufferCount = 0;
+	host->sendMessageCount = 0;
 	host->receivedAddress.host = MRTP_HOST_ANY;
 	host->receivedAddress.port = 0;
+	host->receivedSocket = host->socket;
 	host->receivedData = NULL;
 	host->receivedDataLength = 0;
+	host->receivedTime = 0;
+	for (size_t i = 0; i < MRTP_HOST_RECEIVE_BATCH_SIZE; ++i)
+		host->receiveBuffers[i] = host->receiveBufferData[i];
+	host->receiveBufferSize = sizeof(host->receiveBufferData[0]);
+	host->receiveSegmentData = NULL;
+	host->receiveBatchCount = 0;
+	host->receiveBatchIndex = 0;
+	host->receiveSegmentOffset = 0;
 
 	host->totalSentData = 0;
 	host->totalSentPackets = 0;
@@ -68,40 +135,80 @@ MRtpHost * mrtp_host_create(const MRtpAddress * address, size_t peerCount,
 	host->duplicatePeers = MRTP_PROTOCOL_MAXIMUM_PEER_ID;
 	host->maximumPacketSize = MRTP_HOST_DEFAULT_MAXIMUM_PACKET_SIZE;
 	host->maximumWaitingData = MRTP_HOST_DEFAULT_MAXIMUM_WAITING_DATA;
+	mrtp_list_clear(&host->reassemblies);
+	host->reassemblyData = 0;
+	host->maximumReassemblyData = MRTP_HOST_DEFAULT_MAXIMUM_REASSEMBLY_DATA;
+	host->maximumPeerReassemblyData = MRTP_HOST_DEFAULT_MAXIMUM_PEER_REASSEMBLY_DATA;
 
 	host->redundancyNum = MRTP_PROTOCOL_DEFAULT_REDUNDANCY_NUM;
 	host->openQuickRetransmit = 0;
+	host->segmentOffload = 0;
+	host->zeroCopyThreshold = 0;
+	mrtp_list_clear(&host->zeroCopySends);
+	host->packetPool = NULL;
+	host->reassemblyPool = NULL;
+	host->receiveSlabPool = NULL;
+	for (size_t i = 0; i < MRTP_HOST_RECEIVE_BATCH_SIZE; ++i)
+		host->receiveSlabs[i] = NULL;
+	host->receivedSlab = NULL;
+	memset(&host->memory, 0, sizeof(MRtpMemoryArena));
+	mrtp_object_pool_init(&host->outgoingCommandPool, sizeof(MRtpOutgoingCommand), MRTP_HOST_COMMAND_SLAB_OBJECTS);
+	host->outgoingCommandPool.arena = &host->memory;
+	host->outgoingCommandPool.memoryType = MRTP_MEMORY_COMMANDS;
+	host->pacing = MRTP_PACING_NONE;
+	host->pacedPeers = 0;
+	host->pacingTimeout = 0;
+	mrtp_timer_wheel_init(&host->timers);
 
 #ifdef PRINTLOG
 	host->logFile = fopen("log.txt", "w");
 #endif
 
 	mrtp_list_clear(&host->dispatchQueue);
+	mrtp_list_clear(&host->sendQueue);
+
+	return host;
+}
+
+// add a chunk of peers to the peer table, their slots and channels come with them
+// return the first of them, or NULL if the table has grown to its limit
+MRtpPeer * mrtp_host_grow_peers(MRtpHost * host) {
+
+	size_t chunkPeers = MRTP_MIN(host->peerLimit - host->peerCount, (size_t)MRTP_HOST_PEER_CHUNK);
+	MRtpPeer * chunk, * currentPeer;
+
+	if (chunkPeers == 0)
+		return NULL;
+
+	chunk = (MRtpPeer *)mrtp_malloc(chunkPeers * sizeof(MRtpPeer));
+	if (chunk == NULL)
+		return NULL;
+	memset(chunk, 0, chunkPeers * sizeof(MRtpPeer));
 
-	// initilize the peers array
-	for (currentPeer = host->peers; currentPeer < &host->peers[host->peerCount]; ++currentPeer) {
+	host->peerChunks[host->peerCount / MRTP_HOST_PEER_CHUNK] = chunk;
+
+	for (currentPeer = chunk; currentPeer < &chunk[chunkPeers]; ++currentPeer) {
 
 		currentPeer->host = host;
-		currentPeer->incomingPeerID = currentPeer - host->peers;
+		currentPeer->incomingPeerID = host->peerCount + (currentPeer - chunk);
+		currentPeer->socket = host->socket;
 		currentPeer->outgoingSessionID = currentPeer->incomingSessionID = 0xFF;
 		currentPeer->data = NULL;
+		currentPeer->memoryUsed = 0;
+		memset(&host->peerSlots[currentPeer->incomingPeerID], 0, sizeof(MRtpPeerSlot));
 
-		mrtp_list_clear(&currentPeer->acknowledgements);
-		mrtp_list_clear(&currentPeer->redundancyAcknowledgemets);
+		memset(&currentPeer->acknowledgements, 0, sizeof(MRtpAcknowledgementRing));
+		memset(&currentPeer->redundancyAcknowledgemets, 0, sizeof(MRtpAcknowledgementRing));
 		mrtp_list_clear(&currentPeer->sentReliableCommands);
 		mrtp_list_clear(&currentPeer->sentRedundancyNoAckCommands);
 		mrtp_list_clear(&currentPeer->outgoingReliableCommands);
 		mrtp_list_clear(&currentPeer->dispatchedCommands);
 		mrtp_list_clear(&currentPeer->outgoingRedundancyCommands);
 		mrtp_list_clear(&currentPeer->outgoingRedundancyNoAckCommands);
-		mrtp_list_clear(&currentPeer->sentRedundancyLastTimeCommands);
-		mrtp_list_clear(&currentPeer->sentRedundancyThisTimeCommands);
+		mrtp_list_clear(&currentPeer->sentRedundancyCommands);
 		mrtp_list_clear(&currentPeer->outgoingUnsequencedCommands);
 		mrtp_list_clear(&currentPeer->sentUnsequencedCommands);
 
-		currentPeer->channels = (MRtpChannel *)mrtp_malloc(MRTP_PROTOCOL_CHANNEL_COUNT * sizeof(MRtpChannel));
-		if (currentPeer->channels == NULL)
-			return NULL;
 		currentPeer->channelCount = MRTP_PROTOCOL_CHANNEL_COUNT;
 
 		for (MRtpChannel *channel = currentPeer->channels;
@@ -113,25 +220,35 @@ MRtpHost * mrtp_host_create(const MRtpAddress * address, size_t peerCount,
 		mrtp_peer_reset(currentPeer);
 	}
 
-	return host;
+	host->peerCount += chunkPeers;
+
+	return chunk;
 }
 
 MRtpPeer *mrtp_host_connect(MRtpHost * host, const MRtpAddress * address) {
 	MRtpPeer * currentPeer;
+	MRtpPeerSlot * peerSlot;
 	MRtpChannel * channel;
 	MRtpProtocol command;
 
-	for (currentPeer = host->peers; currentPeer < &host->peers[host->peerCount]; ++currentPeer) {
+	for (peerSlot = host->peerSlots; peerSlot < &host->peerSlots[host->peerCount]; ++peerSlot) {
 		// find the first peer which state is disconnected
-		if (currentPeer->state == MRTP_PEER_STATE_DISCONNECTED)
+		if (peerSlot->state == MRTP_PEER_STATE_DISCONNECTED)
 			break;
 	}
 
-	if (currentPeer >= &host->peers[host->peerCount])
-		return NULL;
+	// all the peers in the table are in use, it grows
+	if (peerSlot < &host->peerSlots[host->peerCount])
+		currentPeer = MRTP_HOST_PEER(host, peerSlot - host->peerSlots);
+	else {
+		currentPeer = mrtp_host_grow_peers(host);
+		if (currentPeer == NULL)
+			return NULL;
+	}
 
-	currentPeer->state = MRTP_PEER_STATE_CONNECTING;
-	currentPeer->address = *address;
+	mrtp_peer_set_state(currentPeer, MRTP_PEER_STATE_CONNECTING);
+	mrtp_peer_set_address(currentPeer, address);
+	currentPeer->socket = host->socket;
 	currentPeer->connectID = ++host->randomSeed;
 
 	if (host->outgoingBandwidth == 0)
@@ -161,46 +278,101 @@ MRtpPeer *mrtp_host_connect(MRtpHost * host, const MRtpAddress * address) {
 	return currentPeer;
 }
 
-void mrtp_host_free_redundancy_buffers(MRtpHost* host) {
+// drop the references a zero copy send held on its packets
+static void mrtp_host_release_zero_copy(MRtpZeroCopySend * zeroCopySend) {
 
-	MRtpPeer* currentPeer;
-	for (currentPeer = host->peers; currentPeer < &host->peers[host->peerCount]; ++currentPeer) {
-		if (currentPeer->redundancyNoAckBuffers) {
+	size_t i;
 
-			for (int i = 0; i < currentPeer->redundancyNum; i++) {
-				mrtp_protocol_remove_redundancy_buffer_commands(&currentPeer->redundancyNoAckBuffers[i]);
-			}
-			mrtp_free(currentPeer->redundancyNoAckBuffers);
+	mrtp_list_remove(&zeroCopySend->zeroCopyList);
 
-			currentPeer->redundancyNoAckBuffers = NULL;
-			currentPeer->currentRedundancyNoAckBufferNum = 0;
-		}
+	for (i = 0; i < zeroCopySend->packetCount; ++i) {
+		MRtpPacket * packet = zeroCopySend->packets[i];
+
+		--packet->referenceCount;
+		if (packet->referenceCount == 0)
+			mrtp_packet_destroy(packet);
 	}
 
+	mrtp_free(zeroCopySend);
 }
 
 void mrtp_host_destroy(MRtpHost * host) {
-	MRtpPeer * currentPeer;
+	size_t i;
 
 	if (host == NULL)
 		return;
 
-	mrtp_socket_destroy(host->socket);
+	// the reactor stops waiting on the sockets before they are closed
+	if (host->reactor != NULL)
+		mrtp_reactor_remove_host(host->reactor, host);
 
-	mrtp_host_free_redundancy_buffers(host);
+	mrtp_host_destroy_sockets(host);
 
-	for (currentPeer = host->peers; currentPeer < &host->peers[host->peerCount]; ++currentPeer) {
-		mrtp_peer_reset(currentPeer);
-		mrtp_free(currentPeer->channels);
-	}
+	// the kernel dropped its page references with the sockets
+	while (!mrtp_list_empty(&host->zeroCopySends))
+		mrtp_host_release_zero_copy((MRtpZeroCopySend *)mrtp_list_front(&host->zeroCopySends));
+
+	if (host->receiveSegmentData != NULL)
+		mrtp_free(host->receiveSegmentData);
+
+	for (i = 0; i < host->peerCount; ++i)
+		mrtp_peer_reset(MRTP_HOST_PEER(host, i));
 #ifdef PRINTLOG
 	fclose(host->logFile);
 #endif // PRINTLOG
 
-	mrtp_free(host->peers);
+	for (i = 0; i < host->peerCount; i += MRTP_HOST_PEER_CHUNK)
+		mrtp_free(host->peerChunks[i / MRTP_HOST_PEER_CHUNK]);
+	mrtp_free(host->peerChunks);
+	mrtp_free(host->peerSlots);
+	mrtp_object_pool_clear(&host->outgoingCommandPool);
+	mrtp_packet_pool_destroy(host->packetPool);
+	mrtp_packet_pool_destroy(host->reassemblyPool);
+	for (i = 0; i < MRTP_HOST_RECEIVE_BATCH_SIZE; ++i) {
+		if (host->receiveSlabs[i] != NULL)
+			mrtp_receive_slab_release(host->receiveSlabs[i]);
+	}
+	mrtp_receive_slab_pool_destroy(host->receiveSlabPool);
 	mrtp_free(host);
 }
 
+// point the receive buffers at the slabs, the segment buffers or the buffers inside the host
+// return -1 if a slab couldn't be allocated, the host receives into its own buffers then
+static int mrtp_host_setup_receive_buffers(MRtpHost * host) {
+
+	size_t i;
+
+	host->receivedSlab = NULL;
+
+	for (i = 0; i < MRTP_HOST_RECEIVE_BATCH_SIZE; ++i) {
+		if (host->receiveSlabs[i] != NULL) {
+			mrtp_receive_slab_release(host->receiveSlabs[i]);
+			host->receiveSlabs[i] = NULL;
+		}
+
+		if (host->receiveSegmentData != NULL)
+			host->receiveBuffers[i] = &host->receiveSegmentData[i * MRTP_HOST_SEGMENT_RECEIVE_BUFFER_SIZE];
+		else
+			host->receiveBuffers[i] = host->receiveBufferData[i];
+	}
+	host->receiveBufferSize = host->receiveSegmentData != NULL ? (size_t)MRTP_HOST_SEGMENT_RECEIVE_BUFFER_SIZE : sizeof(host->receiveBufferData[0]);
+
+	if (host->receiveSlabPool == NULL)
+		return 0;
+
+	mrtp_receive_slab_pool_resize(host->receiveSlabPool, host->receiveBufferSize);
+
+	for (i = 0; i < MRTP_HOST_RECEIVE_BATCH_SIZE; ++i) {
+		host->receiveSlabs[i] = mrtp_receive_slab_acquire(host->receiveSlabPool);
+		if (host->receiveSlabs[i] == NULL)
+			return -1;
+
+		host->receiveBuffers[i] = MRTP_RECEIVE_SLAB_DATA(host->receiveSlabs[i]);
+	}
+
+	return 0;
+}
+
 void mrtp_host_bandwidth_throttle(MRtpHost * host) {
 
 	mrtp_uint32 timeCurrent = mrtp_time_get();
@@ -212,6 +384,7 @@ void mrtp_host_bandwidth_throttle(MRtpHost * host) {
 	mrtp_uint32 bandwidthLimit = 0;
 	int needsAdjustment = host->bandwidthLimitedPeers > 0 ? 1 : 0;
 	MRtpPeer * peer;
+	MRtpPeerSlot * peerSlot;
 	MRtpProtocol command;
 
 	if (elapsedTime < MRTP_HOST_BANDWIDTH_THROTTLE_INTERVAL)
@@ -228,8 +401,9 @@ void mrtp_host_bandwidth_throttle(MRtpHost * host) {
 		//the data size at full outgoingBandwidth during the elapsed time
 		bandwidth = (host->outgoingBandwidth * elapsedTime) / 1000;
 
-		for (peer = host->peers; peer < &host->peers[host->peerCount]; ++peer) {
-			if (peer->state != MRTP_PEER_STATE_CONNECTED && peer->state != MRTP_PEER_STATE_DISCONNECT_LATER)
+		for (peerSlot = host->peerSlots; peerSlot < &host->peerSlots[host->peerCount]; ++peerSlot) {
+			peer = MRTP_HOST_PEER(host, peerSlot - host->peerSlots);
+			if (!MRTP_PEER_SLOT_CONNECTED(peerSlot))
 				continue;
 
 			dataTotal += peer->outgoingDataTotal;	// the total data send to peer during the elapsed time
@@ -245,11 +419,11 @@ void mrtp_host_bandwidth_throttle(MRtpHost * host) {
 		else
 			throttle = (bandwidth * MRTP_PEER_PACKET_THROTTLE_SCALE) / dataTotal;
 
-		for (peer = host->peers; peer < &host->peers[host->peerCount]; ++peer) {
+		for (peerSlot = host->peerSlots; peerSlot < &host->peerSlots[host->peerCount]; ++peerSlot) {
 			mrtp_uint32 peerBandwidth;
+			peer = MRTP_HOST_PEER(host, peerSlot - host->peerSlots);
 
-			if ((peer->state != MRTP_PEER_STATE_CONNECTED &&
-				peer->state != MRTP_PEER_STATE_DISCONNECT_LATER) ||	// peer is conected
+			if (!MRTP_PEER_SLOT_CONNECTED(peerSlot) ||	// peer is conected
 				peer->incomingBandwidth == 0 ||						// peer open flow control
 				peer->outgoingBandwidthThrottleEpoch == timeCurrent)// hasn't been adjusted before
 				continue;
@@ -293,9 +467,9 @@ void mrtp_host_bandwidth_throttle(MRtpHost * host) {
 		else
 			throttle = (bandwidth * MRTP_PEER_PACKET_THROTTLE_SCALE) / dataTotal;
 
-		for (peer = host->peers; peer < &host->peers[host->peerCount]; ++peer) {
-			if ((peer->state != MRTP_PEER_STATE_CONNECTED &&
-				peer->state != MRTP_PEER_STATE_DISCONNECT_LATER) ||
+		for (peerSlot = host->peerSlots; peerSlot < &host->peerSlots[host->peerCount]; ++peerSlot) {
+			peer = MRTP_HOST_PEER(host, peerSlot - host->peerSlots);
+			if (!MRTP_PEER_SLOT_CONNECTED(peerSlot) ||
 				peer->outgoingBandwidthThrottleEpoch == timeCurrent)
 				continue;
 
@@ -311,7 +485,7 @@ void mrtp_host_bandwidth_throttle(MRtpHost * host) {
 
 #ifdef FLOWCONTROLDEBUG
 	for (int i = 0; i < host->peerCount; i++) {
-		peer = &host->peers[i];
+		peer = MRTP_HOST_PEER(host, i);
 		fprintf(host->logFile, "peer [%d]: packetThrottleLimit [%d], packetThrottle [%d], incomingBandwidth [%d]\n",
 			i, peer->packetThrottleLimit, peer->packetThrottle, peer->incomingBandwidth);
 	}
@@ -335,9 +509,9 @@ void mrtp_host_bandwidth_throttle(MRtpHost * host) {
 				// get the host incoming bandwidth average value each time
 				bandwidthLimit = bandwidth / peersRemaining;
 
-				for (peer = host->peers; peer < &host->peers[host->peerCount]; ++peer) {
-					if ((peer->state != MRTP_PEER_STATE_CONNECTED &&
-						peer->state != MRTP_PEER_STATE_DISCONNECT_LATER) ||		// peer has alerady connected
+				for (peerSlot = host->peerSlots; peerSlot < &host->peerSlots[host->peerCount]; ++peerSlot) {
+					peer = MRTP_HOST_PEER(host, peerSlot - host->peerSlots);
+					if (!MRTP_PEER_SLOT_CONNECTED(peerSlot) ||		// peer has alerady connected
 						peer->incomingBandwidthThrottleEpoch == timeCurrent)	// hasn't been handled before
 						continue;
 
@@ -354,9 +528,10 @@ void mrtp_host_bandwidth_throttle(MRtpHost * host) {
 			}
 		}
 
-		for (peer = host->peers; peer < &host->peers[host->peerCount]; ++peer) {
+		for (peerSlot = host->peerSlots; peerSlot < &host->peerSlots[host->peerCount]; ++peerSlot) {
+			peer = MRTP_HOST_PEER(host, peerSlot - host->peerSlots);
 
-			if (peer->state != MRTP_PEER_STATE_CONNECTED && peer->state != MRTP_PEER_STATE_DISCONNECT_LATER)
+			if (!MRTP_PEER_SLOT_CONNECTED(peerSlot))
 				continue;
 
 			// send the bandwidth limit command to the connected peer
@@ -377,6 +552,67 @@ void mrtp_host_bandwidth_throttle(MRtpHost * host) {
 	}
 }
 
+// queue the packet to every connected peer, the peers share the one packet and the delivery mode comes from its flags
+// fragments are encoded once for each fragment length among the peers, the packet is destroyed if no peer took it
+void mrtp_host_broadcast(MRtpHost * host, MRtpPacket * packet) {
+
+	MRtpFragmentPlan plans[MRTP_HOST_BROADCAST_PLANS];
+	size_t planCount = 0, fragmentLength, i;
+	MRtpPeerSlot * peerSlot;
+	MRtpPeer * peer;
+
+	for (peerSlot = host->peerSlots; peerSlot < &host->peerSlots[host->peerCount]; ++peerSlot) {
+		MRtpFragmentPlan * plan = NULL;
+
+		if (peerSlot->state != MRTP_PEER_STATE_CONNECTED || packet->dataLength > host->maximumPacketSize)
+			continue;
+
+		peer = MRTP_HOST_PEER(host, peerSlot - host->peerSlots);
+		fragmentLength = mrtp_peer_fragment_length(peer, packet);
+
+		// a single command holds the packet itself, there is nothing to share
+		if (packet->dataLength <= fragmentLength) {
+			mrtp_peer_send(peer, packet);
+			continue;
+		}
+
+		for (i = 0; i < planCount; ++i) {
+			if (plans[i].fragmentLength == fragmentLength) {
+				plan = &plans[i];
+				break;
+			}
+		}
+
+		if (plan == NULL && planCount < MRTP_HOST_BROADCAST_PLANS) {
+			mrtp_uint32 fragmentCount = (packet->dataLength + fragmentLength - 1) / fragmentLength;
+			MRtpProtocol * fragments = NULL;
+
+			if (fragmentCount <= MRTP_PROTOCOL_MAXIMUM_FRAGMENT_COUNT)
+				fragments = (MRtpProtocol *)mrtp_malloc(fragmentCount * sizeof(MRtpProtocol));
+
+			if (fragments != NULL) {
+				mrtp_peer_encode_fragments(packet, fragmentLength, fragments);
+
+				plan = &plans[planCount++];
+				plan->fragmentLength = fragmentLength;
+				plan->fragmentCount = fragmentCount;
+				plan->fragments = fragments;
+			}
+		}
+
+		// past the plans, the peer fragments the packet on its own
+		if (plan == NULL)
+			mrtp_peer_send(peer, packet);
+		else
+			mrtp_peer_send_fragments(peer, packet, plan->fragments, plan->fragmentCount, plan->fragmentLength);
+	}
+
+	for (i = 0; i < planCount; ++i)
+		mrtp_free(plans[i].fragments);
+
+	if (packet->referenceCount == 0)
+		mrtp_packet_destroy(packet);
+}
 
 void mrtp_host_bandwidth_limit(MRtpHost * host, mrtp_uint32 incomingBandwidth, mrtp_uint32 outgoingBandwidth)
 {
@@ -385,6 +621,21 @@ void mrtp_host_bandwidth_limit(MRtpHost * host, mrtp_uint32 incomingBandwidth, m
 	host->recalculateBandwidthLimits = 1;
 }
 
+// cap the memory the messages still missing fragments may hold, for each peer and for the whole host, 0 is unlimited
+// a new message past a cap evicts stale unreliable ones, reliable fragments are refused and resent by the peer then
+void mrtp_host_reassembly_limit(MRtpHost * host, size_t peerLimit, size_t hostLimit) {
+	host->maximumPeerReassemblyData = peerLimit;
+	host->maximumReassemblyData = hostLimit;
+}
+
+// budget the memory each peer and the whole host may hold in the arena of the host, 0 is unlimited
+// past a budget incoming messages are dropped, reliable ones resent by the peer, acknowledgements are dropped
+// the same way, and the outgoing command pool stops growing so that mrtp_peer_send fails
+void mrtp_host_memory_limit(MRtpHost * host, size_t peerBudget, size_t hostBudget) {
+	host->memory.peerBudget = peerBudget;
+	host->memory.budget = hostBudget;
+}
+
 // don't change redundancy_num when you send a packet
 void mrtp_host_set_redundancy_num(MRtpHost *host, mrtp_uint32 redundancy_num) {
 	if (redundancy_num > MRTP_PROTOCOL_MAXIMUM_REDUNDANCY_NUM) {
@@ -402,8 +653,6 @@ void mrtp_host_shutdown_quick_retransmit(MRtpHost * host) {
 
 void mrtp_host_open_quick_retransmit(MRtpHost *host, mrtp_uint32 quickRetransmit) {
 
-	MRtpPeer * currentPeer;
-
 	host->openQuickRetransmit = 1;
 
 	if (quickRetransmit > 0) {
@@ -414,12 +663,261 @@ void mrtp_host_open_quick_retransmit(MRtpHost *host, mrtp_uint32 quickRetransmit
 			quickRetransmit = MRTP_PROTOCOL_MINIMUM_QUICK_RETRANSMIT;
 		}
 
-		for (currentPeer = host->peers; currentPeer < &host->peers[host->peerCount]; ++currentPeer) {
-			currentPeer->quickRetransmitNum = quickRetransmit;
+		for (size_t i = 0; i < host->peerCount; ++i) {
+			MRTP_HOST_PEER(host, i)->quickRetransmitNum = quickRetransmit;
+		}
+	}
+}
+
+// let the kernel split trains of equal sized datagrams to one peer (UDP GSO)
+// return -1 if the socket doesn't support it
+int mrtp_host_segment_offload(MRtpHost * host, int enable) {
+
+	size_t i;
+
+	for (i = 0; enable && i < host->socketCount; ++i) {
+		if (mrtp_socket_set_option(host->sockets[i], MRTP_SOCKOPT_UDP_SEGMENT, 0) < 0)
+			return -1;
+	}
+
+	host->segmentOffload = enable ? 1 : 0;
+
+	return 0;
+}
+
+// let the kernel coalesce datagrams from one peer into larger buffers (UDP GRO)
+// the datagrams are split again before they are handled, return -1 if the socket doesn't support it,
+// or if the host uses io rings and is in a reactor
+int mrtp_host_receive_offload(MRtpHost * host, int enable) {
+
+	size_t i;
+
+	// datagrams left in the ring still point into the current buffers
+	if (host->receiveBatchIndex < host->receiveBatchCount)
+		return -1;
+
+	// the io rings are rebuilt for the new buffer size, the reactor would still wait on the old ones
+	if (host->socketRings[0] != NULL && host->reactor != NULL)
+		return -1;
+
+	if (enable) {
+		if (host->receiveSegmentData != NULL)
+			return 0;
+
+		host->receiveSegmentData = (mrtp_uint8 *)mrtp_malloc(MRTP_HOST_RECEIVE_BATCH_SIZE * MRTP_HOST_SEGMENT_RECEIVE_BUFFER_SIZE);
+		if (host->receiveSegmentData == NULL)
+			return -1;
+
+		for (i = 0; i < host->socketCount; ++i) {
+			if (mrtp_socket_set_option(host->sockets[i], MRTP_SOCKOPT_UDP_GRO, 1) < 0) {
+				while (i > 0)
+					mrtp_socket_set_option(host->sockets[--i], MRTP_SOCKOPT_UDP_GRO, 0);
+
+				mrtp_free(host->receiveSegmentData);
+				host->receiveSegmentData = NULL;
+
+				return -1;
+			}
+		}
+
+		mrtp_host_setup_receive_buffers(host);
+	}
+	else {
+		if (host->receiveSegmentData == NULL)
+			return 0;
+
+		for (i = 0; i < host->socketCount; ++i)
+			mrtp_socket_set_option(host->sockets[i], MRTP_SOCKOPT_UDP_GRO, 0);
+
+		mrtp_free(host->receiveSegmentData);
+		host->receiveSegmentData = NULL;
+
+		mrtp_host_setup_receive_buffers(host);
+	}
+
+	// the io ring buffers have to match the new receive buffer size
+	if (host->socketRings[0] != NULL) {
+		mrtp_host_io_ring(host, 0);
+		return mrtp_host_io_ring(host, 1);
+	}
+
+	return 0;
+}
+
+// receive and send through an io_uring per socket instead of the plain socket calls, call it right after
+// the host is created, before it is added to a reactor
+// return -1 if io_uring is not available, the host keeps using the plain socket calls then,
+// or if the host is in a reactor, which waits on the descriptors the host has now
+int mrtp_host_io_ring(MRtpHost * host, int enable) {
+
+	size_t i;
+
+	// datagrams left in the ring may still point into the io ring buffers
+	if (host->receiveBatchIndex < host->receiveBatchCount || host->reactor != NULL)
+		return -1;
+
+	for (i = 0; i < host->socketCount; ++i) {
+		if (host->socketRings[i] != NULL) {
+			mrtp_socket_ring_destroy(host->socketRings[i]);
+			host->socketRings[i] = NULL;
+		}
+	}
+
+	for (i = 0; enable && i < host->socketCount; ++i) {
+		host->socketRings[i] = mrtp_socket_ring_create(host->sockets[i], MRTP_HOST_IO_RING_BUFFERS, host->receiveBufferSize);
+
+		if (host->socketRings[i] == NULL) {
+			mrtp_host_io_ring(host, 0);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+// send the datagrams that carry at least threshold bytes of packet data with MSG_ZEROCOPY, 0 turns it off
+// the packets are held until the kernel reports it is done with them, which only pays off for large
+// datagrams, so it goes with segment offload, MRTP_HOST_DEFAULT_ZERO_COPY_THRESHOLD is a fair start
+// it is not used while the io ring is on
+// return -1 if the socket doesn't support it
+int mrtp_host_zero_copy(MRtpHost * host, size_t threshold) {
+
+	size_t i;
+
+	for (i = 0; threshold && i < host->socketCount; ++i) {
+		if (mrtp_socket_set_option(host->sockets[i], MRTP_SOCKOPT_ZEROCOPY, 1) < 0)
+			return -1;
+	}
+
+	// sends still in flight are reaped on later service calls
+	host->zeroCopyThreshold = threshold;
+
+	return 0;
+}
+
+// release the packets of the zero copy sends the kernel reported done
+void mrtp_host_reap_zero_copy(MRtpHost * host) {
+
+	MRtpListIterator currentSend, nextSend;
+	mrtp_uint32 first, last;
+	size_t i;
+
+	for (i = 0; i < host->socketCount && !mrtp_list_empty(&host->zeroCopySends); ++i) {
+		while (mrtp_socket_zero_copy_completion(host->sockets[i], &first, &last) > 0) {
+
+			for (currentSend = mrtp_list_begin(&host->zeroCopySends);
+				currentSend != mrtp_list_end(&host->zeroCopySends);
+				currentSend = nextSend)
+			{
+				MRtpZeroCopySend * zeroCopySend = (MRtpZeroCopySend *)currentSend;
+
+				nextSend = mrtp_list_next(currentSend);
+
+				// the completion ids wrap around
+				if (zeroCopySend->socketIndex == i && zeroCopySend->sequence - first <= last - first)
+					mrtp_host_release_zero_copy(zeroCopySend);
+			}
 		}
 	}
 }
 
+// spread the datagrams of every peer across its round trip time, at a rate taken from its throttled window,
+// instead of sending what the window allows in one burst
+// kernel pacing stamps the datagrams with SO_TXTIME and needs the fq qdisc on the outgoing device,
+// where the socket doesn't support it the host paces in user space
+// return the mode the host paces with
+MRtpPacingMode mrtp_host_pacing(MRtpHost * host, MRtpPacingMode pacing) {
+
+	size_t i;
+
+	for (i = 0; pacing == MRTP_PACING_KERNEL && i < host->socketCount; ++i) {
+		if (mrtp_socket_set_option(host->sockets[i], MRTP_SOCKOPT_TXTIME, 1) < 0)
+			pacing = MRTP_PACING_USER;
+	}
+
+	host->pacing = pacing;
+	host->pacedPeers = 0;
+
+	return pacing;
+}
+
+// take the incoming packets, and those made with mrtp_host_packet_create, from size classed blocks of the host
+// instead of the allocator, mrtp_packet_destroy gives them back
+// the pool is not locked, so its packets must be destroyed on the thread that services the host
+// return -1 if the pool couldn't be allocated
+int mrtp_host_packet_pool(MRtpHost * host, int enable) {
+
+	if (enable && host->packetPool == NULL) {
+		host->packetPool = mrtp_packet_pool_create();
+		if (host->packetPool == NULL)
+			return -1;
+	}
+	else if (!enable && host->packetPool != NULL) {
+		// packets still out go back to the old pool, it is freed with the last of them
+		mrtp_packet_pool_destroy(host->packetPool);
+		host->packetPool = NULL;
+	}
+
+	return 0;
+}
+
+// create a packet from the pool of the host, or on its own if the pool is off
+MRtpPacket * mrtp_host_packet_create(MRtpHost * host, const void * data, size_t dataLength, mrtp_uint32 flags) {
+	return mrtp_packet_pool_acquire(host->packetPool, data, dataLength, flags);
+}
+
+// deliver the unfragmented incoming packets pointing into the buffer the datagram was received in
+// instead of copying them out, the buffer is recycled once the last packet into it is destroyed
+// a buffer is held as long as any packet into it, with receive offload that is 64KB for each packet kept around,
+// payloads under MRTP_PACKET_INLINE_DATA are copied instead
+// the packets are not locked either, so they must be destroyed on the thread that services the host
+// it is not used while the io ring is on or for compressed datagrams
+// return -1 if datagrams are still waiting to be handled or the slabs couldn't be allocated
+int mrtp_host_zero_copy_receive(MRtpHost * host, int enable) {
+
+	// datagrams left in the ring still point into the current buffers
+	if (host->receiveBatchIndex < host->receiveBatchCount)
+		return -1;
+
+	if (!enable) {
+		MRtpReceiveSlabPool * receiveSlabPool = host->receiveSlabPool;
+
+		if (receiveSlabPool == NULL)
+			return 0;
+
+		host->receiveSlabPool = NULL;
+		mrtp_host_setup_receive_buffers(host);
+
+		// slabs still held by packets are freed with the last of them
+		mrtp_receive_slab_pool_destroy(receiveSlabPool);
+
+		return 0;
+	}
+
+	if (host->receiveSlabPool != NULL)
+		return 0;
+
+	host->receiveSlabPool = mrtp_receive_slab_pool_create(host->receiveBufferSize);
+	if (host->receiveSlabPool == NULL)
+		return -1;
+
+	if (mrtp_host_setup_receive_buffers(host) < 0) {
+		mrtp_host_zero_copy_receive(host, 0);
+		return -1;
+	}
+
+	return 0;
+}
+
+// the descriptor that turns readable when datagrams came in on a host socket
+MRtpSocket mrtp_host_wait_socket(MRtpHost * host, size_t socketIndex) {
+
+	if (host->socketRings[socketIndex] != NULL)
+		return mrtp_socket_ring_wait_socket(host->socketRings[socketIndex]);
+
+	return host->sockets[socketIndex];
+}
+
 void mrtp_host_compress(MRtpHost * host, const MRtpCompressor * compressor) {
 
 	if (host->compressor.context != NULL && host->compressor.destroy)
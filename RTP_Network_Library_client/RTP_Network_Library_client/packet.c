@@ -1,22 +1,27 @@
 #include <string.h>
 #include "mrtp.h"
 
-MRtpPacket * mrtp_packet_create(const void * data, size_t dataLength, mrtp_uint32 flags) {
+// a packet and its data are allocated as one block, the data follows the packet
+#define MRTP_PACKET_BLOCK_DATA(packet) ((mrtp_uint8 *)(packet) + sizeof(MRtpPacket))
 
-	MRtpPacket * packet = (MRtpPacket *)mrtp_malloc(sizeof(MRtpPacket));
-	if (packet == NULL)
-		return NULL;
+// slabs of a packet pool are linked through their header, the blocks of one size class follow it
+typedef union _MRtpPacketSlab {
+	struct {
+		union _MRtpPacketSlab * next;
+		size_t poolClass;
+		size_t blockCount;
+	} header;
+	MRtpPacket align;
+} MRtpPacketSlab;
+
+static void mrtp_packet_init(MRtpPacket * packet, const void * data, size_t dataLength, mrtp_uint32 flags) {
 
 	if (flags & MRTP_PACKET_FLAG_NO_ALLOCATE)
 		packet->data = (mrtp_uint8 *)data;
 	else if (dataLength <= 0)
 		packet->data = NULL;
 	else {
-		packet->data = (mrtp_uint8 *)mrtp_malloc(dataLength);
-		if (packet->data == NULL) {
-			mrtp_free(packet);
-			return NULL;
-		}
+		packet->data = MRTP_PACKET_BLOCK_DATA(packet);
 		if (data != NULL)
 			memcpy(packet->data, data, dataLength);
 	}
@@ -25,6 +30,21 @@ MRtpPacket * mrtp_packet_create(const void * data, size_t dataLength, mrtp_uint3
 	packet->flags = flags;
 	packet->dataLength = dataLength;
 	packet->freeCallback = NULL;
+	packet->slab = NULL;
+}
+
+// one allocation holds the packet and its data, mrtp_packet_resize only moves the data out when it outgrows the block
+MRtpPacket * mrtp_packet_create(const void * data, size_t dataLength, mrtp_uint32 flags) {
+
+	size_t capacity = (flags & MRTP_PACKET_FLAG_NO_ALLOCATE) ? 0 : dataLength;
+	MRtpPacket * packet = (MRtpPacket *)mrtp_malloc(sizeof(MRtpPacket) + capacity);
+	if (packet == NULL)
+		return NULL;
+
+	packet->pool = NULL;
+	packet->capacity = capacity;
+
+	mrtp_packet_init(packet, data, dataLength, flags);
 
 	return packet;
 }
@@ -38,12 +58,38 @@ int mrtp_packet_resize(MRtpPacket * packet, size_t dataLength) {
 		return 0;
 	}
 
+	// the data can't grow inside a receive slab, it moves out of it
+	if (packet->slab != NULL) {
+		newData = (mrtp_uint8 *)mrtp_malloc(dataLength);
+		if (newData == NULL)
+			return -1;
+
+		memcpy(newData, packet->data, packet->dataLength);
+		mrtp_receive_slab_release(packet->slab);
+
+		packet->slab = NULL;
+		packet->data = newData;
+		packet->dataLength = dataLength;
+
+		return 0;
+	}
+
+	// the block still has room for it
+	if ((packet->data == NULL || packet->data == MRTP_PACKET_BLOCK_DATA(packet)) && dataLength <= packet->capacity) {
+		packet->data = MRTP_PACKET_BLOCK_DATA(packet);
+		packet->dataLength = dataLength;
+		return 0;
+	}
+
 	newData = (mrtp_uint8 *)mrtp_malloc(dataLength);
 	if (newData == NULL)
 		return -1;
 
-	memcpy(newData, packet->data, packet->dataLength);
-	mrtp_free(packet->data);
+	if (packet->data != NULL) {
+		memcpy(newData, packet->data, packet->dataLength);
+		if (packet->data != MRTP_PACKET_BLOCK_DATA(packet))
+			mrtp_free(packet->data);
+	}
 
 	packet->data = newData;
 	packet->dataLength = dataLength;
@@ -51,14 +97,286 @@ int mrtp_packet_resize(MRtpPacket * packet, size_t dataLength) {
 	return 0;
 }
 
+// the size class of a pool block with room for dataLength bytes, MRTP_PACKET_POOL_CLASSES or more if none fits
+static size_t mrtp_packet_pool_class(size_t dataLength) {
+
+	size_t poolClass = 0;
+
+	while ((size_t)(MRTP_PACKET_POOL_MINIMUM_DATA << poolClass) < dataLength && poolClass < MRTP_PACKET_POOL_CLASSES)
+		++poolClass;
+
+	return poolClass;
+}
+
+static void mrtp_packet_pool_free(MRtpPacketPool * pool) {
+
+	MRtpPacketSlab * slab = (MRtpPacketSlab *)pool->slabs;
+
+	while (slab != NULL) {
+		MRtpPacketSlab * nextSlab = slab->header.next;
+
+		mrtp_free(slab);
+		slab = nextSlab;
+	}
+
+	mrtp_free(pool);
+}
+
+// carve a new slab into blocks of a size class
+static int mrtp_packet_pool_grow(MRtpPacketPool * pool, size_t poolClass) {
+
+	size_t capacity = MRTP_PACKET_POOL_MINIMUM_DATA << poolClass;
+	size_t blockSize = sizeof(MRtpPacket) + capacity;
+	size_t blockCount = (MRTP_PACKET_POOL_SLAB_SIZE - sizeof(MRtpPacketSlab)) / blockSize;
+	MRtpPacketSlab * slab;
+	mrtp_uint8 * block;
+
+	if (blockCount < MRTP_PACKET_POOL_MINIMUM_SLAB_BLOCKS)
+		blockCount = MRTP_PACKET_POOL_MINIMUM_SLAB_BLOCKS;
+
+	slab = (MRtpPacketSlab *)mrtp_malloc(sizeof(MRtpPacketSlab) + blockCount * blockSize);
+	if (slab == NULL)
+		return -1;
+
+	slab->header.next = (MRtpPacketSlab *)pool->slabs;
+	slab->header.poolClass = poolClass;
+	slab->header.blockCount = blockCount;
+	pool->slabs = slab;
+	++pool->slabCount;
+	if (sizeof(MRtpPacketSlab) + blockCount * blockSize > MRTP_PACKET_POOL_SLAB_SIZE)
+		++pool->largeSlabs;
+
+	for (block = (mrtp_uint8 *)(slab + 1); blockCount > 0; --blockCount, block += blockSize) {
+		MRtpPacket * packet = (MRtpPacket *)block;
+
+		packet->pool = pool;
+		packet->capacity = capacity;
+		packet->data = (mrtp_uint8 *)pool->freePackets[poolClass];
+		pool->freePackets[poolClass] = packet;
+	}
+
+	return 0;
+}
+
+// free the slabs grown past the slab size whose blocks are all free, the slabs of the regular size are kept
+void mrtp_packet_pool_trim(MRtpPacketPool * pool) {
+
+	MRtpPacketSlab ** slabLink = (MRtpPacketSlab **)&pool->slabs;
+
+	while (*slabLink != NULL && pool->largeSlabs > 0) {
+		MRtpPacketSlab * slab = *slabLink;
+		size_t poolClass = slab->header.poolClass;
+		size_t blockSize = sizeof(MRtpPacket) + (MRTP_PACKET_POOL_MINIMUM_DATA << poolClass);
+		mrtp_uint8 * blocks = (mrtp_uint8 *)(slab + 1), * blocksEnd = blocks + slab->header.blockCount * blockSize;
+		MRtpPacket * packet, ** packetLink;
+		size_t freeBlocks = 0;
+
+		if (sizeof(MRtpPacketSlab) + slab->header.blockCount * blockSize > MRTP_PACKET_POOL_SLAB_SIZE) {
+			for (packet = pool->freePackets[poolClass]; packet != NULL; packet = (MRtpPacket *)packet->data) {
+				if ((mrtp_uint8 *)packet >= blocks && (mrtp_uint8 *)packet < blocksEnd)
+					++freeBlocks;
+			}
+		}
+
+		if (freeBlocks == 0 || freeBlocks < slab->header.blockCount) {
+			slabLink = &slab->header.next;
+			continue;
+		}
+
+		for (packetLink = &pool->freePackets[poolClass]; *packetLink != NULL; ) {
+			if ((mrtp_uint8 *)*packetLink >= blocks && (mrtp_uint8 *)*packetLink < blocksEnd)
+				*packetLink = (MRtpPacket *)(*packetLink)->data;
+			else
+				packetLink = (MRtpPacket **)&(*packetLink)->data;
+		}
+
+		*slabLink = slab->header.next;
+		--pool->slabCount;
+		--pool->largeSlabs;
+		mrtp_free(slab);
+	}
+}
+
+MRtpPacketPool * mrtp_packet_pool_create(void) {
+
+	MRtpPacketPool * pool = (MRtpPacketPool *)mrtp_malloc(sizeof(MRtpPacketPool));
+	if (pool == NULL)
+		return NULL;
+
+	memset(pool, 0, sizeof(MRtpPacketPool));
+
+	return pool;
+}
+
+// packets still held by the application keep the pool alive, it is freed with the last of them
+void mrtp_packet_pool_destroy(MRtpPacketPool * pool) {
+
+	if (pool == NULL)
+		return;
+
+	pool->destroyed = 1;
+
+	if (pool->usedPackets == 0)
+		mrtp_packet_pool_free(pool);
+}
+
+// take a packet from the block of its size class, the data is copied into the block
+// packets too large for any class, such as reassembled messages past 64KB, are allocated on their own
+MRtpPacket * mrtp_packet_pool_acquire(MRtpPacketPool * pool, const void * data, size_t dataLength, mrtp_uint32 flags) {
+
+	size_t poolClass = (flags & MRTP_PACKET_FLAG_NO_ALLOCATE) ? 0 : mrtp_packet_pool_class(dataLength);
+	MRtpPacket * packet;
+
+	if (pool == NULL || poolClass >= MRTP_PACKET_POOL_CLASSES)
+		return mrtp_packet_create(data, dataLength, flags);
+
+	if (pool->freePackets[poolClass] == NULL && mrtp_packet_pool_grow(pool, poolClass) < 0)
+		return NULL;
+
+	packet = pool->freePackets[poolClass];
+	pool->freePackets[poolClass] = (MRtpPacket *)packet->data;
+	++pool->usedPackets;
+
+	mrtp_packet_init(packet, data, dataLength, flags);
+
+	return packet;
+}
+
+static void mrtp_packet_pool_release(MRtpPacketPool * pool, MRtpPacket * packet) {
+
+	size_t poolClass = mrtp_packet_pool_class(packet->capacity);
+
+	packet->data = (mrtp_uint8 *)pool->freePackets[poolClass];
+	pool->freePackets[poolClass] = packet;
+	--pool->usedPackets;
+
+	if (pool->destroyed && pool->usedPackets == 0)
+		mrtp_packet_pool_free(pool);
+}
+
+// a packet whose data stays in the receive slab it came in, the slab is kept until the packet is destroyed
+MRtpPacket * mrtp_packet_pool_reference(MRtpPacketPool * pool, MRtpReceiveSlab * slab, const void * data, size_t dataLength, mrtp_uint32 flags) {
+
+	MRtpPacket * packet = mrtp_packet_pool_acquire(pool, NULL, 0, flags);
+	if (packet == NULL)
+		return NULL;
+
+	packet->data = (mrtp_uint8 *)data;
+	packet->dataLength = dataLength;
+	packet->slab = slab;
+	++slab->referenceCount;
+
+	return packet;
+}
+
 void mrtp_packet_destroy(MRtpPacket * packet) {
 	if (packet == NULL)
 		return;
 	if (packet->freeCallback != NULL)
 		(*packet->freeCallback) (packet);
-	if (!(packet->flags & MRTP_PACKET_FLAG_NO_ALLOCATE) &&
-		packet->data != NULL)
+	if (packet->slab != NULL)
+		mrtp_receive_slab_release(packet->slab);
+	// data that outgrew its block was allocated on its own
+	else if (!(packet->flags & MRTP_PACKET_FLAG_NO_ALLOCATE) &&
+		packet->data != NULL && packet->data != MRTP_PACKET_BLOCK_DATA(packet))
 		mrtp_free(packet->data);
-	mrtp_free(packet);
+	if (packet->pool != NULL)
+		mrtp_packet_pool_release(packet->pool, packet);
+	else
+		mrtp_free(packet);
+}
+
+MRtpReceiveSlabPool * mrtp_receive_slab_pool_create(size_t slabSize) {
+
+	MRtpReceiveSlabPool * pool = (MRtpReceiveSlabPool *)mrtp_malloc(sizeof(MRtpReceiveSlabPool));
+	if (pool == NULL)
+		return NULL;
+
+	memset(pool, 0, sizeof(MRtpReceiveSlabPool));
+	pool->slabSize = slabSize;
+
+	return pool;
 }
 
+static void mrtp_receive_slab_pool_trim(MRtpReceiveSlabPool * pool) {
+
+	while (pool->freeSlabs != NULL) {
+		MRtpReceiveSlab * slab = pool->freeSlabs;
+
+		pool->freeSlabs = slab->next;
+		mrtp_free(slab);
+	}
+
+	pool->freeCount = 0;
+}
+
+// slabs still referenced by packets keep the pool alive, it is freed with the last of them
+void mrtp_receive_slab_pool_destroy(MRtpReceiveSlabPool * pool) {
+
+	if (pool == NULL)
+		return;
+
+	mrtp_receive_slab_pool_trim(pool);
+	pool->destroyed = 1;
+
+	if (pool->usedSlabs == 0)
+		mrtp_free(pool);
+}
+
+// slabs of the old size are freed as they come back
+void mrtp_receive_slab_pool_resize(MRtpReceiveSlabPool * pool, size_t slabSize) {
+
+	if (slabSize == pool->slabSize)
+		return;
+
+	mrtp_receive_slab_pool_trim(pool);
+	pool->slabSize = slabSize;
+}
+
+// take a slab to receive into, the caller holds its first reference
+MRtpReceiveSlab * mrtp_receive_slab_acquire(MRtpReceiveSlabPool * pool) {
+
+	MRtpReceiveSlab * slab = pool->freeSlabs;
+
+	if (slab != NULL) {
+		pool->freeSlabs = slab->next;
+		--pool->freeCount;
+	}
+	else {
+		slab = (MRtpReceiveSlab *)mrtp_malloc(sizeof(MRtpReceiveSlab) + pool->slabSize);
+		if (slab == NULL)
+			return NULL;
+
+		slab->pool = pool;
+		slab->size = pool->slabSize;
+	}
+
+	slab->referenceCount = 1;
+	slab->next = NULL;
+	++pool->usedSlabs;
+
+	return slab;
+}
+
+void mrtp_receive_slab_release(MRtpReceiveSlab * slab) {
+
+	MRtpReceiveSlabPool * pool = slab->pool;
+
+	if (--slab->referenceCount > 0)
+		return;
+
+	--pool->usedSlabs;
+
+	if (pool->destroyed || slab->size != pool->slabSize || pool->freeCount >= MRTP_HOST_FREE_RECEIVE_SLABS) {
+		mrtp_free(slab);
+
+		if (pool->destroyed && pool->usedSlabs == 0)
+			mrtp_free(pool);
+
+		return;
+	}
+
+	slab->next = pool->freeSlabs;
+	pool->freeSlabs = slab;
+	++pool->freeCount;
+}
@@ -1,9 +1,22 @@
-﻿#include <string.h>
+﻿#include <stddef.h>
+#include <string.h>
+#include "time.h"
 #include "mrtp.h"
 
 extern mrtp_uint8 channelIDs[];
 extern char* commandName[];
 
+// the state and address of a peer are mirrored in its host slot, so they are only written through these
+void mrtp_peer_set_state(MRtpPeer * peer, MRtpPeerState state) {
+	peer->state = state;
+	peer->host->peerSlots[peer->incomingPeerID].state = state;
+}
+
+void mrtp_peer_set_address(MRtpPeer * peer, const MRtpAddress * address) {
+	peer->address = *address;
+	peer->host->peerSlots[peer->incomingPeerID].address = *address;
+}
+
 void mrtp_peer_on_disconnect(MRtpPeer * peer) {
 
 	if (peer->state == MRTP_PEER_STATE_CONNECTED || peer->state == MRTP_PEER_STATE_DISCONNECT_LATER) {
@@ -25,8 +38,123 @@ void mrtp_peer_on_connect(MRtpPeer * peer) {
 	}
 }
 
-static void mrtp_peer_remove_incoming_commands(MRtpList * queue, MRtpListIterator startCommand,
-	MRtpListIterator endCommand) {
+#define MRTP_REASSEMBLY_COMMAND(iterator) ((MRtpIncomingCommand *)((mrtp_uint8 *)(iterator) - offsetof(MRtpIncomingCommand, reassemblyList)))
+
+// the message of the command has all its fragments, or is dropped, it no longer counts against the reassembly caps
+void mrtp_peer_finish_reassembly(MRtpIncomingCommand * incomingCommand) {
+
+	MRtpPeer * peer = incomingCommand->peer;
+
+	if (incomingCommand->reassemblyList.next == NULL)
+		return;
+
+	mrtp_list_remove(&incomingCommand->reassemblyList);
+	incomingCommand->reassemblyList.next = NULL;
+
+	peer->reassemblyData -= incomingCommand->packet->dataLength;
+	peer->host->reassemblyData -= incomingCommand->packet->dataLength;
+
+	// the data is charged as waiting to be delivered from now on
+	peer->host->memory.used[MRTP_MEMORY_REASSEMBLY] -= incomingCommand->packet->dataLength;
+	peer->host->memory.used[MRTP_MEMORY_PACKETS] += incomingCommand->packet->dataLength;
+}
+
+static void mrtp_peer_free_incoming_command(MRtpIncomingCommand * incomingCommand) {
+
+	MRtpPeer * peer = incomingCommand->peer;
+
+	if (incomingCommand->fragments != NULL && incomingCommand->fragments != incomingCommand->inlineFragments)
+		mrtp_arena_free(&peer->host->memory, &peer->memoryUsed, MRTP_MEMORY_REASSEMBLY,
+			incomingCommand->fragments, (incomingCommand->fragmentCount + 31) / 32 * sizeof(mrtp_uint32));
+
+	mrtp_arena_free(&peer->host->memory, &peer->memoryUsed, MRTP_MEMORY_COMMANDS, incomingCommand, sizeof(MRtpIncomingCommand));
+}
+
+// the command waiting with the sequence number, NULL if there is none
+MRtpIncomingCommand * mrtp_peer_find_incoming_command(MRtpChannel * channel, mrtp_uint16 sequenceNumber) {
+
+	MRtpIncomingCommandRing * ring = &channel->reorderBuffer;
+	MRtpIncomingCommand * incomingCommand;
+
+	if (ring->count == 0)
+		return NULL;
+
+	incomingCommand = ring->commands[sequenceNumber & (ring->capacity - 1)];
+	if (incomingCommand == NULL || incomingCommand->sequenceNumber != sequenceNumber)
+		return NULL;
+
+	return incomingCommand;
+}
+
+// make room for a command with the sequence number, the commands waiting all lie ahead of the incoming
+// sequence number within the free windows, so a ring spanning that distance keeps them apart
+// return -1 if it can't grow
+static int mrtp_peer_reserve_reorder_buffer(MRtpPeer * peer, MRtpChannel * channel, mrtp_uint16 sequenceNumber) {
+
+	MRtpIncomingCommandRing * ring = &channel->reorderBuffer;
+	size_t span = (mrtp_uint16)(sequenceNumber - channel->incomingSequenceNumber);
+	size_t capacity = ring->capacity > 0 ? ring->capacity : (size_t)MRTP_PEER_REORDER_COMMANDS;
+	MRtpIncomingCommand ** commands;
+	size_t i;
+
+	if (span < ring->capacity)
+		return 0;
+
+	while (capacity <= span)
+		capacity *= 2;
+
+	if (capacity > MRTP_PEER_MAXIMUM_REORDER_COMMANDS)
+		return -1;
+
+	commands = (MRtpIncomingCommand **)mrtp_arena_malloc(&peer->host->memory, &peer->memoryUsed,
+		MRTP_MEMORY_COMMANDS, capacity * sizeof(MRtpIncomingCommand *));
+	if (commands == NULL)
+		return -1;
+	memset(commands, 0, capacity * sizeof(MRtpIncomingCommand *));
+
+	for (i = 0; i < ring->capacity; ++i) {
+		if (ring->commands[i] != NULL)
+			commands[ring->commands[i]->sequenceNumber & (capacity - 1)] = ring->commands[i];
+	}
+
+	if (ring->commands != NULL)
+		mrtp_arena_free(&peer->host->memory, &peer->memoryUsed, MRTP_MEMORY_COMMANDS,
+			ring->commands, ring->capacity * sizeof(MRtpIncomingCommand *));
+
+	ring->commands = commands;
+	ring->capacity = capacity;
+
+	return 0;
+}
+
+// the command leaves the reorder buffer of its channel when it is dispatched or dropped
+static void mrtp_peer_unindex_incoming_command(MRtpPeer * peer, MRtpIncomingCommand * incomingCommand) {
+
+	mrtp_uint8 channelID = channelIDs[incomingCommand->command.header.command & MRTP_PROTOCOL_COMMAND_MASK];
+	MRtpIncomingCommandRing * ring;
+
+	if (channelID >= peer->channelCount)
+		return;
+
+	ring = &peer->channels[channelID].reorderBuffer;
+	if (ring->count > 0 && ring->commands[incomingCommand->sequenceNumber & (ring->capacity - 1)] == incomingCommand) {
+		ring->commands[incomingCommand->sequenceNumber & (ring->capacity - 1)] = NULL;
+		--ring->count;
+	}
+}
+
+static void mrtp_peer_free_reorder_buffer(MRtpPeer * peer, MRtpIncomingCommandRing * ring) {
+
+	if (ring->commands != NULL)
+		mrtp_arena_free(&peer->host->memory, &peer->memoryUsed, MRTP_MEMORY_COMMANDS,
+			ring->commands, ring->capacity * sizeof(MRtpIncomingCommand *));
+
+	memset(ring, 0, sizeof(MRtpIncomingCommandRing));
+}
+
+// remove the commands from startCommand up to endCommand, except excludeCommand which the caller still uses
+static void mrtp_peer_remove_incoming_commands(MRtpPeer * peer, MRtpListIterator startCommand,
+	MRtpListIterator endCommand, MRtpIncomingCommand * excludeCommand) {
 
 	MRtpListIterator currentCommand;
 
@@ -36,27 +164,132 @@ static void mrtp_peer_remove_incoming_commands(MRtpList * queue, MRtpListIterato
 
 		currentCommand = mrtp_list_next(currentCommand);
 
+		if (incomingCommand == excludeCommand)
+			continue;
+
 		mrtp_list_remove(&incomingCommand->incomingCommandList);
+		mrtp_peer_unindex_incoming_command(peer, incomingCommand);
+		mrtp_peer_finish_reassembly(incomingCommand);
 
 		if (incomingCommand->packet != NULL) {
 			--incomingCommand->packet->referenceCount;
+			peer->totalWaitingData -= incomingCommand->packet->dataLength;
+			mrtp_arena_release(&peer->host->memory, &peer->memoryUsed, MRTP_MEMORY_PACKETS, incomingCommand->packet->dataLength);
 			// if there is no command to use this packet, then delete packet
 			if (incomingCommand->packet->referenceCount == 0)
 				mrtp_packet_destroy(incomingCommand->packet);
 		}
 
-		if (incomingCommand->fragments != NULL)
-			mrtp_free(incomingCommand->fragments);
+		mrtp_peer_free_incoming_command(incomingCommand);
+	}
+}
+
+static void mrtp_peer_reset_incoming_commands(MRtpPeer * peer, MRtpList * queue) {
+	mrtp_peer_remove_incoming_commands(peer, mrtp_list_begin(queue), mrtp_list_end(queue), NULL);
+}
+
+// unreliable messages missing fragments may be dropped, the reliable ones were acknowledged fragment by fragment
+static int mrtp_peer_reassembly_evictable(const MRtpIncomingCommand * incomingCommand) {
+
+	switch (incomingCommand->command.header.command & MRTP_PROTOCOL_COMMAND_MASK) {
+	case MRTP_PROTOCOL_COMMAND_SEND_UNSEQUENCED_FRAGMENT:
+	case MRTP_PROTOCOL_COMMAND_SEND_REDUNDANCY_FRAGEMENT_NO_ACK:
+		return 1;
+
+	default:
+		return 0;
+	}
+}
+
+// the message of the command has all its fragments, a message reassembled in the reassembly pool is moved
+// to a packet of its own, the packets handed out follow the packet pool setting of the host
+// the pool isn't locked, with the packet pool off the application may destroy its packets on any thread,
+// so the message is copied out, mrtp_host_packet_pool hands out the reassembled block itself
+void mrtp_peer_complete_reassembly(MRtpIncomingCommand * incomingCommand) {
+
+	MRtpHost * host = incomingCommand->peer->host;
+	MRtpPacket * packet = incomingCommand->packet;
+
+	mrtp_peer_finish_reassembly(incomingCommand);
+
+	if (packet->pool != NULL && packet->pool == host->reassemblyPool) {
+		// if it can't be allocated, the message is delivered from the reassembly pool
+		MRtpPacket * ownPacket = mrtp_packet_create(packet->data, packet->dataLength, packet->flags);
+		if (ownPacket != NULL) {
+			ownPacket->referenceCount = packet->referenceCount;
+			incomingCommand->packet = ownPacket;
+			mrtp_packet_destroy(packet);
+		}
+	}
+}
+
+// drop the unreliable messages of the host that are still missing fragments after the reassembly timeout
+void mrtp_peer_evict_stale_reassemblies(MRtpHost * host) {
+
+	MRtpListIterator currentReassembly, nextReassembly;
+
+	for (currentReassembly = mrtp_list_begin(&host->reassemblies);
+		currentReassembly != mrtp_list_end(&host->reassemblies);
+		currentReassembly = nextReassembly)
+	{
+		MRtpIncomingCommand * incomingCommand = MRTP_REASSEMBLY_COMMAND(currentReassembly);
+
+		nextReassembly = mrtp_list_next(currentReassembly);
 
-		mrtp_free(incomingCommand);
+		// the list is oldest first
+		if (MRTP_TIME_DIFFERENCE(host->serviceTime, incomingCommand->reassemblyTime) < MRTP_PEER_REASSEMBLY_TIMEOUT)
+			break;
+
+		if (mrtp_peer_reassembly_evictable(incomingCommand))
+			mrtp_peer_remove_incoming_commands(incomingCommand->peer, &incomingCommand->incomingCommandList,
+				mrtp_list_next(&incomingCommand->incomingCommandList), NULL);
 	}
 }
 
-static void mrtp_peer_reset_incoming_commands(MRtpList * queue) {
-	mrtp_peer_remove_incoming_commands(queue, mrtp_list_begin(queue), mrtp_list_end(queue));
+// make room for a new message of the peer that is missing fragments, the stale unreliable messages of the host
+// are evicted, then the oldest unreliable ones while the new message would exceed a cap or a memory budget
+// return -1 if it still doesn't fit
+int mrtp_peer_reserve_reassembly(MRtpPeer * peer, size_t dataLength) {
+
+	MRtpHost * host = peer->host;
+	MRtpListIterator currentReassembly, nextReassembly;
+
+	for (currentReassembly = mrtp_list_begin(&host->reassemblies);
+		currentReassembly != mrtp_list_end(&host->reassemblies);
+		currentReassembly = nextReassembly)
+	{
+		MRtpIncomingCommand * incomingCommand = MRTP_REASSEMBLY_COMMAND(currentReassembly);
+		MRtpPeer * reassemblyPeer = incomingCommand->peer;
+		int hostFull = (host->maximumReassemblyData != 0 && host->reassemblyData + dataLength > host->maximumReassemblyData) ||
+			(host->memory.budget != 0 && host->memory.totalUsed + dataLength > host->memory.budget);
+		int peerFull = (host->maximumPeerReassemblyData != 0 && peer->reassemblyData + dataLength > host->maximumPeerReassemblyData) ||
+			(host->memory.peerBudget != 0 && peer->memoryUsed + dataLength > host->memory.peerBudget);
+
+		nextReassembly = mrtp_list_next(currentReassembly);
+
+		// the list is oldest first, past the stale messages only a full cap evicts more
+		if (MRTP_TIME_DIFFERENCE(host->serviceTime, incomingCommand->reassemblyTime) < MRTP_PEER_REASSEMBLY_TIMEOUT) {
+			if (!hostFull && !peerFull)
+				break;
+			if (!hostFull && reassemblyPeer != peer)
+				continue;
+		}
+
+		if (!mrtp_peer_reassembly_evictable(incomingCommand))
+			continue;
+
+		mrtp_peer_remove_incoming_commands(reassemblyPeer, &incomingCommand->incomingCommandList,
+			mrtp_list_next(&incomingCommand->incomingCommandList), NULL);
+	}
+
+	if ((host->maximumReassemblyData != 0 && host->reassemblyData + dataLength > host->maximumReassemblyData) ||
+		(host->maximumPeerReassemblyData != 0 && peer->reassemblyData + dataLength > host->maximumPeerReassemblyData))
+		return -1;
+
+	return 0;
 }
 
-static void mrtp_peer_reset_outgoing_commands(MRtpList * queue) {
+static void mrtp_peer_reset_outgoing_commands(MRtpPeer * peer, MRtpList * queue) {
 	MRtpOutgoingCommand * outgoingCommand;
 
 	while (!mrtp_list_empty(queue)) {
@@ -69,10 +302,52 @@ static void mrtp_peer_reset_outgoing_commands(MRtpList * queue) {
 				mrtp_packet_destroy(outgoingCommand->packet);
 		}
 
-		mrtp_free(outgoingCommand);
+		mrtp_object_pool_release(&peer->host->outgoingCommandPool, outgoingCommand);
 	}
 }
 
+static void mrtp_peer_free_acknowledgements(MRtpPeer * peer, MRtpAcknowledgementRing * ring) {
+
+	if (ring->acknowledgements != NULL)
+		mrtp_arena_free(&peer->host->memory, &peer->memoryUsed, MRTP_MEMORY_ACKNOWLEDGEMENTS,
+			ring->acknowledgements, ring->capacity * sizeof(MRtpAcknowledgement));
+
+	memset(ring, 0, sizeof(MRtpAcknowledgementRing));
+}
+
+static void mrtp_peer_clear_sent_commands(MRtpSentCommandRing * ring) {
+
+	if (ring->commands != NULL)
+		memset(ring->commands, 0, ring->capacity * sizeof(MRtpOutgoingCommand *));
+
+	ring->first = ring->last = 0;
+	ring->count = 0;
+}
+
+static void mrtp_peer_free_sent_commands(MRtpPeer * peer, MRtpSentCommandRing * ring) {
+
+	if (ring->commands != NULL)
+		mrtp_arena_free(&peer->host->memory, &peer->memoryUsed, MRTP_MEMORY_COMMANDS,
+			ring->commands, ring->capacity * sizeof(MRtpOutgoingCommand *));
+
+	memset(ring, 0, sizeof(MRtpSentCommandRing));
+}
+
+// the noack buffers are allocated again by the next connection
+static void mrtp_peer_free_redundancy_noack_buffers(MRtpPeer * peer) {
+
+	if (peer->redundancyNoAckBuffers != NULL) {
+		for (size_t i = 0; i < peer->redundancyNum + 1; ++i)
+			mrtp_protocol_remove_redundancy_buffer_commands(peer->host, &peer->redundancyNoAckBuffers[i]);
+
+		mrtp_free(peer->redundancyNoAckBuffers);
+		peer->redundancyNoAckBuffers = NULL;
+	}
+
+	peer->redundancyNum = 0;
+	peer->currentRedundancyNoAckBufferNum = 0;
+}
+
 void mrtp_peer_reset_queues(MRtpPeer * peer) {
 	MRtpChannel * channel;
 
@@ -82,31 +357,36 @@ void mrtp_peer_reset_queues(MRtpPeer * peer) {
 		peer->needsDispatch = 0;
 	}
 
-	while (!mrtp_list_empty(&peer->acknowledgements))
-		mrtp_free(mrtp_list_remove(mrtp_list_begin(&peer->acknowledgements)));
+	if (peer->needsSend) {
+		mrtp_list_remove(&peer->sendList);
+
+		peer->needsSend = 0;
+	}
 
-	while (!mrtp_list_empty(&peer->redundancyAcknowledgemets))
-		mrtp_free(mrtp_list_remove(mrtp_list_begin(&peer->redundancyAcknowledgemets)));
+	// the rings keep their storage until the peer is reset
+	peer->acknowledgements.first = peer->acknowledgements.count = 0;
+	peer->redundancyAcknowledgemets.first = peer->redundancyAcknowledgemets.count = 0;
+	mrtp_peer_clear_sent_commands(&peer->sentSystemCommands);
 
-	mrtp_peer_reset_outgoing_commands(&peer->sentReliableCommands);
-	mrtp_peer_reset_outgoing_commands(&peer->sentRedundancyNoAckCommands);
-	mrtp_peer_reset_outgoing_commands(&peer->outgoingReliableCommands);
-	mrtp_peer_reset_outgoing_commands(&peer->outgoingRedundancyCommands);
-	mrtp_peer_reset_outgoing_commands(&peer->outgoingRedundancyNoAckCommands);
-	mrtp_peer_reset_outgoing_commands(&peer->sentRedundancyLastTimeCommands);
-	mrtp_peer_reset_outgoing_commands(&peer->sentRedundancyThisTimeCommands);
-	mrtp_peer_reset_outgoing_commands(&peer->outgoingUnsequencedCommands);
-	mrtp_peer_reset_outgoing_commands(&peer->sentUnsequencedCommands);
-	mrtp_peer_reset_incoming_commands(&peer->dispatchedCommands);
+	mrtp_peer_reset_outgoing_commands(peer, &peer->sentReliableCommands);
+	mrtp_peer_reset_outgoing_commands(peer, &peer->sentRedundancyNoAckCommands);
+	mrtp_peer_reset_outgoing_commands(peer, &peer->outgoingReliableCommands);
+	mrtp_peer_reset_outgoing_commands(peer, &peer->outgoingRedundancyCommands);
+	mrtp_peer_reset_outgoing_commands(peer, &peer->outgoingRedundancyNoAckCommands);
+	mrtp_peer_reset_outgoing_commands(peer, &peer->sentRedundancyCommands);
+	mrtp_peer_reset_outgoing_commands(peer, &peer->outgoingUnsequencedCommands);
+	mrtp_peer_reset_outgoing_commands(peer, &peer->sentUnsequencedCommands);
+	mrtp_peer_reset_incoming_commands(peer, &peer->dispatchedCommands);
 
 
 	for (channel = peer->channels; channel < &peer->channels[peer->channelCount]; ++channel) {
-		mrtp_peer_reset_incoming_commands(&channel->incomingCommands);
+		mrtp_peer_reset_incoming_commands(peer, &channel->incomingCommands);
 		channel->outgoingSequenceNumber = 0;
 		channel->incomingSequenceNumber = 0;
 
 		channel->usedWindows = 0;
 		memset(channel->commandWindows, 0, sizeof(channel->commandWindows));
+		mrtp_peer_clear_sent_commands(&channel->sentCommands);
 	}
 
 }
@@ -118,7 +398,7 @@ void mrtp_peer_reset(MRtpPeer * peer) {
 	peer->outgoingPeerID = MRTP_PROTOCOL_MAXIMUM_PEER_ID;
 	peer->connectID = 0;
 
-	peer->state = MRTP_PEER_STATE_DISCONNECTED;
+	mrtp_peer_set_state(peer, MRTP_PEER_STATE_DISCONNECTED);
 
 	peer->incomingBandwidth = 0;
 	peer->outgoingBandwidth = 0;
@@ -130,6 +410,8 @@ void mrtp_peer_reset(MRtpPeer * peer) {
 	peer->lastReceiveTime = 0;
 	peer->nextTimeout = 0;
 	peer->earliestTimeout = 0;
+	mrtp_timer_wheel_cancel(&peer->host->timers, &peer->timeoutTimer);
+	peer->timeoutsDue = 0;
 	peer->packetThrottle = MRTP_PEER_DEFAULT_PACKET_THROTTLE;
 	peer->packetThrottleLimit = MRTP_PEER_PACKET_THROTTLE_SCALE;
 	peer->packetThrottleCounter = 0;
@@ -149,24 +431,38 @@ void mrtp_peer_reset(MRtpPeer * peer) {
 	peer->roundTripTimeVariance = 0;
 	peer->mtu = peer->host->mtu;
 	peer->reliableDataInTransit = 0;
+	peer->pacingRate = 0;
+	peer->pacingTime = 0;
 	peer->outgoingReliableSequenceNumber = 0;
 	peer->windowSize = MRTP_PROTOCOL_MAXIMUM_WINDOW_SIZE;
 	peer->totalWaitingData = 0;
+	peer->reassemblyData = 0;
 	peer->quickRetransmitNum = MRTP_PROTOCOL_DEFAULT_QUICK_RETRANSMIT;
 
 	peer->redundancyLastSentTimeStamp = 0;
 
 	peer->sendRedundancyAfterReceive = TRUE;
-	peer->sentRedundancyLastTimeSize = 0;
-	peer->sentRedundancyThisTimeSize = 0;
+	peer->sentRedundancySize = 0;
+	peer->redundancySendEpoch = 0;
+	peer->redundancyResendSequenceNumber = 0;
 
 	mrtp_peer_reset_queues(peer);
+
+	// release the per-connection storage, an idle slot only keeps its peer struct
+	mrtp_peer_free_acknowledgements(peer, &peer->acknowledgements);
+	mrtp_peer_free_acknowledgements(peer, &peer->redundancyAcknowledgemets);
+	mrtp_peer_free_redundancy_noack_buffers(peer);
+	mrtp_peer_free_sent_commands(peer, &peer->sentSystemCommands);
+	for (size_t i = 0; i < peer->channelCount; ++i) {
+		mrtp_peer_free_sent_commands(peer, &peer->channels[i].sentCommands);
+		mrtp_peer_free_reorder_buffer(peer, &peer->channels[i].reorderBuffer);
+	}
 }
 
 MRtpOutgoingCommand * mrtp_peer_queue_outgoing_command(MRtpPeer * peer, const MRtpProtocol * command,
 	MRtpPacket * packet, mrtp_uint32 offset, mrtp_uint16 length) {
 
-	MRtpOutgoingCommand * outgoingCommand = (MRtpOutgoingCommand *)mrtp_malloc(sizeof(MRtpOutgoingCommand));
+	MRtpOutgoingCommand * outgoingCommand = (MRtpOutgoingCommand *)mrtp_object_pool_acquire(&peer->host->outgoingCommandPool);
 	if (outgoingCommand == NULL)
 		return NULL;
 
@@ -215,9 +511,11 @@ void mrtp_peer_setup_outgoing_command(MRtpPeer * peer, MRtpOutgoingCommand * out
 
 	outgoingCommand->sendAttempts = 0;
 	outgoingCommand->sentTime = 0;
+	outgoingCommand->sentEpoch = 0;
 	outgoingCommand->roundTripTimeout = 0;
 	outgoingCommand->roundTripTimeoutLimit = 0;
 	outgoingCommand->fastAck = 0;
+	outgoingCommand->inTransit = 0;
 	outgoingCommand->redundancyBufferNum = 0xFFFF;
 	outgoingCommand->command.header.sequenceNumber = MRTP_HOST_TO_NET_16(outgoingCommand->sequenceNumber);
 
@@ -238,6 +536,18 @@ void mrtp_peer_setup_outgoing_command(MRtpPeer * peer, MRtpOutgoingCommand * out
 		}
 		mrtp_list_insert(mrtp_list_end(&peer->outgoingUnsequencedCommands), outgoingCommand);
 	}
+
+	mrtp_peer_queue_send(peer);
+}
+
+// let the next send pass of the host visit the peer, it stays queued until it has nothing left to send
+void mrtp_peer_queue_send(MRtpPeer * peer) {
+
+	if (!peer->needsSend) {
+		mrtp_list_insert(mrtp_list_end(&peer->host->sendQueue), &peer->sendList);
+
+		peer->needsSend = 1;
+	}
 }
 
 void mrtp_peer_ping(MRtpPeer * peer) {
@@ -252,6 +562,125 @@ void mrtp_peer_ping(MRtpPeer * peer) {
 	mrtp_peer_queue_outgoing_command(peer, &command, NULL, 0, 0);
 }
 
+// the free entry at the end of an acknowledgement ring, a full ring doubles up to MRTP_PEER_MAXIMUM_ACKNOWLEDGEMENTS
+// past that NULL is returned, the acknowledgement is dropped and the sender resends the command as if it was lost
+static MRtpAcknowledgement * mrtp_peer_push_acknowledgement(MRtpPeer * peer, MRtpAcknowledgementRing * ring) {
+
+	if (ring->count >= ring->capacity) {
+		size_t capacity = ring->capacity > 0 ? 2 * ring->capacity : (size_t)MRTP_PEER_ACKNOWLEDGEMENTS;
+		MRtpAcknowledgement * acknowledgements;
+		size_t i;
+
+		if (capacity > MRTP_PEER_MAXIMUM_ACKNOWLEDGEMENTS)
+			return NULL;
+
+		acknowledgements = (MRtpAcknowledgement *)mrtp_arena_malloc(&peer->host->memory, &peer->memoryUsed,
+			MRTP_MEMORY_ACKNOWLEDGEMENTS, capacity * sizeof(MRtpAcknowledgement));
+		if (acknowledgements == NULL)
+			return NULL;
+
+		for (i = 0; i < ring->count; ++i)
+			acknowledgements[i] = ring->acknowledgements[(ring->first + i) & (ring->capacity - 1)];
+
+		if (ring->acknowledgements != NULL)
+			mrtp_arena_free(&peer->host->memory, &peer->memoryUsed, MRTP_MEMORY_ACKNOWLEDGEMENTS,
+				ring->acknowledgements, ring->capacity * sizeof(MRtpAcknowledgement));
+
+		ring->acknowledgements = acknowledgements;
+		ring->capacity = capacity;
+		ring->first = 0;
+	}
+
+	return &ring->acknowledgements[(ring->first + ring->count++) & (ring->capacity - 1)];
+}
+
+// the ring a sent reliable command is indexed in, system commands have no channel
+MRtpSentCommandRing * mrtp_peer_sent_command_ring(MRtpPeer * peer, mrtp_uint8 channelID) {
+	return channelID < peer->channelCount ? &peer->channels[channelID].sentCommands : &peer->sentSystemCommands;
+}
+
+// index a reliable command the first time it is sent, the ring doubles to span every sequence number in flight
+// return -1 if it can't grow, the command then waits on the outgoing queue
+int mrtp_peer_insert_sent_command(MRtpPeer * peer, MRtpOutgoingCommand * outgoingCommand) {
+
+	MRtpSentCommandRing * ring = mrtp_peer_sent_command_ring(peer,
+		channelIDs[outgoingCommand->command.header.command & MRTP_PROTOCOL_COMMAND_MASK]);
+	mrtp_uint16 sequenceNumber = outgoingCommand->sequenceNumber;
+	mrtp_uint16 first = ring->first, last = ring->last;
+	size_t span;
+
+	if (ring->count == 0)
+		first = last = sequenceNumber;
+
+	// a command held back by the window may go out after a later one, the ring reaches back to it then
+	if ((mrtp_uint16)(first - sequenceNumber) != 0 && (mrtp_uint16)(first - sequenceNumber) < 0x8000)
+		first = sequenceNumber;
+	else if ((mrtp_uint16)(sequenceNumber - first) >= (mrtp_uint16)(last - first))
+		last = sequenceNumber + 1;
+
+	span = (size_t)(mrtp_uint16)(last - first - 1) + 1;
+
+	if (span > ring->capacity) {
+		size_t capacity = ring->capacity > 0 ? ring->capacity : (size_t)MRTP_PEER_SENT_COMMANDS;
+		MRtpOutgoingCommand ** commands;
+		mrtp_uint16 i;
+
+		while (capacity < span)
+			capacity *= 2;
+
+		if (capacity > MRTP_PEER_MAXIMUM_SENT_COMMANDS)
+			return -1;
+
+		commands = (MRtpOutgoingCommand **)mrtp_arena_malloc(&peer->host->memory, &peer->memoryUsed,
+			MRTP_MEMORY_COMMANDS, capacity * sizeof(MRtpOutgoingCommand *));
+		if (commands == NULL)
+			return -1;
+		memset(commands, 0, capacity * sizeof(MRtpOutgoingCommand *));
+
+		if (ring->count > 0) {
+			for (i = ring->first; i != ring->last; ++i)
+				commands[i & (capacity - 1)] = ring->commands[i & (ring->capacity - 1)];
+		}
+
+		if (ring->commands != NULL)
+			mrtp_arena_free(&peer->host->memory, &peer->memoryUsed, MRTP_MEMORY_COMMANDS,
+				ring->commands, ring->capacity * sizeof(MRtpOutgoingCommand *));
+
+		ring->commands = commands;
+		ring->capacity = capacity;
+	}
+
+	ring->commands[sequenceNumber & (ring->capacity - 1)] = outgoingCommand;
+	ring->first = first;
+	ring->last = last;
+	++ring->count;
+
+	return 0;
+}
+
+// the command in flight with the sequence number, NULL if it was acknowledged already or never sent
+MRtpOutgoingCommand * mrtp_peer_find_sent_command(MRtpSentCommandRing * ring, mrtp_uint16 sequenceNumber) {
+
+	if (ring->count == 0 || (mrtp_uint16)(sequenceNumber - ring->first) >= (mrtp_uint16)(ring->last - ring->first))
+		return NULL;
+
+	return ring->commands[sequenceNumber & (ring->capacity - 1)];
+}
+
+// drop an acknowledged command, the oldest sequence number moves past the ones acknowledged out of order
+void mrtp_peer_remove_sent_command(MRtpSentCommandRing * ring, mrtp_uint16 sequenceNumber) {
+
+	ring->commands[sequenceNumber & (ring->capacity - 1)] = NULL;
+
+	if (--ring->count == 0) {
+		ring->first = ring->last;
+		return;
+	}
+
+	while (ring->commands[ring->first & (ring->capacity - 1)] == NULL)
+		++ring->first;
+}
+
 MRtpAcknowledgement * mrtp_peer_queue_acknowledgement(MRtpPeer * peer, const MRtpProtocol * command,
 	mrtp_uint16 sentTime)
 {
@@ -270,16 +699,14 @@ MRtpAcknowledgement * mrtp_peer_queue_acknowledgement(MRtpPeer * peer, const MRt
 			return NULL;
 	}
 
-	acknowledgement = (MRtpAcknowledgement *)mrtp_malloc(sizeof(MRtpAcknowledgement));
+	acknowledgement = mrtp_peer_push_acknowledgement(peer, &peer->acknowledgements);
 	if (acknowledgement == NULL)
 		return NULL;
 
 	peer->outgoingDataTotal += sizeof(MRtpProtocolAcknowledge);
 
 	acknowledgement->sentTime = sentTime;
-	acknowledgement->command = *command;
-
-	mrtp_list_insert(mrtp_list_end(&peer->acknowledgements), acknowledgement);
+	acknowledgement->command = command->header;
 
 	return acknowledgement;
 }
@@ -293,16 +720,14 @@ MRtpAcknowledgement * mrtp_peer_queue_redundancy_acknowldegement(MRtpPeer* peer,
 	//if (sequenceNumber >= nextRedundancyNumber - 1) {
 	MRtpAcknowledgement * acknowledgement;
 
-	acknowledgement = (MRtpAcknowledgement *)mrtp_malloc(sizeof(MRtpAcknowledgement));
+	acknowledgement = mrtp_peer_push_acknowledgement(peer, &peer->redundancyAcknowledgemets);
 	if (acknowledgement == NULL)
 		return NULL;
 
 	peer->outgoingDataTotal += sizeof(MRtpProtocolRedundancyAcknowledge);
 
 	acknowledgement->sentTime = sentTime;
-	acknowledgement->command = *command;
-
-	mrtp_list_insert(mrtp_list_end(&peer->redundancyAcknowledgemets), acknowledgement);
+	acknowledgement->command = command->header;
 
 	return acknowledgement;
 	//}
@@ -356,7 +781,7 @@ void mrtp_peer_disconnect(MRtpPeer * peer) {
 	if (peer->state == MRTP_PEER_STATE_CONNECTED || peer->state == MRTP_PEER_STATE_DISCONNECT_LATER) {
 		mrtp_peer_on_disconnect(peer);
 
-		peer->state = MRTP_PEER_STATE_DISCONNECTING;
+		mrtp_peer_set_state(peer, MRTP_PEER_STATE_DISCONNECTING);
 	}
 	else {
 		mrtp_host_flush(peer->host);
@@ -368,7 +793,7 @@ void mrtp_peer_disconnect_later(MRtpPeer * peer) {
 	if ((peer->state == MRTP_PEER_STATE_CONNECTED || peer->state == MRTP_PEER_STATE_DISCONNECT_LATER) &&
 		!(mrtp_list_empty(&peer->outgoingReliableCommands) && mrtp_list_empty(&peer->sentReliableCommands)))
 	{
-		peer->state = MRTP_PEER_STATE_DISCONNECT_LATER;
+		mrtp_peer_set_state(peer, MRTP_PEER_STATE_DISCONNECT_LATER);
 	}
 	else
 		mrtp_peer_disconnect(peer);
@@ -411,12 +836,10 @@ MRtpPacket * mrtp_peer_receive(MRtpPeer * peer, mrtp_uint8 * channelID) {
 
 	--packet->referenceCount;
 
-	if (incomingCommand->fragments != NULL)
-		mrtp_free(incomingCommand->fragments);
-
-	mrtp_free(incomingCommand);
+	mrtp_peer_free_incoming_command(incomingCommand);
 
 	peer->totalWaitingData -= packet->dataLength;
+	mrtp_arena_release(&peer->host->memory, &peer->memoryUsed, MRTP_MEMORY_PACKETS, packet->dataLength);
 
 	return packet;
 }
@@ -431,7 +854,8 @@ int mrtp_peer_send_redundancy_noack(MRtpPeer* peer, MRtpPacket* packet) {
 	MRtpProtocol command;
 	size_t fragmentLength;
 
-	fragmentLength = (peer->mtu - sizeof(MRtpProtocolHeader)) / peer->redundancyNum - sizeof(MRtpProtocolSendFragment);
+	// the same share of the mtu mrtp_protocol_send_redundancy_noack_commands packs a command into
+	fragmentLength = (peer->mtu - sizeof(MRtpProtocolHeader) - 1) / peer->redundancyNum - sizeof(MRtpProtocolSendFragment);
 
 	if (packet->dataLength > fragmentLength) {
 
@@ -456,13 +880,13 @@ int mrtp_peer_send_redundancy_noack(MRtpPeer* peer, MRtpPacket* packet) {
 			if (packet->dataLength - fragmentOffset < fragmentLength)
 				fragmentLength = packet->dataLength - fragmentOffset;
 
-			fragment = (MRtpOutgoingCommand *)mrtp_malloc(sizeof(MRtpOutgoingCommand));
+			fragment = (MRtpOutgoingCommand *)mrtp_object_pool_acquire(&peer->host->outgoingCommandPool);
 
 			if (fragment == NULL) {
 				while (!mrtp_list_empty(&fragments)) {
 					fragment = (MRtpOutgoingCommand *)mrtp_list_remove(mrtp_list_begin(&fragments));
 
-					mrtp_free(fragment);
+					mrtp_object_pool_release(&peer->host->outgoingCommandPool, fragment);
 				}
 				return -1;
 			}
@@ -532,12 +956,12 @@ int mrtp_peer_send_redundancy(MRtpPeer* peer, MRtpPacket* packet) {
 			if (packet->dataLength - fragmentOffset < fragmentLength)
 				fragmentLength = packet->dataLength - fragmentOffset;
 
-			fragment = (MRtpOutgoingCommand *)mrtp_malloc(sizeof(MRtpOutgoingCommand));
+			fragment = (MRtpOutgoingCommand *)mrtp_object_pool_acquire(&peer->host->outgoingCommandPool);
 
 			if (fragment == NULL) {
 				while (!mrtp_list_empty(&fragments)) {
 					fragment = (MRtpOutgoingCommand *)mrtp_list_remove(mrtp_list_begin(&fragments));
-					mrtp_free(fragment);
+					mrtp_object_pool_release(&peer->host->outgoingCommandPool, fragment);
 				}
 				return -1;
 			}
@@ -612,12 +1036,12 @@ int mrtp_peer_send_reliable(MRtpPeer * peer, MRtpPacket * packet) {
 			if (packet->dataLength - fragmentOffset < fragmentLength)
 				fragmentLength = packet->dataLength - fragmentOffset;
 
-			fragment = (MRtpOutgoingCommand *)mrtp_malloc(sizeof(MRtpOutgoingCommand));
+			fragment = (MRtpOutgoingCommand *)mrtp_object_pool_acquire(&peer->host->outgoingCommandPool);
 			if (fragment == NULL) {
 				while (!mrtp_list_empty(&fragments)) {
 					fragment = (MRtpOutgoingCommand *)mrtp_list_remove(mrtp_list_begin(&fragments));
 
-					mrtp_free(fragment);
+					mrtp_object_pool_release(&peer->host->outgoingCommandPool, fragment);
 				}
 
 				return -1;
@@ -692,13 +1116,13 @@ int mrtp_peer_send_unsequenced(MRtpPeer * peer, MRtpPacket * packet) {
 			if (packet->dataLength - fragmentOffset < fragmentLength)
 				fragmentLength = packet->dataLength - fragmentOffset;
 
-			fragment = (MRtpOutgoingCommand *)mrtp_malloc(sizeof(MRtpOutgoingCommand));
+			fragment = (MRtpOutgoingCommand *)mrtp_object_pool_acquire(&peer->host->outgoingCommandPool);
 			if (fragment == NULL) {
 
 				while (!mrtp_list_empty(&fragments)) {
 
 					fragment = (MRtpOutgoingCommand *)mrtp_list_remove(mrtp_list_begin(&fragments));
-					mrtp_free(fragment);
+					mrtp_object_pool_release(&peer->host->outgoingCommandPool, fragment);
 				}
 
 				return -1;
@@ -761,177 +1185,210 @@ int mrtp_peer_send(MRtpPeer *peer, MRtpPacket *packet) {
 
 }
 
-// move the continual command to dispatchCommand queue
-void mrtp_peer_dispatch_incoming_reliable_commands(MRtpPeer * peer, MRtpChannel * channel) {
-
-	MRtpListIterator currentCommand;
+// the longest fragment payload of the packet's delivery mode on this peer, longer packets are sent as fragments
+size_t mrtp_peer_fragment_length(MRtpPeer * peer, MRtpPacket * packet) {
 
-	for (currentCommand = mrtp_list_begin(&channel->incomingCommands);
-		currentCommand != mrtp_list_end(&channel->incomingCommands);
-		currentCommand = mrtp_list_next(currentCommand))
-	{
-		MRtpIncomingCommand * incomingCommand = (MRtpIncomingCommand *)currentCommand;
+	if (packet->flags & (MRTP_PACKET_FLAG_RELIABLE | MRTP_PACKET_FLAG_REDUNDANCY) ||
+		!(packet->flags & MRTP_PACKET_FLAG_REDUNDANCY_NO_ACK))
+		return peer->mtu - sizeof(MRtpProtocolHeader) - sizeof(MRtpProtocolSendFragment);
 
-		//if fragment hasn't been received entirly or the sequence number is not contunual
-		if (incomingCommand->fragmentsRemaining > 0 ||
-			incomingCommand->sequenceNumber != (mrtp_uint16)(channel->incomingSequenceNumber + 1))
-			break;
-
-		channel->incomingSequenceNumber = incomingCommand->sequenceNumber;
+	// a noack fragment is sent again with the next redundancyNum packets, so it shares the mtu with them
+	if (peer->redundancyNum == 0 || !peer->redundancyNoAckBuffers || peer->redundancyNum != peer->host->redundancyNum)
+		mrtp_peer_reset_redundancy_noack_buffer(peer, peer->host->redundancyNum);
 
-		if (incomingCommand->fragmentCount > 0)
-			channel->incomingSequenceNumber += incomingCommand->fragmentCount - 1;
-	}
+	return (peer->mtu - sizeof(MRtpProtocolHeader) - 1) / peer->redundancyNum - sizeof(MRtpProtocolSendFragment);
+}
 
-	if (currentCommand == mrtp_list_begin(&channel->incomingCommands))
-		return;
+// encode the fragment commands of the packet for one fragment length, all but the start sequence number
+// they are the same for every peer, fragments must hold the fragment count of the packet
+void mrtp_peer_encode_fragments(MRtpPacket * packet, size_t fragmentLength, MRtpProtocol * fragments) {
 
-	// move command from incomingCommand queue to dispatchedCommand queue
-	mrtp_list_move(mrtp_list_end(&peer->dispatchedCommands), mrtp_list_begin(&channel->incomingCommands), mrtp_list_previous(currentCommand));
+	mrtp_uint32 fragmentCount = (packet->dataLength + fragmentLength - 1) / fragmentLength;
+	mrtp_uint32 fragmentNumber, fragmentOffset;
+	mrtp_uint8 commandNumber, flag;
 
-	if (!peer->needsDispatch) {
-		mrtp_list_insert(mrtp_list_end(&peer->host->dispatchQueue), &peer->dispatchList);
+	if (packet->flags & MRTP_PACKET_FLAG_RELIABLE) {
+		commandNumber = MRTP_PROTOCOL_COMMAND_SEND_FRAGMENT;
+		flag = MRTP_PROTOCOL_COMMAND_FLAG_ACKNOWLEDGE;
+	}
+	else if (packet->flags & MRTP_PACKET_FLAG_REDUNDANCY) {
+		commandNumber = MRTP_PROTOCOL_COMMAND_SEND_REDUNDANCY_FRAGMENT;
+		flag = MRTP_PROTOCOL_COMMAND_FLAG_REDUNDANCY_ACKNOWLEDGE;
+	}
+	else if (packet->flags & MRTP_PACKET_FLAG_REDUNDANCY_NO_ACK) {
+		commandNumber = MRTP_PROTOCOL_COMMAND_SEND_REDUNDANCY_FRAGEMENT_NO_ACK;
+		flag = 0;
+	}
+	else {
+		commandNumber = MRTP_PROTOCOL_COMMAND_SEND_UNSEQUENCED_FRAGMENT;
+		flag = MRTP_PROTOCOL_COMMAND_FLAG_UNSEQUENCED;
+	}
 
-		peer->needsDispatch = 1;
+	for (fragmentNumber = 0, fragmentOffset = 0; fragmentOffset < packet->dataLength;
+		++fragmentNumber, fragmentOffset += fragmentLength)
+	{
+		MRtpProtocol * fragment = &fragments[fragmentNumber];
+
+		if (packet->dataLength - fragmentOffset < fragmentLength)
+			fragmentLength = packet->dataLength - fragmentOffset;
+
+		fragment->header.command = commandNumber;
+		fragment->header.flag = flag;
+		fragment->sendFragment.startSequenceNumber = 0;
+		fragment->sendFragment.dataLength = MRTP_HOST_TO_NET_16(fragmentLength);
+		fragment->sendFragment.fragmentCount = MRTP_HOST_TO_NET_32(fragmentCount);
+		fragment->sendFragment.fragmentNumber = MRTP_HOST_TO_NET_32(fragmentNumber);
+		fragment->sendFragment.totalLength = MRTP_HOST_TO_NET_32(packet->dataLength);
+		fragment->sendFragment.fragmentOffset = MRTP_HOST_TO_NET_32(fragmentOffset);
 	}
 }
 
-void mrtp_peer_dispatch_incoming_redundancy_noack_commands(MRtpPeer * peer, MRtpChannel * channel) {
-
-	MRtpListIterator currentCommand, startCommand, droppedCommand;
+// queue fragments encoded by mrtp_peer_encode_fragments, only the start sequence number is the peer's own
+int mrtp_peer_send_fragments(MRtpPeer * peer, MRtpPacket * packet, const MRtpProtocol * fragments,
+	mrtp_uint32 fragmentCount, size_t fragmentLength) {
 
-	currentCommand = startCommand = droppedCommand = mrtp_list_begin(&channel->incomingCommands);
-	for (; currentCommand != mrtp_list_end(&channel->incomingCommands);
-		currentCommand = mrtp_list_next(currentCommand))
-	{
-		MRtpIncomingCommand * incomingCommand = (MRtpIncomingCommand*)currentCommand;
+	MRtpChannel * channel = &peer->channels[channelIDs[fragments->header.command & MRTP_PROTOCOL_COMMAND_MASK]];
+	mrtp_uint16 startSequenceNumber = MRTP_HOST_TO_NET_16(channel->outgoingSequenceNumber + 1);
+	mrtp_uint32 fragmentNumber;
+	MRtpList queue;
+	MRtpOutgoingCommand * fragment;
 
-		if (incomingCommand->fragmentsRemaining <= 0) {
-			channel->incomingSequenceNumber = incomingCommand->sequenceNumber;
-			continue;
-		}
+	mrtp_list_clear(&queue);
 
-		if (startCommand != currentCommand) {
-			mrtp_list_move(mrtp_list_end(&peer->dispatchedCommands), startCommand, mrtp_list_previous(currentCommand));
+	for (fragmentNumber = 0; fragmentNumber < fragmentCount; ++fragmentNumber) {
 
-			if (!peer->needsDispatch) {
-				mrtp_list_insert(mrtp_list_end(&peer->host->dispatchQueue), &peer->dispatchList);
-				peer->needsDispatch = 1;
+		fragment = (MRtpOutgoingCommand *)mrtp_object_pool_acquire(&peer->host->outgoingCommandPool);
+		if (fragment == NULL) {
+			while (!mrtp_list_empty(&queue)) {
+				fragment = (MRtpOutgoingCommand *)mrtp_list_remove(mrtp_list_begin(&queue));
+				mrtp_object_pool_release(&peer->host->outgoingCommandPool, fragment);
 			}
-			droppedCommand = currentCommand;
-		}
-		else if (droppedCommand != currentCommand) {
-			droppedCommand = mrtp_list_previous(currentCommand);
+			return -1;
 		}
-		startCommand = mrtp_list_next(currentCommand);
-	}
 
-	if (startCommand != currentCommand) {
+		fragment->command = fragments[fragmentNumber];
+		fragment->command.sendFragment.startSequenceNumber = startSequenceNumber;
+		fragment->fragmentOffset = fragmentNumber * fragmentLength;
+		fragment->fragmentLength = MRTP_NET_TO_HOST_16(fragment->command.sendFragment.dataLength);
+		fragment->packet = packet;
 
-		mrtp_list_move(mrtp_list_end(&peer->dispatchedCommands), startCommand, mrtp_list_previous(currentCommand));
+		mrtp_list_insert(mrtp_list_end(&queue), fragment);
+	}
 
-		if (!peer->needsDispatch) {
-			mrtp_list_insert(mrtp_list_end(&peer->host->dispatchQueue), &peer->dispatchList);
+	packet->referenceCount += fragmentCount;
 
-			peer->needsDispatch = 1;
-		}
+	while (!mrtp_list_empty(&queue)) {
+		fragment = (MRtpOutgoingCommand *)mrtp_list_remove(mrtp_list_begin(&queue));
 
-		droppedCommand = currentCommand;
+		mrtp_peer_setup_outgoing_command(peer, fragment);
 	}
 
-	mrtp_peer_remove_incoming_commands(&channel->incomingCommands,
-		mrtp_list_begin(&channel->incomingCommands), droppedCommand);
-
+	return 0;
 }
 
-void mrtp_peer_dispatch_incoming_redundancy_commands(MRtpPeer * peer, MRtpChannel * channel) {
+// move the continual commands to dispatchCommand queue, from the one after the last dispatched
+// until a sequence number is missing or a message still misses fragments
+static void mrtp_peer_dispatch_incoming_sequenced_commands(MRtpPeer * peer, MRtpChannel * channel) {
 
-	MRtpListIterator currentCommand;
+	MRtpIncomingCommand * incomingCommand;
+	int dispatched = 0;
 
-	for (currentCommand = mrtp_list_begin(&channel->incomingCommands);
-		currentCommand != mrtp_list_end(&channel->incomingCommands);
-		currentCommand = mrtp_list_next(currentCommand))
+	while ((incomingCommand = mrtp_peer_find_incoming_command(channel, channel->incomingSequenceNumber + 1)) != NULL &&
+		incomingCommand->fragmentsRemaining == 0)
 	{
-		MRtpIncomingCommand * incomingCommand = (MRtpIncomingCommand *)currentCommand;
-
-		//if fragment hasn't been received entirly or the sequence number is not contunual
-		if (incomingCommand->fragmentsRemaining > 0 ||
-			incomingCommand->sequenceNumber != (mrtp_uint16)(channel->incomingSequenceNumber + 1))
-			break;
-
 		channel->incomingSequenceNumber = incomingCommand->sequenceNumber;
 
 		if (incomingCommand->fragmentCount > 0)
 			channel->incomingSequenceNumber += incomingCommand->fragmentCount - 1;
+
+		mrtp_peer_unindex_incoming_command(peer, incomingCommand);
+		mrtp_list_move(mrtp_list_end(&peer->dispatchedCommands), incomingCommand, incomingCommand);
+		dispatched = 1;
 	}
 
-	// the incomingCommand queue is empty
-	if (currentCommand == mrtp_list_begin(&channel->incomingCommands))
+	if (!dispatched)
 		return;
 
-	// move command from incomingCommand queue to dispatchedCommand queue
-	mrtp_list_move(mrtp_list_end(&peer->dispatchedCommands), mrtp_list_begin(&channel->incomingCommands), mrtp_list_previous(currentCommand));
-
 	if (!peer->needsDispatch) {
 		mrtp_list_insert(mrtp_list_end(&peer->host->dispatchQueue), &peer->dispatchList);
 
 		peer->needsDispatch = 1;
 	}
+}
 
+void mrtp_peer_dispatch_incoming_reliable_commands(MRtpPeer * peer, MRtpChannel * channel) {
+	mrtp_peer_dispatch_incoming_sequenced_commands(peer, channel);
 }
 
-void mrtp_peer_dispatch_incoming_unsequenced_commands(MRtpPeer * peer, MRtpChannel * channel) {
+// incomingCommand was just queued or completed, once it is whole it is delivered and the partial messages
+// before it are given up on, every whole message goes out as it comes in so the others waiting are partial
+void mrtp_peer_dispatch_incoming_redundancy_noack_commands(MRtpPeer * peer, MRtpChannel * channel, MRtpIncomingCommand * incomingCommand) {
 
-	MRtpListIterator droppedCommand, startCommand, currentCommand;
+	MRtpListIterator currentCommand, nextCommand;
+	mrtp_uint16 distance;
 
-	for (droppedCommand = startCommand = currentCommand = mrtp_list_begin(&channel->incomingCommands);
+	if (incomingCommand->fragmentsRemaining > 0)
+		return;
+
+	distance = incomingCommand->sequenceNumber - channel->incomingSequenceNumber;
+
+	for (currentCommand = mrtp_list_begin(&channel->incomingCommands);
 		currentCommand != mrtp_list_end(&channel->incomingCommands);
-		currentCommand = mrtp_list_next(currentCommand))
+		currentCommand = nextCommand)
 	{
-		MRtpIncomingCommand * incomingCommand = (MRtpIncomingCommand *)currentCommand;
+		MRtpIncomingCommand * partialCommand = (MRtpIncomingCommand *)currentCommand;
 
-		if ((incomingCommand->command.header.command & MRTP_PROTOCOL_COMMAND_MASK) ==
-			MRTP_PROTOCOL_COMMAND_SEND_UNSEQUENCED)
-			continue;
+		nextCommand = mrtp_list_next(currentCommand);
 
-		//if remaining <= 0, then dispatch
-		if (incomingCommand->fragmentsRemaining <= 0) {
-			channel->incomingSequenceNumber = incomingCommand->sequenceNumber;
-			continue;
-		}
+		if (partialCommand != incomingCommand &&
+			(mrtp_uint16)(partialCommand->sequenceNumber - channel->incomingSequenceNumber) < distance)
+			mrtp_peer_remove_incoming_commands(peer, currentCommand, nextCommand, NULL);
+	}
 
-		if (startCommand != currentCommand) {
-			mrtp_list_move(mrtp_list_end(&peer->dispatchedCommands), startCommand, mrtp_list_previous(currentCommand));
+	channel->incomingSequenceNumber = incomingCommand->sequenceNumber;
 
-			if (!peer->needsDispatch) {
+	mrtp_peer_unindex_incoming_command(peer, incomingCommand);
+	mrtp_list_move(mrtp_list_end(&peer->dispatchedCommands), incomingCommand, incomingCommand);
 
-				mrtp_list_insert(mrtp_list_end(&peer->host->dispatchQueue), &peer->dispatchList);
+	if (!peer->needsDispatch) {
+		mrtp_list_insert(mrtp_list_end(&peer->host->dispatchQueue), &peer->dispatchList);
 
-				peer->needsDispatch = 1;
-			}
+		peer->needsDispatch = 1;
+	}
+}
 
-			droppedCommand = currentCommand;
-		}
-		else if (droppedCommand != currentCommand)
-			droppedCommand = mrtp_list_previous(currentCommand);
+void mrtp_peer_dispatch_incoming_redundancy_commands(MRtpPeer * peer, MRtpChannel * channel) {
+	mrtp_peer_dispatch_incoming_sequenced_commands(peer, channel);
+}
 
-		startCommand = mrtp_list_next(currentCommand);
-	}
+// unsequenced messages are delivered as soon as they are whole, those still missing fragments stay
+// until they are completed, or evicted once they are stale
+void mrtp_peer_dispatch_incoming_unsequenced_commands(MRtpPeer * peer, MRtpChannel * channel) {
+
+	MRtpListIterator currentCommand, nextCommand;
+
+	for (currentCommand = mrtp_list_begin(&channel->incomingCommands);
+		currentCommand != mrtp_list_end(&channel->incomingCommands);
+		currentCommand = nextCommand)
+	{
+		MRtpIncomingCommand * incomingCommand = (MRtpIncomingCommand *)currentCommand;
 
-	if (startCommand != currentCommand) {
+		nextCommand = mrtp_list_next(currentCommand);
 
-		mrtp_list_move(mrtp_list_end(&peer->dispatchedCommands), startCommand, mrtp_list_previous(currentCommand));
+		if (incomingCommand->fragmentsRemaining > 0)
+			continue;
+
+		if ((incomingCommand->command.header.command & MRTP_PROTOCOL_COMMAND_MASK) == MRTP_PROTOCOL_COMMAND_SEND_UNSEQUENCED_FRAGMENT)
+			channel->incomingSequenceNumber = incomingCommand->sequenceNumber;
+
+		mrtp_list_move(mrtp_list_end(&peer->dispatchedCommands), currentCommand, currentCommand);
 
 		if (!peer->needsDispatch) {
 			mrtp_list_insert(mrtp_list_end(&peer->host->dispatchQueue), &peer->dispatchList);
 
 			peer->needsDispatch = 1;
 		}
-
-		droppedCommand = currentCommand;
 	}
-
-	mrtp_peer_remove_incoming_commands(&channel->incomingCommands, mrtp_list_begin(&channel->incomingCommands), droppedCommand);
 }
 
 MRtpIncomingCommand *mrtp_peer_queue_incoming_command(MRtpPeer * peer, const MRtpProtocol * command,
@@ -943,8 +1400,11 @@ MRtpIncomingCommand *mrtp_peer_queue_incoming_command(MRtpPeer * peer, const MRt
 	mrtp_uint32 sequenceNumber = 0;
 	mrtp_uint16 commandWindow, currentWindow;
 	MRtpIncomingCommand * incomingCommand;
-	MRtpListIterator currentCommand;
+	MRtpIncomingCommandRing * reorderBuffer = NULL;
 	MRtpPacket * packet = NULL;
+	MRtpReceiveSlab * receivedSlab;
+	MRtpMemoryType memoryType = fragmentCount > 0 ? MRTP_MEMORY_REASSEMBLY : MRTP_MEMORY_PACKETS;
+	size_t reservedData = 0;
 
 	if (peer->state == MRTP_PEER_STATE_DISCONNECT_LATER)
 		goto discardCommand;
@@ -959,6 +1419,10 @@ MRtpIncomingCommand *mrtp_peer_queue_incoming_command(MRtpPeer * peer, const MRt
 	if (commandWindow < currentWindow || commandWindow >= currentWindow + MRTP_PEER_FREE_WINDOWS - 1)
 		goto discardCommand;
 
+	// before the queue is searched, the room is made by evicting commands from it
+	if (fragmentCount > 0 && mrtp_peer_reserve_reassembly(peer, dataLength) < 0)
+		goto notifyError;
+
 	switch (command->header.command & MRTP_PROTOCOL_COMMAND_MASK)
 	{
 	case MRTP_PROTOCOL_COMMAND_SEND_FRAGMENT:
@@ -971,31 +1435,18 @@ MRtpIncomingCommand *mrtp_peer_queue_incoming_command(MRtpPeer * peer, const MRt
 		if (sequenceNumber == channel->incomingSequenceNumber)
 			goto discardCommand;
 
-		for (currentCommand = mrtp_list_previous(mrtp_list_end(&channel->incomingCommands));
-			currentCommand != mrtp_list_end(&channel->incomingCommands);
-			currentCommand = mrtp_list_previous(currentCommand))
-		{
-			incomingCommand = (MRtpIncomingCommand *)currentCommand;
+		// if command already exists, then discard the command
+		if (mrtp_peer_find_incoming_command(channel, sequenceNumber) != NULL)
+			goto discardCommand;
 
-			if (sequenceNumber >= channel->incomingSequenceNumber) {
-				if (incomingCommand->sequenceNumber < channel->incomingSequenceNumber)
-					continue;
-			}
-			else if (incomingCommand->sequenceNumber >= channel->incomingSequenceNumber)
-				break;
+		if (mrtp_peer_reserve_reorder_buffer(peer, channel, sequenceNumber) < 0)
+			goto notifyError;
 
-			if (incomingCommand->sequenceNumber <= sequenceNumber) {
-				if (incomingCommand->sequenceNumber < sequenceNumber)
-					break;
-				// if command already exists, then discard the command
-				goto discardCommand;
-			}
-		}
+		reorderBuffer = &channel->reorderBuffer;
 		break;
 
 	case MRTP_PROTOCOL_COMMAND_SEND_UNSEQUENCED:
 	case MRTP_PROTOCOL_COMMAND_SEND_UNSEQUENCED_FRAGMENT:
-		currentCommand = mrtp_list_end(&channel->incomingCommands);
 		break;
 
 	default:
@@ -1005,11 +1456,34 @@ MRtpIncomingCommand *mrtp_peer_queue_incoming_command(MRtpPeer * peer, const MRt
 	if (peer->totalWaitingData >= peer->host->maximumWaitingData)
 		goto notifyError;
 
-	packet = mrtp_packet_create(data, dataLength, flags);
+	// the data counts against the memory budgets until it is delivered or dropped
+	if (mrtp_arena_reserve(&peer->host->memory, &peer->memoryUsed, memoryType, dataLength) < 0)
+		goto notifyError;
+	reservedData = dataLength;
+
+	receivedSlab = peer->host->receivedSlab;
+
+	// the messages missing fragments are pooled even while the packet pool of the host is off
+	if (fragmentCount > 0 && peer->host->packetPool == NULL && peer->host->reassemblyPool == NULL) {
+		peer->host->reassemblyPool = mrtp_packet_pool_create();
+		if (peer->host->reassemblyPool == NULL)
+			goto notifyError;
+	}
+
+	// whole payloads still in the receive slab are delivered in place, the small ones are copied into the packet block
+	if (fragmentCount == 0 && dataLength >= MRTP_PACKET_INLINE_DATA && receivedSlab != NULL &&
+		(const mrtp_uint8 *)data >= MRTP_RECEIVE_SLAB_DATA(receivedSlab) &&
+		(const mrtp_uint8 *)data + dataLength <= MRTP_RECEIVE_SLAB_DATA(receivedSlab) + receivedSlab->size)
+		packet = mrtp_packet_pool_reference(peer->host->packetPool, receivedSlab, data, dataLength, flags);
+	else if (fragmentCount > 0 && peer->host->packetPool == NULL)
+		packet = mrtp_packet_pool_acquire(peer->host->reassemblyPool, data, dataLength, flags);
+	else
+		packet = mrtp_packet_pool_acquire(peer->host->packetPool, data, dataLength, flags);
 	if (packet == NULL)
 		goto notifyError;
 
-	incomingCommand = (MRtpIncomingCommand *)mrtp_malloc(sizeof(MRtpIncomingCommand));
+	incomingCommand = (MRtpIncomingCommand *)mrtp_arena_malloc(&peer->host->memory, &peer->memoryUsed,
+		MRTP_MEMORY_COMMANDS, sizeof(MRtpIncomingCommand));
 	if (incomingCommand == NULL)
 		goto notifyError;
 
@@ -1019,18 +1493,28 @@ MRtpIncomingCommand *mrtp_peer_queue_incoming_command(MRtpPeer * peer, const MRt
 	incomingCommand->fragmentsRemaining = fragmentCount;
 	incomingCommand->packet = packet;
 	incomingCommand->fragments = NULL;
+	incomingCommand->reassemblyList.next = NULL;
+	incomingCommand->peer = peer;
 
 	if (fragmentCount > 0) {
 
 		//use fragments(byte map) to record the already received fragment
-		if (fragmentCount <= MRTP_PROTOCOL_MAXIMUM_FRAGMENT_COUNT)
-			incomingCommand->fragments = (mrtp_uint32 *)mrtp_malloc((fragmentCount + 31) / 32 * sizeof(mrtp_uint32));
+		if (fragmentCount <= MRTP_PEER_INLINE_FRAGMENTS)
+			incomingCommand->fragments = incomingCommand->inlineFragments;
+		else if (fragmentCount <= MRTP_PROTOCOL_MAXIMUM_FRAGMENT_COUNT)
+			incomingCommand->fragments = (mrtp_uint32 *)mrtp_arena_malloc(&peer->host->memory, &peer->memoryUsed,
+				MRTP_MEMORY_REASSEMBLY, (fragmentCount + 31) / 32 * sizeof(mrtp_uint32));
 		if (incomingCommand->fragments == NULL) {
-			mrtp_free(incomingCommand);
+			mrtp_peer_free_incoming_command(incomingCommand);
 
 			goto notifyError;
 		}
 		memset(incomingCommand->fragments, 0, (fragmentCount + 31) / 32 * sizeof(mrtp_uint32));
+
+		incomingCommand->reassemblyTime = peer->host->serviceTime;
+		mrtp_list_insert(mrtp_list_end(&peer->host->reassemblies), &incomingCommand->reassemblyList);
+		peer->reassemblyData += dataLength;
+		peer->host->reassemblyData += dataLength;
 	}
 
 	if (packet != NULL) {
@@ -1038,7 +1522,12 @@ MRtpIncomingCommand *mrtp_peer_queue_incoming_command(MRtpPeer * peer, const MRt
 		peer->totalWaitingData += packet->dataLength;
 	}
 
-	mrtp_list_insert(mrtp_list_next(currentCommand), incomingCommand);
+	mrtp_list_insert(mrtp_list_end(&channel->incomingCommands), incomingCommand);
+
+	if (reorderBuffer != NULL) {
+		reorderBuffer->commands[incomingCommand->sequenceNumber & (reorderBuffer->capacity - 1)] = incomingCommand;
+		++reorderBuffer->count;
+	}
 
 	switch (command->header.command & MRTP_PROTOCOL_COMMAND_MASK)
 	{
@@ -1049,7 +1538,7 @@ MRtpIncomingCommand *mrtp_peer_queue_incoming_command(MRtpPeer * peer, const MRt
 
 	case MRTP_PROTOCOL_COMMAND_SEND_REDUNDANCY_NO_ACK:
 	case MRTP_PROTOCOL_COMMAND_SEND_REDUNDANCY_FRAGEMENT_NO_ACK:
-		mrtp_peer_dispatch_incoming_redundancy_noack_commands(peer, channel);
+		mrtp_peer_dispatch_incoming_redundancy_noack_commands(peer, channel, incomingCommand);
 		break;
 
 	case MRTP_PROTOCOL_COMMAND_SEND_REDUNDANCY:
@@ -1082,6 +1571,8 @@ notifyError:
 	if (packet != NULL && packet->referenceCount == 0)
 		mrtp_packet_destroy(packet);
 
+	mrtp_arena_release(&peer->host->memory, &peer->memoryUsed, memoryType, reservedData);
+
 	return NULL;
 }
 
@@ -1096,14 +1587,14 @@ void mrtp_peer_reset_redundancy_noack_buffer(MRtpPeer* peer, size_t redundancyNu
 		peer->currentRedundancyNoAckBufferNum = 0;
 
 		for (int i = 0; i < redundancyNum + 1; i++) {
-			mrtp_protocol_remove_redundancy_buffer_commands(&peer->redundancyNoAckBuffers[i]);
+			mrtp_protocol_remove_redundancy_buffer_commands(peer->host, &peer->redundancyNoAckBuffers[i]);
 			memset(&peer->redundancyNoAckBuffers[i], 0, sizeof(MRtpRedundancyNoAckBuffer));
 			mrtp_list_clear(&peer->redundancyNoAckBuffers[i].sentCommands);
 		}
 	}
 	else if (peer->redundancyNoAckBuffers != NULL) {
 		for (int i = 0; i < redundancyNum + 1; i++) {
-			mrtp_protocol_remove_redundancy_buffer_commands(&peer->redundancyNoAckBuffers[i]);
+			mrtp_protocol_remove_redundancy_buffer_commands(peer->host, &peer->redundancyNoAckBuffers[i]);
 		}
 		mrtp_free(peer->redundancyNoAckBuffers);
 		peer->redundancyNum = redundancyNum;
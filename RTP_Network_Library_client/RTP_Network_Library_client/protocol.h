@@ -22,7 +22,7 @@ enum {
 	MRTP_PROTOCOL_MINIMUM_REDUNDANCY_NUM = 2,
 
 	MRTP_PROTOCOL_MAXIMUM_REDUNDNACY_BUFFER_SIZE = 600,
-	MRTP_PROTOCOL_MAXIMUM_REDUNDANCY_COMMAND_QUEUE_SiZE = 1024,
+	MRTP_PROTOCOL_MAXIMUM_REDUNDANCY_COMMAND_QUEUE_SiZE = 16 * 1024,
 	MRTP_PROTOCOL_MAXIMUM_REDUNDANCY_COMMAND_RETRANSMIT_TIME = 900,
 
 	MRTP_PROTOCOL_DEFAULT_QUICK_RETRANSMIT = 3,
@@ -0,0 +1,188 @@
+#include <string.h>
+#include "time.h"
+#include "mrtp.h"
+
+// a hierarchical timer wheel, level 0 has a slot for each millisecond of the current 64 milliseconds,
+// every level above has a slot for each 64 slots of the level below, so the four levels span about 4.6 hours
+// a timer goes in the lowest level whose slot range still holds both its expire time and the wheel time,
+// as the wheel time reaches the start of a slot above level 0 the slot is spread over the levels below
+
+#define MRTP_TIMER_WHEEL_SHIFT(level) ((level) * MRTP_TIMER_WHEEL_BITS)
+#define MRTP_TIMER_WHEEL_SLOT(time, level) (((time) >> MRTP_TIMER_WHEEL_SHIFT(level)) & (MRTP_TIMER_WHEEL_SLOTS - 1))
+#define MRTP_TIMER_WHEEL_SPAN ((mrtp_uint32)1 << MRTP_TIMER_WHEEL_SHIFT(MRTP_TIMER_WHEEL_LEVELS))
+
+// the wheel time is taken from the first advance, the service time of a host may not follow the clock
+// it was created at
+void mrtp_timer_wheel_init(MRtpTimerWheel * wheel) {
+
+	size_t level, slot;
+
+	memset(wheel, 0, sizeof(MRtpTimerWheel));
+
+	for (level = 0; level < MRTP_TIMER_WHEEL_LEVELS; ++level) {
+		for (slot = 0; slot < MRTP_TIMER_WHEEL_SLOTS; ++slot)
+			mrtp_list_clear(&wheel->slots[level][slot]);
+	}
+}
+
+static void mrtp_timer_wheel_insert(MRtpTimerWheel * wheel, MRtpTimer * timer) {
+
+	mrtp_uint32 expireTime = timer->expireTime;
+	size_t level = 0;
+
+	// past the top level, or across the end of its span, the timer waits at the end of it and fires early,
+	// its owner schedules it again
+	if ((expireTime ^ wheel->currentTime) >= MRTP_TIMER_WHEEL_SPAN)
+		expireTime = wheel->currentTime | (MRTP_TIMER_WHEEL_SPAN - 1);
+
+	while ((expireTime ^ wheel->currentTime) >> MRTP_TIMER_WHEEL_SHIFT(level + 1))
+		++level;
+
+	timer->level = level;
+	++wheel->levelCounts[level];
+	mrtp_list_insert(mrtp_list_end(&wheel->slots[level][MRTP_TIMER_WHEEL_SLOT(expireTime, level)]), timer);
+}
+
+void mrtp_timer_wheel_cancel(MRtpTimerWheel * wheel, MRtpTimer * timer) {
+
+	if (timer->timerList.next == NULL)
+		return;
+
+	mrtp_list_remove(&timer->timerList);
+	timer->timerList.next = NULL;
+
+	--wheel->levelCounts[timer->level];
+	--wheel->timerCount;
+}
+
+// a time the wheel has passed already fires on its next advance
+void mrtp_timer_wheel_schedule(MRtpTimerWheel * wheel, MRtpTimer * timer, mrtp_uint32 expireTime) {
+
+	mrtp_timer_wheel_cancel(wheel, timer);
+
+	timer->expireTime = MRTP_TIME_LESS(expireTime, wheel->currentTime) ? wheel->currentTime : expireTime;
+
+	mrtp_timer_wheel_insert(wheel, timer);
+	++wheel->timerCount;
+}
+
+// spread the timers of a slot over the levels below, the wheel time has reached its start
+static void mrtp_timer_wheel_cascade(MRtpTimerWheel * wheel, size_t level) {
+
+	MRtpList * slot = &wheel->slots[level][MRTP_TIMER_WHEEL_SLOT(wheel->currentTime, level)];
+
+	while (!mrtp_list_empty(slot)) {
+		MRtpTimer * timer = (MRtpTimer *)mrtp_list_remove(mrtp_list_begin(slot));
+
+		--wheel->levelCounts[level];
+		mrtp_timer_wheel_insert(wheel, timer);
+	}
+}
+
+// move the wheel time to currentTime, every armed timer is due on it and fires early,
+// its owner schedules it again from its own deadlines
+static void mrtp_timer_wheel_rebase(MRtpTimerWheel * wheel, mrtp_uint32 currentTime) {
+
+	MRtpList timers;
+	MRtpTimer * timer;
+	size_t level, slot;
+
+	mrtp_list_clear(&timers);
+
+	for (level = 0; level < MRTP_TIMER_WHEEL_LEVELS; ++level) {
+		for (slot = 0; slot < MRTP_TIMER_WHEEL_SLOTS && wheel->levelCounts[level] > 0; ++slot) {
+			while (!mrtp_list_empty(&wheel->slots[level][slot])) {
+				mrtp_list_insert(mrtp_list_end(&timers), mrtp_list_remove(mrtp_list_begin(&wheel->slots[level][slot])));
+				--wheel->levelCounts[level];
+			}
+		}
+	}
+
+	wheel->currentTime = currentTime;
+
+	while (!mrtp_list_empty(&timers)) {
+		timer = (MRtpTimer *)mrtp_list_remove(mrtp_list_begin(&timers));
+		timer->expireTime = currentTime;
+		mrtp_timer_wheel_insert(wheel, timer);
+	}
+}
+
+// move the timers expiring up to currentTime to the expired list, they are no longer armed once taken from it
+void mrtp_timer_wheel_advance(MRtpTimerWheel * wheel, mrtp_uint32 currentTime, MRtpList * expired) {
+
+	mrtp_uint32 nextSlot;
+	size_t level;
+
+	// the first advance, a time before the ones advanced to already, or one past the span of the wheel,
+	// such as after mrtp_time_set, starts the wheel over at currentTime
+	if (!wheel->started ||
+		MRTP_TIME_LESS(currentTime + 1, wheel->currentTime) ||
+		MRTP_TIME_DIFFERENCE(currentTime, wheel->currentTime) >= MRTP_TIMER_WHEEL_SPAN)
+	{
+		mrtp_timer_wheel_rebase(wheel, currentTime);
+		wheel->started = 1;
+	}
+
+	while (MRTP_TIME_LESS_EQUAL(wheel->currentTime, currentTime)) {
+
+		if (wheel->timerCount == 0) {
+			wheel->currentTime = currentTime + 1;
+			break;
+		}
+
+		for (level = MRTP_TIMER_WHEEL_LEVELS - 1; level > 0; --level) {
+			if ((wheel->currentTime & ((1 << MRTP_TIMER_WHEEL_SHIFT(level)) - 1)) == 0)
+				mrtp_timer_wheel_cascade(wheel, level);
+		}
+
+		if (wheel->levelCounts[0] > 0) {
+			MRtpList * slot = &wheel->slots[0][MRTP_TIMER_WHEEL_SLOT(wheel->currentTime, 0)];
+
+			while (!mrtp_list_empty(slot)) {
+				mrtp_list_insert(mrtp_list_end(expired), mrtp_list_remove(mrtp_list_begin(slot)));
+
+				--wheel->levelCounts[0];
+				--wheel->timerCount;
+			}
+
+			++wheel->currentTime;
+			continue;
+		}
+
+		// nothing is due within the slots of the empty levels, skip to the next slot of the lowest level in use,
+		// the wheel time doesn't run ahead of currentTime though, the timers scheduled next would fire late
+		for (level = 1; level < MRTP_TIMER_WHEEL_LEVELS && wheel->levelCounts[level] == 0; ++level)
+			;
+
+		nextSlot = (wheel->currentTime | ((1 << MRTP_TIMER_WHEEL_SHIFT(level)) - 1)) + 1;
+		wheel->currentTime = MRTP_TIME_LESS(currentTime, nextSlot) ? currentTime + 1 : nextSlot;
+	}
+}
+
+// the earliest time the wheel has to be advanced, the expire time of the next timer or the start of the slot
+// holding it above level 0, return 0 if no timer is armed
+int mrtp_timer_wheel_next(MRtpTimerWheel * wheel, mrtp_uint32 * nextTime) {
+
+	size_t level, slot;
+
+	if (wheel->timerCount == 0)
+		return 0;
+
+	for (level = 0; level < MRTP_TIMER_WHEEL_LEVELS; ++level) {
+		if (wheel->levelCounts[level] == 0)
+			continue;
+
+		// the slot of the wheel time itself was spread below already, above level 0
+		for (slot = MRTP_TIMER_WHEEL_SLOT(wheel->currentTime, level) + (level > 0); slot < MRTP_TIMER_WHEEL_SLOTS; ++slot) {
+			if (!mrtp_list_empty(&wheel->slots[level][slot])) {
+				mrtp_uint32 levelStart = wheel->currentTime & ~((MRTP_TIMER_WHEEL_SLOTS << MRTP_TIMER_WHEEL_SHIFT(level)) - 1);
+
+				*nextTime = levelStart + ((mrtp_uint32)slot << MRTP_TIMER_WHEEL_SHIFT(level));
+				return 1;
+			}
+		}
+	}
+
+	*nextTime = wheel->currentTime;
+	return 1;
+}
@@ -1,12 +1,17 @@
 
 #ifndef _WIN32
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE 1
+#endif
+
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <sys/ioctl.h>
 #include <sys/time.h>
 #include <arpa/inet.h>
 #include <netinet/tcp.h>
+#include <netinet/udp.h>
 #include <netdb.h>
 #include <unistd.h>
 #include <string.h>
@@ -37,6 +42,76 @@
 #endif
 #endif
 
+#ifdef __linux__
+#ifndef HAS_POLL
+#define HAS_POLL 1
+#endif
+#ifndef HAS_EPOLL
+#define HAS_EPOLL 1
+#endif
+#ifndef HAS_RECVMMSG
+#define HAS_RECVMMSG 1
+#endif
+#ifndef HAS_SENDMMSG
+#define HAS_SENDMMSG 1
+#endif
+#ifndef HAS_UDP_SEGMENT
+#define HAS_UDP_SEGMENT 1
+#endif
+#ifndef HAS_UDP_GRO
+#define HAS_UDP_GRO 1
+#endif
+#ifndef HAS_SO_TIMESTAMPNS
+#define HAS_SO_TIMESTAMPNS 1
+#endif
+#ifndef HAS_MSG_ZEROCOPY
+#define HAS_MSG_ZEROCOPY 1
+#endif
+#ifndef HAS_SO_TXTIME
+#define HAS_SO_TXTIME 1
+#endif
+#endif
+
+// segmented sends are only issued through sendmmsg
+#if defined(HAS_UDP_SEGMENT) && !defined(HAS_SENDMMSG)
+#undef HAS_UDP_SEGMENT
+#endif
+
+#if defined(HAS_UDP_SEGMENT) && !defined(UDP_SEGMENT)
+#define UDP_SEGMENT 103
+#endif
+
+// the segment size of coalesced datagrams is only read through recvmmsg
+#if defined(HAS_UDP_GRO) && !defined(HAS_RECVMMSG)
+#undef HAS_UDP_GRO
+#endif
+
+#if defined(HAS_SO_TIMESTAMPNS) && !defined(SO_TIMESTAMPNS)
+#undef HAS_SO_TIMESTAMPNS
+#endif
+
+#if defined(HAS_UDP_GRO) && !defined(UDP_GRO)
+#define UDP_GRO 104
+#endif
+
+#if defined(HAS_MSG_ZEROCOPY) && !defined(SO_ZEROCOPY)
+#define SO_ZEROCOPY 60
+#endif
+
+#if defined(HAS_MSG_ZEROCOPY) && !defined(MSG_ZEROCOPY)
+#define MSG_ZEROCOPY 0x4000000
+#endif
+
+// transmit times are only stamped through sendmmsg
+#if defined(HAS_SO_TXTIME) && !defined(HAS_SENDMMSG)
+#undef HAS_SO_TXTIME
+#endif
+
+#if defined(HAS_SO_TXTIME) && !defined(SO_TXTIME)
+#define SO_TXTIME 61
+#define SCM_TXTIME SO_TXTIME
+#endif
+
 #ifdef HAS_FCNTL
 #include <fcntl.h>
 #endif
@@ -45,6 +120,18 @@
 #include <sys/poll.h>
 #endif
 
+#ifdef HAS_EPOLL
+#include <sys/epoll.h>
+#endif
+
+#ifdef HAS_MSG_ZEROCOPY
+#include <linux/errqueue.h>
+#endif
+
+#ifdef HAS_SO_TXTIME
+#include <linux/net_tstamp.h>
+#endif
+
 #ifndef HAS_SOCKLEN_T
 typedef int socklen_t;
 #endif
@@ -82,6 +169,21 @@ void mrtp_time_set(mrtp_uint32 newTimeBase) {
 	timeBase = timeVal.tv_sec * 1000 + timeVal.tv_usec / 1000 - newTimeBase;
 }
 
+// monotonic microseconds, they wrap around every 71 minutes
+// paced datagrams are stamped with them, SO_TXTIME takes the same clock
+mrtp_uint32 mrtp_time_micro(void) {
+	struct timespec timeSpec;
+
+	clock_gettime(CLOCK_MONOTONIC, &timeSpec);
+
+	return (mrtp_uint32)(timeSpec.tv_sec * 1000000 + timeSpec.tv_nsec / 1000);
+}
+
+// convert milliseconds of the clock mrtp_time_get reads, such as a kernel receive timestamp, to mrtp time
+mrtp_uint32 mrtp_time_from_system(mrtp_uint32 systemTime) {
+	return systemTime - timeBase;
+}
+
 int mrtp_address_set_host(MRtpAddress * address, const char * name) {
 	struct hostent * hostEntry = NULL;
 #ifdef HAS_GETHOSTBYNAME_R
@@ -251,6 +353,52 @@ int mrtp_socket_set_option(MRtpSocket socket, MRtpSocketOption option, int value
 		result = setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, (char *)& value, sizeof(int));
 		break;
 
+	case MRTP_SOCKOPT_UDP_SEGMENT:
+#ifdef HAS_UDP_SEGMENT
+		// value is the default segment size, 0 lets every send choose its own
+		result = setsockopt(socket, IPPROTO_UDP, UDP_SEGMENT, (char *)& value, sizeof(int));
+#endif
+		break;
+
+	case MRTP_SOCKOPT_UDP_GRO:
+#ifdef HAS_UDP_GRO
+		result = setsockopt(socket, IPPROTO_UDP, UDP_GRO, (char *)& value, sizeof(int));
+#endif
+		break;
+
+	case MRTP_SOCKOPT_REUSEPORT:
+#ifdef SO_REUSEPORT
+		result = setsockopt(socket, SOL_SOCKET, SO_REUSEPORT, (char *)& value, sizeof(int));
+#endif
+		break;
+
+	case MRTP_SOCKOPT_TIMESTAMP:
+#ifdef HAS_SO_TIMESTAMPNS
+		result = setsockopt(socket, SOL_SOCKET, SO_TIMESTAMPNS, (char *)& value, sizeof(int));
+#endif
+		break;
+
+	case MRTP_SOCKOPT_ZEROCOPY:
+#ifdef HAS_MSG_ZEROCOPY
+		result = setsockopt(socket, SOL_SOCKET, SO_ZEROCOPY, (char *)& value, sizeof(int));
+#endif
+		break;
+
+	case MRTP_SOCKOPT_TXTIME:
+#ifdef HAS_SO_TXTIME
+		// once on it stays on, the datagrams without a transmit time are sent right away
+		if (value) {
+			struct sock_txtime txTime;
+
+			memset(&txTime, 0, sizeof(struct sock_txtime));
+			txTime.clockid = CLOCK_MONOTONIC;
+			result = setsockopt(socket, SOL_SOCKET, SO_TXTIME, (char *)& txTime, sizeof(struct sock_txtime));
+		}
+		else
+			result = 0;
+#endif
+		break;
+
 	default:
 		break;
 	}
@@ -354,10 +502,251 @@ int mrtp_socket_send(MRtpSocket socket, const MRtpAddress * address, const MRtpB
 	return sentLength;
 }
 
-int mrtp_socket_receive(MRtpSocket socket, MRtpAddress * address, MRtpBuffer * buffers, size_t bufferCount) {
+#if defined(HAS_SENDMMSG) || defined(HAS_MSG_ZEROCOPY)
+// control data of an outgoing datagram: the segment size for UDP GSO and the transmit time for SO_TXTIME
+typedef union {
+	char buf[CMSG_SPACE(sizeof(mrtp_uint16)) + CMSG_SPACE(sizeof(unsigned long long))];
+	struct cmsghdr align;
+} MRtpSocketControl;
+
+static void mrtp_socket_message_control(struct msghdr * msgHdr, MRtpSocketControl * control, const MRtpSocketMessage * message) {
+
+	struct cmsghdr * cmsg;
+	size_t controlLength = 0;
+
+	memset(control, 0, sizeof(MRtpSocketControl));
+	msgHdr->msg_control = control->buf;
+	msgHdr->msg_controllen = sizeof(control->buf);
+
+	cmsg = CMSG_FIRSTHDR(msgHdr);
+
+#ifdef HAS_UDP_SEGMENT
+	if (message->segmentSize != 0) {
+		cmsg->cmsg_level = IPPROTO_UDP;
+		cmsg->cmsg_type = UDP_SEGMENT;
+		cmsg->cmsg_len = CMSG_LEN(sizeof(mrtp_uint16));
+		*(mrtp_uint16 *)CMSG_DATA(cmsg) = (mrtp_uint16)message->segmentSize;
+
+		controlLength += CMSG_SPACE(sizeof(mrtp_uint16));
+		cmsg = CMSG_NXTHDR(msgHdr, cmsg);
+	}
+#endif
+
+#ifdef HAS_SO_TXTIME
+	if (message->sendTime != 0) {
+		struct timespec timeSpec;
+		unsigned long long currentTime, txTime;
+
+		// widen the microsecond send time to the nanoseconds of the monotonic clock
+		clock_gettime(CLOCK_MONOTONIC, &timeSpec);
+		currentTime = (unsigned long long)timeSpec.tv_sec * 1000000000 + timeSpec.tv_nsec;
+		txTime = currentTime + (long long)(int)(message->sendTime - (mrtp_uint32)(currentTime / 1000)) * 1000;
+
+		cmsg->cmsg_level = SOL_SOCKET;
+		cmsg->cmsg_type = SCM_TXTIME;
+		cmsg->cmsg_len = CMSG_LEN(sizeof(unsigned long long));
+		memcpy(CMSG_DATA(cmsg), &txTime, sizeof(unsigned long long));
+
+		controlLength += CMSG_SPACE(sizeof(unsigned long long));
+	}
+#endif
+
+	msgHdr->msg_controllen = controlLength;
+	if (controlLength == 0)
+		msgHdr->msg_control = NULL;
+}
+#endif
+
+// send the datagrams in order with a single system call where supported
+// return the number of datagrams sent, which is less than messageCount if the socket would block
+// return -2 if the first datagram is segmented and the kernel or the device can't segment it
+int mrtp_socket_send_batch(MRtpSocket socket, MRtpSocketMessage * messages, size_t messageCount) {
+
+#ifdef HAS_SENDMMSG
+	struct mmsghdr msgHdrs[MRTP_HOST_SEND_BATCH_SIZE];
+	struct sockaddr_in sins[MRTP_HOST_SEND_BATCH_SIZE];
+	MRtpSocketControl controls[MRTP_HOST_SEND_BATCH_SIZE];
+	int sentCount, i;
+
+	if (messageCount > MRTP_HOST_SEND_BATCH_SIZE)
+		messageCount = MRTP_HOST_SEND_BATCH_SIZE;
+
+	memset(msgHdrs, 0, messageCount * sizeof(struct mmsghdr));
+	memset(sins, 0, messageCount * sizeof(struct sockaddr_in));
+
+	for (i = 0; i < (int)messageCount; ++i) {
+		sins[i].sin_family = AF_INET;
+		sins[i].sin_port = MRTP_HOST_TO_NET_16(messages[i].address.port);
+		sins[i].sin_addr.s_addr = messages[i].address.host;
+
+		msgHdrs[i].msg_hdr.msg_name = &sins[i];
+		msgHdrs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+		msgHdrs[i].msg_hdr.msg_iov = (struct iovec *) messages[i].buffers;
+		msgHdrs[i].msg_hdr.msg_iovlen = messages[i].bufferCount;
+
+		if (messages[i].segmentSize != 0 || messages[i].sendTime != 0)
+			mrtp_socket_message_control(&msgHdrs[i].msg_hdr, &controls[i], &messages[i]);
+	}
+
+	sentCount = sendmmsg(socket, msgHdrs, (unsigned int)messageCount, MSG_NOSIGNAL);
+
+	if (sentCount == -1) {
+		if (errno == EWOULDBLOCK)
+			return 0;
+
+		if (messages[0].segmentSize != 0 && (errno == EIO || errno == EINVAL || errno == EOPNOTSUPP))
+			return -2;
+
+		return -1;
+	}
+
+	for (i = 0; i < sentCount; ++i)
+		messages[i].sentLength = msgHdrs[i].msg_len;
+
+	return sentCount;
+#else
+	size_t sentCount;
+
+	for (sentCount = 0; sentCount < messageCount; ++sentCount) {
+		int sentLength = mrtp_socket_send(socket, &messages[sentCount].address,
+			messages[sentCount].buffers, messages[sentCount].bufferCount);
+
+		if (sentLength < 0)
+			return sentCount > 0 ? (int)sentCount : -1;
+
+		if (sentLength == 0)
+			break;
+
+		messages[sentCount].sentLength = sentLength;
+	}
+
+	return (int)sentCount;
+#endif
+}
+
+// send one datagram with MSG_ZEROCOPY, the kernel pins the pages of the buffers instead of copying them
+// return 1 if it was sent, its completion comes on the error queue then, and the buffers must stay untouched till it does
+// return 0 if the socket would block or can't pin more pages, the datagram can still be sent by copy
+int mrtp_socket_send_zero_copy(MRtpSocket socket, MRtpSocketMessage * message) {
+
+#ifdef HAS_MSG_ZEROCOPY
+	struct msghdr msgHdr;
+	struct sockaddr_in sin;
+	MRtpSocketControl control;
+	int sentLength;
+
+	memset(&msgHdr, 0, sizeof(struct msghdr));
+	memset(&sin, 0, sizeof(struct sockaddr_in));
+
+	sin.sin_family = AF_INET;
+	sin.sin_port = MRTP_HOST_TO_NET_16(message->address.port);
+	sin.sin_addr.s_addr = message->address.host;
+
+	msgHdr.msg_name = &sin;
+	msgHdr.msg_namelen = sizeof(struct sockaddr_in);
+	msgHdr.msg_iov = (struct iovec *) message->buffers;
+	msgHdr.msg_iovlen = message->bufferCount;
+
+	if (message->segmentSize != 0 || message->sendTime != 0)
+		mrtp_socket_message_control(&msgHdr, &control, message);
+
+	sentLength = sendmsg(socket, &msgHdr, MSG_NOSIGNAL | MSG_ZEROCOPY);
+
+	if (sentLength == -1) {
+		// ENOBUFS: the pinned pages would go over the socket option memory limit
+		if (errno == EWOULDBLOCK || errno == ENOBUFS)
+			return 0;
+
+		return -1;
+	}
+
+	message->sentLength = sentLength;
+
+	return 1;
+#else
+	return 0;
+#endif
+}
+
+// read the next zero copy completion off the socket error queue, the kernel merges the completions
+// of consecutive sends, so they come as a range of completion ids from first to last
+// return 1 with a range, 0 if no completion is queued
+int mrtp_socket_zero_copy_completion(MRtpSocket socket, mrtp_uint32 * first, mrtp_uint32 * last) {
+
+#ifdef HAS_MSG_ZEROCOPY
+	union {
+		// the receive timestamp comes along when SO_TIMESTAMPNS is on
+		char buf[CMSG_SPACE(sizeof(struct timespec)) + CMSG_SPACE(sizeof(struct sock_extended_err) + sizeof(struct sockaddr_in))];
+		struct cmsghdr align;
+	} control;
+	struct msghdr msgHdr;
+	struct cmsghdr * cmsg;
+	struct sock_extended_err * error;
+
+	for (;;) {
+		memset(&msgHdr, 0, sizeof(struct msghdr));
+		msgHdr.msg_control = control.buf;
+		msgHdr.msg_controllen = sizeof(control.buf);
+
+		if (recvmsg(socket, &msgHdr, MSG_ERRQUEUE) == -1) {
+			if (errno == EWOULDBLOCK || errno == EINTR)
+				return 0;
+
+			return -1;
+		}
+
+		for (cmsg = CMSG_FIRSTHDR(&msgHdr); cmsg != NULL; cmsg = CMSG_NXTHDR(&msgHdr, cmsg)) {
+			if (cmsg->cmsg_level != SOL_IP || cmsg->cmsg_type != IP_RECVERR ||
+				cmsg->cmsg_len < CMSG_LEN(sizeof(struct sock_extended_err)))
+				continue;
+
+			error = (struct sock_extended_err *)CMSG_DATA(cmsg);
+			if (error->ee_origin == SO_EE_ORIGIN_ZEROCOPY && error->ee_errno == 0) {
+				*first = error->ee_info;
+				*last = error->ee_data;
+
+				return 1;
+			}
+		}
+
+		// not a zero copy completion, skip it
+	}
+#else
+	return 0;
+#endif
+}
+
+#ifdef HAS_SO_TIMESTAMPNS
+// the kernel receive timestamp of a datagram, or currentTime if the socket has no timestamps on
+static mrtp_uint32 mrtp_socket_receive_time(struct msghdr * msgHdr, mrtp_uint32 currentTime) {
+
+	struct cmsghdr * cmsg;
+
+	for (cmsg = CMSG_FIRSTHDR(msgHdr); cmsg != NULL; cmsg = CMSG_NXTHDR(msgHdr, cmsg)) {
+		if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SO_TIMESTAMPNS) {
+			struct timespec timeSpec;
+
+			memcpy(&timeSpec, CMSG_DATA(cmsg), sizeof(struct timespec));
+
+			return mrtp_time_from_system((mrtp_uint32)(timeSpec.tv_sec * 1000 + timeSpec.tv_nsec / 1000000));
+		}
+	}
+
+	return currentTime;
+}
+#endif
+
+static int mrtp_socket_receive_timed(MRtpSocket socket, MRtpAddress * address, MRtpBuffer * buffers, size_t bufferCount,
+	mrtp_uint32 * receivedTime) {
 
 	struct msghdr msgHdr;
 	struct sockaddr_in sin;
+#ifdef HAS_SO_TIMESTAMPNS
+	union {
+		char buf[CMSG_SPACE(sizeof(struct timespec))];
+		struct cmsghdr align;
+	} control;
+#endif
 	int recvLength;
 
 	memset(&msgHdr, 0, sizeof(struct msghdr));
@@ -370,6 +759,13 @@ int mrtp_socket_receive(MRtpSocket socket, MRtpAddress * address, MRtpBuffer * b
 	msgHdr.msg_iov = (struct iovec *) buffers;
 	msgHdr.msg_iovlen = bufferCount;
 
+#ifdef HAS_SO_TIMESTAMPNS
+	if (receivedTime != NULL) {
+		msgHdr.msg_control = control.buf;
+		msgHdr.msg_controllen = sizeof(control.buf);
+	}
+#endif
+
 	recvLength = recvmsg(socket, &msgHdr, MSG_NOSIGNAL);
 
 	if (recvLength == -1) {
@@ -390,9 +786,134 @@ int mrtp_socket_receive(MRtpSocket socket, MRtpAddress * address, MRtpBuffer * b
 		address->port = MRTP_NET_TO_HOST_16(sin.sin_port);
 	}
 
+	if (receivedTime != NULL) {
+#ifdef HAS_SO_TIMESTAMPNS
+		*receivedTime = mrtp_socket_receive_time(&msgHdr, mrtp_time_get());
+#else
+		*receivedTime = mrtp_time_get();
+#endif
+	}
+
 	return recvLength;
 }
 
+int mrtp_socket_receive(MRtpSocket socket, MRtpAddress * address, MRtpBuffer * buffers, size_t bufferCount) {
+	return mrtp_socket_receive_timed(socket, address, buffers, bufferCount, NULL);
+}
+
+// receive up to bufferCount datagrams, one per buffer, with a single system call where supported
+// if segmentSizes is not NULL, it gets the datagram size of the buffers the kernel coalesced (UDP GRO), 0 for the others
+// if receivedTimes is not NULL, it gets the kernel receive timestamps, or the time of the call if there are none
+// a datagram truncated to its buffer gets a length of 0
+int mrtp_socket_receive_batch(MRtpSocket socket, MRtpAddress * addresses, MRtpBuffer * buffers,
+	size_t * receivedLengths, size_t * segmentSizes, mrtp_uint32 * receivedTimes, size_t bufferCount) {
+
+#ifdef HAS_RECVMMSG
+	struct mmsghdr msgHdrs[MRTP_HOST_RECEIVE_BATCH_SIZE];
+	struct sockaddr_in sins[MRTP_HOST_RECEIVE_BATCH_SIZE];
+	union {
+		char buf[CMSG_SPACE(sizeof(int)) + CMSG_SPACE(sizeof(struct timespec))];
+		struct cmsghdr align;
+	} controls[MRTP_HOST_RECEIVE_BATCH_SIZE];
+	mrtp_uint32 currentTime;
+	int recvCount, i;
+
+	if (bufferCount > MRTP_HOST_RECEIVE_BATCH_SIZE)
+		bufferCount = MRTP_HOST_RECEIVE_BATCH_SIZE;
+
+	memset(msgHdrs, 0, bufferCount * sizeof(struct mmsghdr));
+
+	for (i = 0; i < (int)bufferCount; ++i) {
+		if (addresses != NULL) {
+			msgHdrs[i].msg_hdr.msg_name = &sins[i];
+			msgHdrs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+		}
+
+		msgHdrs[i].msg_hdr.msg_iov = (struct iovec *) &buffers[i];
+		msgHdrs[i].msg_hdr.msg_iovlen = 1;
+
+		if (segmentSizes != NULL || receivedTimes != NULL) {
+			msgHdrs[i].msg_hdr.msg_control = controls[i].buf;
+			msgHdrs[i].msg_hdr.msg_controllen = sizeof(controls[i].buf);
+		}
+	}
+
+	recvCount = recvmmsg(socket, msgHdrs, (unsigned int)bufferCount, MSG_NOSIGNAL, NULL);
+
+	if (recvCount == -1) {
+		if (errno == EWOULDBLOCK)
+			return 0;
+
+		return -1;
+	}
+
+	currentTime = mrtp_time_get();
+
+	for (i = 0; i < recvCount; ++i) {
+		receivedLengths[i] = msgHdrs[i].msg_len;
+
+#ifdef HAS_MSGHDR_FLAGS
+		// a datagram longer than the buffer is dropped, it stays in the batch with no data so the others are kept
+		if (msgHdrs[i].msg_hdr.msg_flags & MSG_TRUNC)
+			receivedLengths[i] = 0;
+#endif
+
+		if (segmentSizes != NULL) {
+			segmentSizes[i] = 0;
+
+#ifdef HAS_UDP_GRO
+			struct cmsghdr * cmsg;
+
+			for (cmsg = CMSG_FIRSTHDR(&msgHdrs[i].msg_hdr); cmsg != NULL; cmsg = CMSG_NXTHDR(&msgHdrs[i].msg_hdr, cmsg)) {
+				if (cmsg->cmsg_level == IPPROTO_UDP && cmsg->cmsg_type == UDP_GRO) {
+					int segmentSize;
+
+					memcpy(&segmentSize, CMSG_DATA(cmsg), sizeof(int));
+					if (segmentSize > 0 && (size_t)segmentSize < receivedLengths[i])
+						segmentSizes[i] = segmentSize;
+				}
+			}
+#endif
+		}
+
+		if (receivedTimes != NULL) {
+#ifdef HAS_SO_TIMESTAMPNS
+			receivedTimes[i] = mrtp_socket_receive_time(&msgHdrs[i].msg_hdr, currentTime);
+#else
+			receivedTimes[i] = currentTime;
+#endif
+		}
+
+		if (addresses != NULL) {
+			addresses[i].host = (mrtp_uint32)sins[i].sin_addr.s_addr;
+			addresses[i].port = MRTP_NET_TO_HOST_16(sins[i].sin_port);
+		}
+	}
+
+	return recvCount;
+#else
+	size_t recvCount;
+
+	for (recvCount = 0; recvCount < bufferCount; ++recvCount) {
+		int recvLength = mrtp_socket_receive_timed(socket, addresses != NULL ? &addresses[recvCount] : NULL,
+			&buffers[recvCount], 1, receivedTimes != NULL ? &receivedTimes[recvCount] : NULL);
+
+		if (recvLength < 0)
+			return recvCount > 0 ? (int)recvCount : -1;
+
+		if (recvLength == 0)
+			break;
+
+		receivedLengths[recvCount] = recvLength;
+
+		if (segmentSizes != NULL)
+			segmentSizes[recvCount] = 0;
+	}
+
+	return (int)recvCount;
+#endif
+}
+
 int mrtp_socketset_select(MRtpSocket maxSocket, MRtpSocketSet * readSet, MRtpSocketSet * writeSet, 
 	mrtp_uint32 timeout)
 {
@@ -439,7 +960,8 @@ int mrtp_socket_wait(MRtpSocket socket, mrtp_uint32 * condition, mrtp_uint32 tim
 	if (pollSocket.revents & POLLOUT)
 		* condition |= MRTP_SOCKET_WAIT_SEND;
 
-	if (pollSocket.revents & POLLIN)
+	// zero copy completions queued on the error queue are reaped on the receive pass
+	if (pollSocket.revents & (POLLIN | POLLERR))
 		* condition |= MRTP_SOCKET_WAIT_RECEIVE;
 
 	return 0;
@@ -487,5 +1009,165 @@ int mrtp_socket_wait(MRtpSocket socket, mrtp_uint32 * condition, mrtp_uint32 tim
 #endif
 }
 
+// wait until any of the sockets meets the condition
+int mrtp_socket_wait_multiple(const MRtpSocket * sockets, size_t socketCount, mrtp_uint32 * condition, mrtp_uint32 timeout) {
+
+#ifdef HAS_POLL
+	struct pollfd pollSockets[MRTP_HOST_MAXIMUM_SOCKETS];
+	int pollCount;
+	size_t i;
+
+	if (socketCount > MRTP_HOST_MAXIMUM_SOCKETS)
+		socketCount = MRTP_HOST_MAXIMUM_SOCKETS;
+
+	for (i = 0; i < socketCount; ++i) {
+		pollSockets[i].fd = sockets[i];
+		pollSockets[i].events = 0;
+
+		if (*condition & MRTP_SOCKET_WAIT_SEND)
+			pollSockets[i].events |= POLLOUT;
+
+		if (*condition & MRTP_SOCKET_WAIT_RECEIVE)
+			pollSockets[i].events |= POLLIN;
+	}
+
+	pollCount = poll(pollSockets, socketCount, timeout);
+
+	if (pollCount < 0) {
+		if (errno == EINTR && * condition & MRTP_SOCKET_WAIT_INTERRUPT) {
+			*condition = MRTP_SOCKET_WAIT_INTERRUPT;
+
+			return 0;
+		}
+
+		return -1;
+	}
+
+	*condition = MRTP_SOCKET_WAIT_NONE;
+
+	for (i = 0; pollCount > 0 && i < socketCount; ++i) {
+		if (pollSockets[i].revents & POLLOUT)
+			* condition |= MRTP_SOCKET_WAIT_SEND;
+
+		if (pollSockets[i].revents & (POLLIN | POLLERR))
+			* condition |= MRTP_SOCKET_WAIT_RECEIVE;
+	}
+
+	return 0;
+#else
+	fd_set readSet, writeSet;
+	struct timeval timeVal;
+	MRtpSocket maxSocket = 0;
+	int selectCount;
+	size_t i;
+
+	timeVal.tv_sec = timeout / 1000;
+	timeVal.tv_usec = (timeout % 1000) * 1000;
+
+	FD_ZERO(&readSet);
+	FD_ZERO(&writeSet);
+
+	for (i = 0; i < socketCount; ++i) {
+		if (*condition & MRTP_SOCKET_WAIT_SEND)
+			FD_SET(sockets[i], &writeSet);
+
+		if (*condition & MRTP_SOCKET_WAIT_RECEIVE)
+			FD_SET(sockets[i], &readSet);
+
+		if (sockets[i] > maxSocket)
+			maxSocket = sockets[i];
+	}
+
+	selectCount = select(maxSocket + 1, &readSet, &writeSet, NULL, &timeVal);
+
+	if (selectCount < 0) {
+		if (errno == EINTR && * condition & MRTP_SOCKET_WAIT_INTERRUPT) {
+			*condition = MRTP_SOCKET_WAIT_INTERRUPT;
+
+			return 0;
+		}
+
+		return -1;
+	}
+
+	*condition = MRTP_SOCKET_WAIT_NONE;
+
+	if (selectCount == 0)
+		return 0;
+
+	for (i = 0; i < socketCount; ++i) {
+		if (FD_ISSET(sockets[i], &writeSet))
+			* condition |= MRTP_SOCKET_WAIT_SEND;
+
+		if (FD_ISSET(sockets[i], &readSet))
+			* condition |= MRTP_SOCKET_WAIT_RECEIVE;
+	}
+
+	return 0;
+#endif
+}
+
+// the poller is an epoll descriptor, it is destroyed with mrtp_socket_destroy
+MRtpSocket mrtp_socket_poller_create(void) {
+#ifdef HAS_EPOLL
+	return epoll_create1(EPOLL_CLOEXEC);
+#else
+	return MRTP_SOCKET_NULL;
+#endif
+}
+
+int mrtp_socket_poller_add(MRtpSocket poller, MRtpSocket socket, size_t key) {
+#ifdef HAS_EPOLL
+	struct epoll_event pollEvent;
+
+	memset(&pollEvent, 0, sizeof(struct epoll_event));
+	pollEvent.events = EPOLLIN;
+	pollEvent.data.u64 = key;
+
+	return epoll_ctl(poller, EPOLL_CTL_ADD, socket, &pollEvent);
+#else
+	return -1;
+#endif
+}
+
+int mrtp_socket_poller_remove(MRtpSocket poller, MRtpSocket socket) {
+#ifdef HAS_EPOLL
+	struct epoll_event pollEvent;
+
+	memset(&pollEvent, 0, sizeof(struct epoll_event));
+
+	return epoll_ctl(poller, EPOLL_CTL_DEL, socket, &pollEvent);
+#else
+	return -1;
+#endif
+}
+
+// fill keys with the keys of the readable sockets and return how many there are
+int mrtp_socket_poller_wait(MRtpSocket poller, size_t * keys, size_t maxKeys, mrtp_uint32 timeout) {
+#ifdef HAS_EPOLL
+	struct epoll_event pollEvents[MRTP_SOCKET_POLLER_MAXIMUM_EVENTS];
+	int pollCount, i;
+
+	if (maxKeys > MRTP_SOCKET_POLLER_MAXIMUM_EVENTS)
+		maxKeys = MRTP_SOCKET_POLLER_MAXIMUM_EVENTS;
+
+	pollCount = epoll_wait(poller, pollEvents, (int)maxKeys, (int)timeout);
+
+	if (pollCount < 0) {
+		if (errno == EINTR)
+			return 0;
+
+		return -1;
+	}
+
+	for (i = 0; i < pollCount; ++i)
+		keys[i] = (size_t)pollEvents[i].data.u64;
+
+	return pollCount;
+#else
+	return -1;
+#endif
+}
+
 #endif
 
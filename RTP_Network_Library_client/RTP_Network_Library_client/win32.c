@@ -41,6 +41,20 @@ void mrtp_time_set(mrtp_uint32 newTimeBase) {
 	timeBase = (mrtp_uint32)timeGetTime() - newTimeBase;
 }
 
+// microseconds of the performance counter, they wrap around every 71 minutes
+mrtp_uint32 mrtp_time_micro(void) {
+	LARGE_INTEGER counter, frequency;
+
+	QueryPerformanceCounter(&counter);
+	QueryPerformanceFrequency(&frequency);
+
+	return (mrtp_uint32)(counter.QuadPart / frequency.QuadPart * 1000000 + counter.QuadPart % frequency.QuadPart * 1000000 / frequency.QuadPart);
+}
+
+mrtp_uint32 mrtp_time_from_system(mrtp_uint32 systemTime) {
+	return systemTime - timeBase;
+}
+
 int mrtp_address_set_host(MRtpAddress * address, const char * name) {
 	struct hostent * hostEntry;
 
@@ -327,6 +341,65 @@ int mrtp_socket_receive(MRtpSocket socket, MRtpAddress * address, MRtpBuffer * b
 	return (int)recvLength;
 }
 
+// winsock has no batched send, so send the datagrams one at a time
+int mrtp_socket_send_batch(MRtpSocket socket, MRtpSocketMessage * messages, size_t messageCount) {
+
+	size_t sentCount;
+
+	for (sentCount = 0; sentCount < messageCount; ++sentCount) {
+		int sentLength = mrtp_socket_send(socket, &messages[sentCount].address,
+			messages[sentCount].buffers, messages[sentCount].bufferCount);
+
+		if (sentLength < 0)
+			return sentCount > 0 ? (int)sentCount : -1;
+
+		if (sentLength == 0)
+			break;
+
+		messages[sentCount].sentLength = sentLength;
+	}
+
+	return (int)sentCount;
+}
+
+// winsock has no MSG_ZEROCOPY, the datagram is always sent by copy
+int mrtp_socket_send_zero_copy(MRtpSocket socket, MRtpSocketMessage * message) {
+	return 0;
+}
+
+int mrtp_socket_zero_copy_completion(MRtpSocket socket, mrtp_uint32 * first, mrtp_uint32 * last) {
+	return 0;
+}
+
+// winsock has no batched receive, so drain the socket one datagram at a time
+// there are no kernel receive timestamps either, the datagrams get the time they are read at
+int mrtp_socket_receive_batch(MRtpSocket socket, MRtpAddress * addresses, MRtpBuffer * buffers,
+	size_t * receivedLengths, size_t * segmentSizes, mrtp_uint32 * receivedTimes, size_t bufferCount) {
+
+	size_t recvCount;
+
+	for (recvCount = 0; recvCount < bufferCount; ++recvCount) {
+		int recvLength = mrtp_socket_receive(socket, addresses != NULL ? &addresses[recvCount] : NULL,
+			&buffers[recvCount], 1);
+
+		if (recvLength < 0)
+			return recvCount > 0 ? (int)recvCount : -1;
+
+		if (recvLength == 0)
+			break;
+
+		receivedLengths[recvCount] = recvLength;
+
+		if (segmentSizes != NULL)
+			segmentSizes[recvCount] = 0;
+
+		if (receivedTimes != NULL)
+			receivedTimes[recvCount] = mrtp_time_get();
+	}
+
+	return (int)recvCount;
+}
+
 int mrtp_socketset_select(MRtpSocket maxSocket, MRtpSocketSet * readSet,
 	MRtpSocketSet * writeSet, mrtp_uint32 timeout) {
 
@@ -376,5 +449,91 @@ int mrtp_socket_wait(MRtpSocket socket, mrtp_uint32 * condition, mrtp_uint32 tim
 	return 0;
 }
 
+// wait until any of the sockets meets the condition
+int mrtp_socket_wait_multiple(const MRtpSocket * sockets, size_t socketCount, mrtp_uint32 * condition, mrtp_uint32 timeout) {
+
+	fd_set readSet, writeSet;
+	struct timeval timeVal;
+	int selectCount;
+	size_t i;
+
+	timeVal.tv_sec = timeout / 1000;
+	timeVal.tv_usec = (timeout % 1000) * 1000;
+
+	FD_ZERO(&readSet);
+	FD_ZERO(&writeSet);
+
+	for (i = 0; i < socketCount; ++i) {
+		if (*condition & MRTP_SOCKET_WAIT_SEND)
+			FD_SET(sockets[i], &writeSet);
+
+		if (*condition & MRTP_SOCKET_WAIT_RECEIVE)
+			FD_SET(sockets[i], &readSet);
+	}
+
+	// the first argument of select is ignored by winsock
+	selectCount = select(0, &readSet, &writeSet, NULL, &timeVal);
+
+	if (selectCount < 0)
+		return -1;
+
+	*condition = MRTP_SOCKET_WAIT_NONE;
+
+	if (selectCount == 0)
+		return 0;
+
+	for (i = 0; i < socketCount; ++i) {
+		if (FD_ISSET(sockets[i], &writeSet))
+			*condition |= MRTP_SOCKET_WAIT_SEND;
+
+		if (FD_ISSET(sockets[i], &readSet))
+			*condition |= MRTP_SOCKET_WAIT_RECEIVE;
+	}
+
+	return 0;
+}
+
+// there is no epoll here, the reactor falls back to select
+MRtpSocket mrtp_socket_poller_create(void) {
+	return MRTP_SOCKET_NULL;
+}
+
+int mrtp_socket_poller_add(MRtpSocket poller, MRtpSocket socket, size_t key) {
+	return -1;
+}
+
+int mrtp_socket_poller_remove(MRtpSocket poller, MRtpSocket socket) {
+	return -1;
+}
+
+int mrtp_socket_poller_wait(MRtpSocket poller, size_t * keys, size_t maxKeys, mrtp_uint32 timeout) {
+	return -1;
+}
+
+// there is no io_uring here, hosts keep using the plain socket calls
+MRtpSocketRing * mrtp_socket_ring_create(MRtpSocket socket, size_t bufferCount, size_t bufferSize) {
+	return NULL;
+}
+
+void mrtp_socket_ring_destroy(MRtpSocketRing * ring) {
+}
+
+MRtpSocket mrtp_socket_ring_wait_socket(MRtpSocketRing * ring) {
+	return MRTP_SOCKET_NULL;
+}
+
+int mrtp_socket_ring_pending(MRtpSocketRing * ring) {
+	return 0;
+}
+
+int mrtp_socket_ring_send_batch(MRtpSocketRing * ring, MRtpSocketMessage * messages, size_t messageCount) {
+	return -1;
+}
+
+int mrtp_socket_ring_receive_batch(MRtpSocketRing * ring, MRtpAddress * addresses, MRtpBuffer * buffers,
+	size_t * receivedLengths, size_t * segmentSizes, mrtp_uint32 * receivedTimes, size_t bufferCount) {
+	return -1;
+}
+
 #endif
 